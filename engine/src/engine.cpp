@@ -9,38 +9,180 @@
 #define GLM_FORCE_RADIANS
 #include "glm/glm.hpp"
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <fstream>
 #include <thread>
 
 namespace mas
 {
+namespace
+{
+struct FrameStats
+{
+    f64 mean{ 0.0 };
+    f64 median{ 0.0 };
+    f64 p95{ 0.0 };
+    f64 p99{ 0.0 };
+    f64 max{ 0.0 };
+};
+
+FrameStats compute_frame_stats(std::vector<f64> samples)
+{
+    FrameStats stats{};
+    if (samples.empty())
+        return stats;
+
+    std::ranges::sort(samples);
+    const auto percentile = [&samples](const f64 p)
+    {
+        return samples[static_cast<usize>(p * static_cast<f64>(samples.size() - 1))];
+    };
+
+    for (const auto sample : samples)
+        stats.mean += sample;
+    stats.mean /= static_cast<f64>(samples.size());
+    stats.median = percentile(0.5);
+    stats.p95 = percentile(0.95);
+    stats.p99 = percentile(0.99);
+    stats.max = samples.back();
+
+    return stats;
+}
+
+// The transforms plus the extra ids and their data, one per entity or null. GlobalTransform is left to the transform
+// system, which sees the new rows as a change of their table.
+std::vector<flecs::entity_t> bulk_spawn(const flecs::world& world, const std::span<const Transform> transforms,
+                                        const std::initializer_list<std::pair<flecs::id_t, const void*>> extra)
+{
+    if (transforms.empty())
+        return {};
+
+    ecs_bulk_desc_t desc{};
+    desc.count = static_cast<i32>(transforms.size());
+
+    // Bulk init only reads the data, the array is not const because it is a C api.
+    std::array<void*, FLECS_ID_DESC_MAX> data{};
+    desc.ids[0] = world.id<Transform>().raw_id();
+    data[0] = const_cast<Transform*>(transforms.data());
+    desc.ids[1] = world.id<GlobalTransform>().raw_id();
+
+    usize count{ 2 };
+    for (const auto& [id, values] : extra)
+    {
+        desc.ids[count] = id;
+        data[count] = const_cast<void*>(values);
+        ++count;
+    }
+    desc.data = data.data();
+
+    const flecs::entity_t* entities = ecs_bulk_init(world, &desc);
+    return { entities, entities + transforms.size() };
+}
+
+void write_frame_times(const std::string& path, const std::vector<f64>& cpu_ms, const std::vector<f64>& gpu_ms)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        spdlog::error("Failed to open: {} for writing frame times", path);
+        return;
+    }
+
+    // The gpu time is the last frame the profiler resolved, which trails the cpu by the frames in flight.
+    file << "frame,cpu_ms,gpu_ms\n";
+    for (usize i{ 0 }; i < cpu_ms.size(); ++i)
+        file << i << ',' << cpu_ms[i] << ',' << gpu_ms[i] << '\n';
+
+    spdlog::info("Wrote {} frame times to: {}", cpu_ms.size(), path);
+}
+}
+
 App::App(const AppSettings& settings)
 {
     const auto threads = std::thread::hardware_concurrency();
     spdlog::info("Cores detected: {}", threads);
-    world.set_threads(static_cast<i32>(threads));
+
+    // One worker per core, except the one the main thread runs on.
+    jobs = std::make_shared<JobSystem>(threads > 1 ? threads - 1 : 1);
+    jobs->attach(world);
+    world.set<Jobs>(jobs);
 
     // Import all modules
     world.import<TransformModule>();
     world.import<WindowModule>();
     world.import<InputModule>();
     world.import<RenderModule>();
+    world.import<SpatialModule>();
 
     // Init resources
-    world.set(Window{});
-    world.get_mut<Window>()->init(settings.window_settings);
+    // Without a window the input system has nothing to match, so input stays at its defaults when headless.
+    headless = settings.render_settings.headless;
+    GLFWwindow* raw_window{ nullptr };
+    if (!headless)
+    {
+        world.set(Window{});
+        world.get_mut<Window>()->init(settings.window_settings);
+        raw_window = world.get<Window>()->get_raw_window();
+    }
 
     world.set(KeyboardInput{});
     world.set(MouseInput{});
 
-    world.set<Renderer>(std::make_shared<gfx::vulkan::Renderer>(world.get<Window>()->get_raw_window(), &world));
+    world.set<Renderer>(std::make_shared<gfx::vulkan::Renderer>(raw_window, settings.render_settings, jobs->get_executor()));
     world.set(AssetLoader{});
 
     world.get_mut<AssetLoader>()->inject_renderer(*world.get_mut<Renderer>());
 }
 
+std::vector<flecs::entity_t> App::spawn(const std::span<const Transform> transforms, const std::span<const Model> models) const
+{
+    if (models.empty())
+        return bulk_spawn(world, transforms, {});
+
+    if (models.size() != 1 && models.size() != transforms.size())
+    {
+        spdlog::error("Can not spawn {} entities with {} models", transforms.size(), models.size());
+        throw std::runtime_error("Failed to spawn entities!");
+    }
+
+    // Flecs copies component data per entity, so a shared model is repeated.
+    std::vector<Model> repeated{};
+    if (models.size() == 1 && transforms.size() > 1)
+        repeated.assign(transforms.size(), models.front());
+
+    const Model* data = repeated.empty() ? models.data() : repeated.data();
+    return bulk_spawn(world, transforms, { { world.id<Model>().raw_id(), data } });
+}
+
+std::vector<flecs::entity_t> App::spawn(const flecs::entity prefab, const std::span<const Transform> transforms) const
+{
+    if (!prefab.has(flecs::Prefab))
+    {
+        spdlog::error("Can not spawn instances of {}, it is not a prefab", prefab.name().c_str());
+        throw std::runtime_error("Failed to spawn entities!");
+    }
+
+    const auto is_a = world.pair(flecs::IsA, prefab).raw_id();
+
+    // Systems read Model per entity, an inherited one would be shared by the whole table.
+    const auto* model = prefab.get<Model>();
+    if (!model)
+        return bulk_spawn(world, transforms, { { is_a, nullptr } });
+
+    const std::vector models(transforms.size(), *model);
+    return bulk_spawn(world, transforms, { { is_a, nullptr }, { world.id<Model>().raw_id(), models.data() } });
+}
+
 void App::run() const
 {
+    if (headless)
+    {
+        run_headless();
+        return;
+    }
+
     spdlog::info("Application launching");
     f32 frame_time{ 0 };
     const auto window = world.get<Window>();
@@ -56,9 +198,7 @@ void App::run() const
 
         if (startup)
         {
-            const auto asset_loader = world.get_mut<AssetLoader>();
-            asset_loader->upload_all();
-            asset_loader->startup = false;
+            finish_startup();
             startup = false;
         }
 
@@ -69,6 +209,61 @@ void App::run() const
     close();
 }
 
+void App::run_headless() const
+{
+    spdlog::info("Application launching headless for {} frames", headless->frame_count);
+
+    // A fixed step keeps the simulation identical between runs, only the measured times vary.
+    constexpr f32 fixed_step{ 1.0f / 60.0f };
+    const auto renderer = *world.get<Renderer>();
+
+    std::vector<f64> cpu_ms{};
+    std::vector<f64> gpu_ms{};
+    cpu_ms.reserve(headless->frame_count);
+    gpu_ms.reserve(headless->frame_count);
+
+    for (u32 frame{ 0 }; frame < headless->frame_count; ++frame)
+    {
+        const auto start_time = std::chrono::high_resolution_clock::now();
+
+        if (!world.progress(fixed_step))
+            spdlog::error("Failed to progress world");
+
+        if (frame == 0)
+            finish_startup();
+
+        const auto end_time = std::chrono::high_resolution_clock::now();
+        cpu_ms.push_back(std::chrono::duration<f64, std::milli>(end_time - start_time).count());
+        gpu_ms.push_back(renderer->gpu_frame_ms());
+    }
+
+    if (!headless->stats_path.empty())
+        write_frame_times(headless->stats_path, cpu_ms, gpu_ms);
+
+    const auto warmup = std::min<usize>(headless->warmup_frames, cpu_ms.size());
+    const auto cpu = compute_frame_stats(std::vector(cpu_ms.begin() + static_cast<std::ptrdiff_t>(warmup), cpu_ms.end()));
+    const auto gpu = compute_frame_stats(std::vector(gpu_ms.begin() + static_cast<std::ptrdiff_t>(warmup), gpu_ms.end()));
+    spdlog::info("Cpu frame ms: mean {:.3f}, median {:.3f}, p95 {:.3f}, p99 {:.3f}, max {:.3f}", cpu.mean, cpu.median, cpu.p95, cpu.p99, cpu.max);
+    spdlog::info("Gpu frame ms: mean {:.3f}, median {:.3f}, p95 {:.3f}, p99 {:.3f}, max {:.3f}", gpu.mean, gpu.median, gpu.p95, gpu.p99, gpu.max);
+
+    if (!headless->capture_path.empty())
+        renderer->capture_frame(headless->capture_path);
+
+    close();
+}
+
+void App::finish_startup() const
+{
+    const auto asset_loader = world.get_mut<AssetLoader>();
+    asset_loader->upload_all(jobs->get_executor());
+    asset_loader->startup = false;
+    world.set(MeshBounds{ std::move(asset_loader->mesh_bounds) });
+    world.set(OccluderMeshes{ std::move(asset_loader->occluder_meshes) });
+
+    // Graph nodes look up meshes and shaders, so they are set up once everything has been uploaded.
+    (*world.get_mut<Renderer>())->startup_done();
+}
+
 void App::close() const
 {
     spdlog::info("Closing application");
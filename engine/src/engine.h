@@ -1,26 +1,54 @@
 #pragma once
 #include "common.h"
+#include "job_system.h"
 #include "modules/window/window_module.h"
 #include "modules/transform/transform_module.h"
+#include "modules/render/render_module.h"
+#include "modules/spatial/spatial_module.h"
 
 #include "flecs/flecs.h"
 
+#include <optional>
+#include <span>
+#include <vector>
+
 namespace mas
 {
 struct AppSettings
 {
     WindowSettings window_settings{};
+    gfx::RenderSettings render_settings{};
 };
 
 class App
 {
+    // Declared before the world, so the workers outlive every system and renderer using them.
+    Jobs jobs{};
+
 public:
     flecs::world world{};
     explicit App(const AppSettings& settings);
 
     void run() const;
 
+    // Create one entity per transform with a Transform and GlobalTransform, and a Model if models is not empty, all
+    // written straight into their final table with one allocation. models holds either one model for every entity or
+    // one per transform. Returns the new entities in the order of the transforms.
+    // Call outside of systems, for example while loading a level.
+    std::vector<flecs::entity_t> spawn(std::span<const Transform> transforms, std::span<const Model> models = {}) const;
+
+    // The same for instances of a prefab. The prefab's Model is copied to every instance, its other components are
+    // shared or overridden as usual and its children are instantiated for every instance.
+    std::vector<flecs::entity_t> spawn(flecs::entity prefab, std::span<const Transform> transforms) const;
+
 private:
+    // Fixed number of frames with a fixed time step, then frame time statistics and the optional capture.
+    void run_headless() const;
+
+    void finish_startup() const;
+
     void close() const;
+
+    std::optional<gfx::HeadlessSettings> headless{};
 };
 }
@@ -0,0 +1,59 @@
+#include "job_system.h"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace mas
+{
+namespace
+{
+JobSystem* flecs_jobs{ nullptr };
+
+// World updates are frame work, so the worker tasks keep the default high priority.
+ecs_os_thread_t flecs_task_new(const ecs_os_thread_callback_t callback, void* param)
+{
+    auto* task = new std::future<void>(flecs_jobs->get_executor().async([callback, param] { callback(param); }));
+    return reinterpret_cast<ecs_os_thread_t>(task);
+}
+
+void* flecs_task_join(const ecs_os_thread_t thread)
+{
+    const auto* task = reinterpret_cast<std::future<void>*>(thread);
+    task->wait();
+    delete task;
+    return nullptr;
+}
+}
+
+JobSystem::JobSystem(const u32 worker_count)
+    : executor(std::max(1u, worker_count))
+{
+    spdlog::info("Job system started with {} workers", executor.num_workers());
+}
+
+JobSystem::~JobSystem()
+{
+    executor.wait_for_all();
+    if (flecs_jobs == this)
+        flecs_jobs = nullptr;
+}
+
+void JobSystem::attach(const flecs::world& world)
+{
+    if (flecs_jobs && flecs_jobs != this)
+    {
+        spdlog::error("Flecs is already running on another job system");
+        throw std::runtime_error("Failed to attach job system!");
+    }
+
+    flecs_jobs = this;
+    ecs_os_api.task_new_ = flecs_task_new;
+    ecs_os_api.task_join_ = flecs_task_join;
+
+    // At least one worker always stays free, the thread calling progress may wait on the pool while the world's
+    // tasks are blocked. Plus one stage for that thread, which runs it itself.
+    world.set_task_threads(static_cast<i32>(worker_count() / 2 + 1));
+}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "common.h"
+
+#include "flecs/flecs.h"
+#include "taskflow/taskflow.hpp"
+
+#include <future>
+#include <memory>
+#include <type_traits>
+
+namespace mas
+{
+// The one pool of worker threads in the engine. Flecs' multi threaded systems, render graph recording, asset decoding
+// and the spatial workers all run on it, so they steal work from each other instead of oversubscribing the machine.
+// Frame work is queued at high priority and background work at low priority, idle workers always take queued frame
+// work first. Work that already started is never preempted, so background jobs should be split into short tasks.
+class JobSystem
+{
+public:
+    explicit JobSystem(u32 worker_count);
+    ~JobSystem();
+    DISABLE_COPY_AND_MOVE(JobSystem)
+
+    [[nodiscard]] tf::Executor& get_executor() { return executor; }
+
+    [[nodiscard]] u32 worker_count() const { return static_cast<u32>(executor.num_workers()); }
+
+    // Run the world's worker threads as tasks on the pool, created and joined around every update. A worker task
+    // blocks while the world runs single threaded systems, so the world only gets half of the workers and the rest
+    // stays free for recording and background work. Flecs' os api is process wide, only one job system can be attached.
+    void attach(const flecs::world& world);
+
+    // Queue func at low priority, the future holds its result.
+    template <typename F>
+    [[nodiscard]] std::future<std::invoke_result_t<F>> background(F&& func);
+
+private:
+    tf::Executor executor;
+};
+
+template <typename F>
+std::future<std::invoke_result_t<F>> JobSystem::background(F&& func)
+{
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(func));
+    auto future = task->get_future();
+
+    tf::Taskflow taskflow;
+    taskflow.emplace([task] { (*task)(); }).priority(tf::TaskPriority::LOW);
+    executor.run(std::move(taskflow));
+
+    return future;
+}
+
+using Jobs = std::shared_ptr<JobSystem>;
+}
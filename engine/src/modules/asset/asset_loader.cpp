@@ -344,6 +344,9 @@ AssetLoader& AssetLoader::operator=(AssetLoader&& other) noexcept
     this->binary_models_to_load = std::move(other.binary_models_to_load);
     this->model_data = std::move(other.model_data);
     this->models = std::move(other.models);
+    this->sources = std::move(other.sources);
+    this->mesh_bounds = std::move(other.mesh_bounds);
+    this->occluder_meshes = std::move(other.occluder_meshes);
 
     this->startup = other.startup;
     this->model_count = other.model_count;
@@ -375,6 +378,7 @@ Model AssetLoader::load_gltf(const std::string& path)
     model_count++;
 
     ascii_models_to_load.emplace_back(path, model);
+    sources.push_back({ path, false });
 
     return model;
 }
@@ -400,13 +404,20 @@ Model AssetLoader::load_glb(const std::string& path)
     model_count++;
 
     binary_models_to_load.emplace_back(path, model);
+    sources.push_back({ path, true });
 
     return model;
 }
 
-void AssetLoader::upload_all()
+const AssetSource* AssetLoader::get_source(const Model& model) const
 {
-    tf::Executor executor;
+    const auto index = id::index(model.mesh_id);
+    return index < sources.size() ? &sources[index] : nullptr;
+}
+
+void AssetLoader::upload_all(tf::Executor& executor)
+{
+    // Decoding is background work, frames in flight keep the workers they need.
     tf::Taskflow taskflow;
 
     for (usize i{ 0 }; i < ascii_models_to_load.size(); ++i)
@@ -419,7 +430,7 @@ void AssetLoader::upload_all()
                 load(ascii_models_to_load[i].first, false, mesh, material);
                 std::lock_guard<std::mutex> lock(mutex);
                 model_data.emplace_back(ascii_models_to_load[i].second, mesh, material);
-            });
+            }).priority(tf::TaskPriority::LOW);
     }
 
     for (usize i{ 0 }; i < binary_models_to_load.size(); ++i)
@@ -432,7 +443,7 @@ void AssetLoader::upload_all()
                 load(binary_models_to_load[i].first, true, mesh, material);
                 std::lock_guard<std::mutex> lock(mutex);
                 model_data.emplace_back(binary_models_to_load[i].second, mesh, material);
-            });
+            }).priority(tf::TaskPriority::LOW);
     }
 
     const auto start_time = std::chrono::high_resolution_clock::now();
@@ -440,6 +451,22 @@ void AssetLoader::upload_all()
     executor.run(taskflow).wait();
     const auto end_time = std::chrono::high_resolution_clock::now();
     spdlog::info("Done in {}s", std::chrono::duration<f32>(end_time - start_time).count());
+
+    mesh_bounds.resize(model_count);
+    occluder_meshes.resize(model_count);
+    for (const auto& [model, mesh, material] : model_data)
+    {
+        auto& bounds = mesh_bounds[id::index(model.mesh_id)];
+        auto& occluder = occluder_meshes[id::index(model.mesh_id)];
+        occluder.positions.reserve(mesh.vertices.size());
+        for (const auto& vertex : mesh.vertices)
+        {
+            bounds.extend(vertex.pos);
+            occluder.positions.push_back(vertex.pos);
+        }
+        occluder.indices = mesh.indices;
+    }
+
     renderer->add_models(std::move(model_data));
 }
 
@@ -1,15 +1,29 @@
 #pragma once
 #include "common.h"
 #include "modules/render/render_module.h"
+#include "modules/spatial/bounds.h"
+#include "modules/spatial/occlusion.h"
 
 #include <unordered_map>
 #include <string>
 #include <mutex>
 
+namespace tf
+{
+class Executor;
+}
+
 namespace mas
 {
 class App;
 
+// File a model was loaded from.
+struct AssetSource
+{
+    std::string path{};
+    bool binary{ false };
+};
+
 class AssetLoader
 {
     friend class App;
@@ -24,8 +38,12 @@ public:
 
     Model load_glb(const std::string& path);
 
+    // Null for models this loader did not hand out.
+    [[nodiscard]] const AssetSource* get_source(const Model& model) const;
+
 private:
-    void upload_all();
+    // Models are decoded on the executor's workers at low priority.
+    void upload_all(tf::Executor& executor);
 
     void inject_renderer(Renderer r);
 
@@ -36,7 +54,12 @@ private:
     std::unordered_map<usize, Model> models{};
     std::vector<std::pair<std::string, Model>> ascii_models_to_load{};
     std::vector<std::pair<std::string, Model>> binary_models_to_load{};
+    // By model index.
+    std::vector<AssetSource> sources{};
     std::mutex mutex{};
     std::vector<std::tuple<Model, gfx::MeshData, gfx::MaterialData>> model_data{};
+    // Local bounds by mesh index, handed to the world once everything is loaded.
+    std::vector<Aabb> mesh_bounds{};
+    std::vector<OccluderMesh> occluder_meshes{};
 };
 }
\ No newline at end of file
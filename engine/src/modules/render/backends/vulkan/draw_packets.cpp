@@ -0,0 +1,153 @@
+#include "draw_packets.h"
+
+#include "taskflow/taskflow.hpp"
+
+#include <algorithm>
+
+namespace mas::gfx::vulkan
+{
+namespace
+{
+constexpr u32 digit_bits{ 8 };
+constexpr u32 digit_count{ 1 << digit_bits };
+constexpr DrawKey digit_mask{ digit_count - 1 };
+
+// Below this a single thread sorts faster than the tasks can be scheduled.
+constexpr usize parallel_sort_threshold{ 16384 };
+constexpr usize min_chunk_size{ 4096 };
+}
+
+DrawKey make_draw_key(const DrawPass pass, const u32 pipeline, const u32 material, const u32 mesh, const u32 depth)
+{
+    using namespace draw_key;
+
+    const u32 ordered_depth = pass == DrawPass::Transparent ? ~depth : depth;
+
+    return ((DrawKey{ static_cast<u32>(pass) } << pass_shift) & pass_mask) |
+        ((DrawKey{ pipeline } << pipeline_shift) & pipeline_mask) |
+        ((DrawKey{ material } << material_shift) & material_mask) |
+        ((DrawKey{ mesh } << mesh_shift) & mesh_mask) |
+        ((DrawKey{ ordered_depth } << depth_shift) & depth_mask);
+}
+
+u32 quantize_depth(const f32 distance, const f32 z_near, const f32 z_far)
+{
+    if (z_far <= z_near)
+        return 0;
+
+    const f32 normalized = std::clamp((distance - z_near) / (z_far - z_near), 0.0f, 1.0f);
+    return static_cast<u32>(normalized * static_cast<f32>((1u << draw_key::depth_bits) - 1));
+}
+
+void DrawPacketList::sort(tf::Executor& executor)
+{
+    const usize count = packets.size();
+    if (count < 2)
+        return;
+
+    // Bits where any two keys differ, digits without one of them would leave the order as it is.
+    DrawKey differing{ 0 };
+    for (const auto& packet : packets)
+        differing |= packet.key ^ packets.front().key;
+
+    std::vector<u32> shifts{};
+    for (u32 shift{ 0 }; shift < 64; shift += digit_bits)
+    {
+        if (((differing >> shift) & digit_mask) != 0)
+            shifts.push_back(shift);
+    }
+
+    if (shifts.empty())
+        return;
+
+    scratch.resize(count);
+
+    const usize workers = executor.num_workers();
+    chunk_count = count < parallel_sort_threshold ? 1 : std::clamp<usize>(count / min_chunk_size, 1, workers);
+    chunk_size = (count + chunk_count - 1) / chunk_count;
+    chunk_digits.resize(chunk_count);
+
+    if (chunk_count == 1)
+    {
+        for (usize i{ 0 }; i < shifts.size(); ++i)
+        {
+            const auto* src = i % 2 == 0 ? packets.data() : scratch.data();
+            auto* dst = i % 2 == 0 ? scratch.data() : packets.data();
+
+            count_digits(0, shifts[i], src);
+            prefix_digits();
+            scatter_digits(0, shifts[i], src, dst);
+        }
+    }
+    else
+    {
+        // Per digit: every chunk counts its digits, one task turns the counts into offsets, then every chunk
+        // scatters its packets. Digits run one after the other, each reading what the previous one wrote.
+        tf::Taskflow taskflow;
+        tf::Task previous{};
+        for (usize i{ 0 }; i < shifts.size(); ++i)
+        {
+            const u32 shift = shifts[i];
+            const auto* src = i % 2 == 0 ? packets.data() : scratch.data();
+            auto* dst = i % 2 == 0 ? scratch.data() : packets.data();
+
+            auto prefix = taskflow.emplace([this] { prefix_digits(); });
+            auto done = taskflow.placeholder();
+
+            for (usize chunk{ 0 }; chunk < chunk_count; ++chunk)
+            {
+                auto count_task = taskflow.emplace([this, chunk, shift, src] { count_digits(chunk, shift, src); });
+                auto scatter_task = taskflow.emplace([this, chunk, shift, src, dst] { scatter_digits(chunk, shift, src, dst); });
+
+                if (!previous.empty())
+                    previous.precede(count_task);
+                count_task.precede(prefix);
+                prefix.precede(scatter_task);
+                scatter_task.precede(done);
+            }
+
+            previous = done;
+        }
+
+        executor.run(taskflow).wait();
+    }
+
+    // Every digit swaps the buffers, after an odd number of them the result is in scratch.
+    if (shifts.size() % 2 == 1)
+        packets.swap(scratch);
+}
+
+void DrawPacketList::count_digits(const usize chunk, const u32 shift, const DrawPacket* src)
+{
+    auto& digits = chunk_digits[chunk];
+    digits.fill(0);
+
+    const usize end = std::min(packets.size(), (chunk + 1) * chunk_size);
+    for (usize i{ chunk * chunk_size }; i < end; ++i)
+        ++digits[(src[i].key >> shift) & digit_mask];
+}
+
+void DrawPacketList::prefix_digits()
+{
+    // Packets with a lower digit go first, within a digit lower chunks go first, which keeps the sort stable.
+    u32 offset{ 0 };
+    for (u32 digit{ 0 }; digit < digit_count; ++digit)
+    {
+        for (auto& digits : chunk_digits)
+        {
+            const u32 digit_total = digits[digit];
+            digits[digit] = offset;
+            offset += digit_total;
+        }
+    }
+}
+
+void DrawPacketList::scatter_digits(const usize chunk, const u32 shift, const DrawPacket* src, DrawPacket* dst)
+{
+    auto& offsets = chunk_digits[chunk];
+
+    const usize end = std::min(packets.size(), (chunk + 1) * chunk_size);
+    for (usize i{ chunk * chunk_size }; i < end; ++i)
+        dst[offsets[(src[i].key >> shift) & digit_mask]++] = src[i];
+}
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include "common.h"
+
+#include <array>
+#include <span>
+#include <vector>
+
+namespace tf
+{
+class Executor;
+}
+
+namespace mas::gfx::vulkan
+{
+using DrawKey = u64;
+
+// Layout of a draw key from most to least significant bits. Sorting by the key groups draws by state, most
+// expensive to switch first, and orders draws with identical state by depth.
+namespace draw_key
+{
+constexpr u32 depth_bits{ 16 };
+constexpr u32 mesh_bits{ 20 };
+constexpr u32 material_bits{ 16 };
+constexpr u32 pipeline_bits{ 8 };
+constexpr u32 pass_bits{ 4 };
+
+constexpr u32 depth_shift{ 0 };
+constexpr u32 mesh_shift{ depth_shift + depth_bits };
+constexpr u32 material_shift{ mesh_shift + mesh_bits };
+constexpr u32 pipeline_shift{ material_shift + material_bits };
+constexpr u32 pass_shift{ pipeline_shift + pipeline_bits };
+static_assert(pass_shift + pass_bits == 64, "Draw key fields must fill 64 bits");
+
+constexpr DrawKey depth_mask{ ((DrawKey{ 1 } << depth_bits) - 1) << depth_shift };
+constexpr DrawKey mesh_mask{ ((DrawKey{ 1 } << mesh_bits) - 1) << mesh_shift };
+constexpr DrawKey material_mask{ ((DrawKey{ 1 } << material_bits) - 1) << material_shift };
+constexpr DrawKey pipeline_mask{ ((DrawKey{ 1 } << pipeline_bits) - 1) << pipeline_shift };
+constexpr DrawKey pass_mask{ ((DrawKey{ 1 } << pass_bits) - 1) << pass_shift };
+
+// Everything but depth, draws agreeing on these can be merged into one.
+constexpr DrawKey state_mask{ pass_mask | pipeline_mask | material_mask | mesh_mask };
+}
+
+enum class DrawPass : u32
+{
+    Opaque,
+    // Sorted back to front instead of front to back.
+    Transparent,
+};
+
+// Fields wider than their bits are truncated, callers check ids against fits_draw_key first.
+[[nodiscard]] DrawKey make_draw_key(DrawPass pass, u32 pipeline, u32 material, u32 mesh, u32 depth);
+
+[[nodiscard]] constexpr bool fits_draw_key(const u64 material, const u64 mesh)
+{
+    return material < (u64{ 1 } << draw_key::material_bits) && mesh < (u64{ 1 } << draw_key::mesh_bits);
+}
+
+[[nodiscard]] constexpr u32 draw_key_field(const DrawKey key, const DrawKey mask, const u32 shift)
+{
+    return static_cast<u32>((key & mask) >> shift);
+}
+
+// View distance mapped linearly to the depth field, nearest first.
+[[nodiscard]] u32 quantize_depth(f32 distance, f32 z_near, f32 z_far);
+
+struct DrawPacket
+{
+    DrawKey key{ 0 };
+    // Whatever the recording node needs to find the draw again, usually an index.
+    u32 payload{ 0 };
+};
+
+struct DrawReplayStats
+{
+    u32 packets{ 0 };
+    u32 draws{ 0 };
+    u32 pipeline_binds{ 0 };
+    u32 material_binds{ 0 };
+    u32 mesh_binds{ 0 };
+};
+
+// Draws of a frame, sorted by key and replayed with redundant state changes removed.
+class DrawPacketList
+{
+public:
+    void clear() { packets.clear(); }
+
+    void reserve(const usize count) { packets.reserve(count); }
+
+    void add(const DrawKey key, const u32 payload) { packets.push_back({ key, payload }); }
+
+    // Stable LSD radix sort over 8 bit digits, digits every key agrees on are skipped. Large lists are split into
+    // chunks that are counted and scattered on the executor's workers. Must not be called from one of its workers.
+    void sort(tf::Executor& executor);
+
+    [[nodiscard]] std::span<const DrawPacket> get_packets() const { return packets; }
+    [[nodiscard]] usize size() const { return packets.size(); }
+    [[nodiscard]] bool empty() const { return packets.empty(); }
+
+    // Walk the sorted packets. Whenever the state under state_mask changes, visitor.bind(packet, changed) is called
+    // with the first packet of the new state and the key bits that differ from the previous one. Each run of packets
+    // sharing a state is handed to visitor.draw(first, count) as a single draw.
+    template <typename Visitor>
+    DrawReplayStats replay(Visitor& visitor, DrawKey state_mask = draw_key::state_mask) const;
+
+private:
+    void count_digits(usize chunk, u32 shift, const DrawPacket* src);
+    void prefix_digits();
+    void scatter_digits(usize chunk, u32 shift, const DrawPacket* src, DrawPacket* dst);
+
+    std::vector<DrawPacket> packets{};
+    std::vector<DrawPacket> scratch{};
+
+    usize chunk_size{ 0 };
+    usize chunk_count{ 0 };
+    // Per chunk digit counts, turned into the chunk's write offsets by prefix_digits.
+    std::vector<std::array<u32, 256>> chunk_digits{};
+};
+
+template <typename Visitor>
+DrawReplayStats DrawPacketList::replay(Visitor& visitor, const DrawKey state_mask) const
+{
+    DrawReplayStats stats{};
+    stats.packets = static_cast<u32>(packets.size());
+
+    DrawKey current{ 0 };
+    usize run_start{ 0 };
+    for (usize i{ 0 }; i < packets.size(); ++i)
+    {
+        const DrawKey state = packets[i].key & state_mask;
+        if (i > 0 && state == current)
+            continue;
+
+        if (i > run_start)
+        {
+            visitor.draw(static_cast<u32>(run_start), static_cast<u32>(i - run_start));
+            ++stats.draws;
+        }
+
+        const DrawKey changed = i == 0 ? state_mask : state ^ current;
+        stats.pipeline_binds += (changed & (draw_key::pass_mask | draw_key::pipeline_mask)) != 0 ? 1 : 0;
+        stats.material_binds += (changed & draw_key::material_mask) != 0 ? 1 : 0;
+        stats.mesh_binds += (changed & draw_key::mesh_mask) != 0 ? 1 : 0;
+        visitor.bind(packets[i], changed);
+
+        current = state;
+        run_start = i;
+    }
+
+    if (run_start < packets.size())
+    {
+        visitor.draw(static_cast<u32>(run_start), static_cast<u32>(packets.size() - run_start));
+        ++stats.draws;
+    }
+
+    return stats;
+}
+}
@@ -1,227 +1,1160 @@
 #include "render_graph.h"
 
+#pragma warning( push )
+#pragma warning( disable : 4018 )
+#pragma warning( disable : 4267 )
+#include "taskflow/taskflow.hpp"
+#pragma warning( pop )
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <limits>
+#include <optional>
 #include <ranges>
+#include <span>
+#include <stdexcept>
+#include <unordered_set>
 
 namespace mas::gfx::vulkan
 {
 namespace
 {
-void topological_sort_util(const usize i, std::vector<bool>& visited, std::vector<usize>& stack, const std::vector<std::vector<usize>>& adj_vec)
+struct ResourceState
+{
+    VkPipelineStageFlags2 stages{ 0 };
+    VkAccessFlags2 access{ 0 };
+    VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+
+    // Tracking since the last write.
+    VkPipelineStageFlags2 write_stages{ 0 };
+    VkAccessFlags2 write_access{ 0 };
+    VkPipelineStageFlags2 read_stages{ 0 };
+    VkPipelineStageFlags2 visible_stages{ 0 };
+    VkAccessFlags2 visible_access{ 0 };
+};
+
+struct BarrierInfo
+{
+    VkPipelineStageFlags2 src_stages{ 0 };
+    VkAccessFlags2 src_access{ 0 };
+    VkPipelineStageFlags2 dst_stages{ 0 };
+    VkAccessFlags2 dst_access{ 0 };
+    VkImageLayout old_layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+    VkImageLayout new_layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+};
+
+// Kahn's algorithm, ties are broken by declaration order so the same graph always compiles to the same plan.
+std::vector<usize> topological_sort(const std::vector<std::vector<usize>>& adj_vec)
 {
-    visited[i] = true;
-    for (usize j : adj_vec[i])
+    std::vector<usize> in_degree(adj_vec.size(), 0);
+    for (const auto& edges : adj_vec)
+    {
+        for (const usize j : edges)
+            ++in_degree[j];
+    }
+
+    std::vector<usize> order{};
+    order.reserve(adj_vec.size());
+    for (usize i{ 0 }; i < adj_vec.size(); ++i)
     {
-        if (!visited[j])
+        if (in_degree[i] == 0)
+            order.push_back(i);
+    }
+
+    for (usize head{ 0 }; head < order.size(); ++head)
+    {
+        for (const usize j : adj_vec[order[head]])
         {
-            topological_sort_util(j, visited, stack, adj_vec);
+            if (--in_degree[j] == 0)
+                order.push_back(j);
         }
     }
 
-    stack.push_back(i);
+    if (order.size() != adj_vec.size())
+    {
+        spdlog::error("Render graph contains a cycle");
+        throw std::runtime_error("Render graph contains a cycle");
+    }
+
+    return order;
 }
 
-std::vector<usize> topological_sort(const std::vector<std::vector<usize>>& adj_vec)
+u64 hash_combine(const u64 seed, const u64 value)
+{
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+u64 hash_string(const u64 seed, const std::string& value)
+{
+    return hash_combine(seed, std::hash<std::string>{}(value));
+}
+
+constexpr VkAccessFlags2 write_access_mask{
+    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT };
+
+ResourceState usage_state(const ResourceUsage usage, const bool write, const RenderPassType pass_type)
 {
-    std::vector<usize> stack{};
-    std::vector<bool> visited(adj_vec.size());
+    const VkPipelineStageFlags2 shader_stages = pass_type == RenderPassType::Compute
+        ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+        : VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
 
-    for (auto&& b : visited)
+    ResourceState state{};
+    switch (usage)
     {
-        b = false;
+        case ResourceUsage::Uniform:
+            state.stages = shader_stages;
+            state.access = VK_ACCESS_2_UNIFORM_READ_BIT;
+            break;
+        case ResourceUsage::Vertex:
+            state.stages = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT;
+            state.access = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT;
+            break;
+        case ResourceUsage::Index:
+            state.stages = VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT;
+            state.access = VK_ACCESS_2_INDEX_READ_BIT;
+            break;
+        case ResourceUsage::Indirect:
+            state.stages = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+            state.access = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+            break;
+        case ResourceUsage::Sampled:
+            state.stages = shader_stages;
+            state.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+            state.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            break;
+        case ResourceUsage::Storage:
+            state.stages = shader_stages;
+            state.access = write ? VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT : VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+            state.layout = VK_IMAGE_LAYOUT_GENERAL;
+            break;
+        case ResourceUsage::ColorAttachment:
+            state.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+            state.access = write ? VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT : VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT;
+            state.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            break;
+        case ResourceUsage::DepthAttachment:
+            state.stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+            state.access = write ? VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT : VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+            state.layout = write ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+            break;
+        case ResourceUsage::TransferSrc:
+            state.stages = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+            state.access = VK_ACCESS_2_TRANSFER_READ_BIT;
+            state.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            break;
+        case ResourceUsage::TransferDst:
+            state.stages = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+            state.access = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            state.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            break;
     }
 
-    for (usize i{ 0 }; i < visited.size(); ++i)
+    return state;
+}
+
+// Advance the tracked state of a resource by one access and return the barrier needed in front of it, if any.
+// Reads after reads never synchronize, and a read that an earlier barrier already made visible is skipped.
+std::optional<BarrierInfo> transition(ResourceState& state, const ResourceState& required, const bool write, const bool image)
+{
+    const bool layout_change = image && state.layout != required.layout;
+
+    if (!layout_change && !write)
     {
-        if (!visited[i])
+        if (state.write_stages == 0)
         {
-            topological_sort_util(i, visited, stack, adj_vec);
+            state.read_stages |= required.stages;
+            return std::nullopt;
         }
+
+        if ((state.visible_stages & required.stages) == required.stages && (state.visible_access & required.access) == required.access)
+        {
+            state.read_stages |= required.stages;
+            return std::nullopt;
+        }
+
+        BarrierInfo barrier{};
+        barrier.src_stages = state.write_stages;
+        barrier.src_access = state.write_access;
+        barrier.dst_stages = required.stages;
+        barrier.dst_access = required.access;
+        barrier.old_layout = state.layout;
+        barrier.new_layout = state.layout;
+
+        state.read_stages |= required.stages;
+        state.visible_stages |= required.stages;
+        state.visible_access |= required.access;
+        return barrier;
     }
 
-    std::reverse(stack.begin(), stack.end());
-    return stack; 
+    BarrierInfo barrier{};
+    barrier.src_stages = state.write_stages | state.read_stages;
+    barrier.src_access = state.write_access;
+    barrier.dst_stages = required.stages;
+    barrier.dst_access = required.access;
+    barrier.old_layout = state.layout;
+    barrier.new_layout = image ? required.layout : state.layout;
+
+    // Nothing touched the resource yet and no layout change, so there is nothing to wait for.
+    if (barrier.src_stages == 0 && !layout_change)
+    {
+        state.write_stages = write ? required.stages : 0;
+        state.write_access = write ? required.access & write_access_mask : 0;
+        state.read_stages = write ? 0 : required.stages;
+        return std::nullopt;
+    }
+
+    // A layout transition counts as a write, later readers in other stages chain off the stages of this barrier.
+    state.layout = barrier.new_layout;
+    state.write_stages = required.stages;
+    state.write_access = write ? required.access & write_access_mask : 0;
+    state.read_stages = write ? 0 : required.stages;
+    state.visible_stages = write ? 0 : required.stages;
+    state.visible_access = write ? 0 : required.access;
+
+    return barrier;
 }
+
+// A dedicated compute queue can only execute compute and transfer work, so barriers recorded on it
+// must not name any graphics stage. Graphics work is ordered against it by semaphores instead.
+constexpr VkPipelineStageFlags2 async_compute_stages{
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT };
+
+void restrict_to_compute_queue(BarrierInfo& barrier)
+{
+    barrier.src_stages &= async_compute_stages;
+    barrier.dst_stages &= async_compute_stages;
+    if (barrier.src_stages == 0)
+        barrier.src_access = 0;
+    if (barrier.dst_stages == 0)
+    {
+        barrier.dst_stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        barrier.dst_access &= VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT;
+    }
 }
 
-RenderGraph::RenderGraph(std::shared_ptr<Context> c)
+void record_barriers(const VkCommandBuffer cmd, const auto& barriers)
 {
-    context = std::move(c);
+    if (barriers.image_barriers.empty() && barriers.buffer_barriers.empty())
+        return;
+
+    VkDependencyInfo dep_info{};
+    dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dep_info.pImageMemoryBarriers = barriers.image_barriers.data();
+    dep_info.imageMemoryBarrierCount = static_cast<u32>(barriers.image_barriers.size());
+    dep_info.pBufferMemoryBarriers = barriers.buffer_barriers.data();
+    dep_info.bufferMemoryBarrierCount = static_cast<u32>(barriers.buffer_barriers.size());
+
+    vkCmdPipelineBarrier2(cmd, &dep_info);
+}
+}
+
+void NodeResources::read_buffer(const std::string& name, const ResourceUsage usage)
+{
+    accesses.push_back({ name, usage, false, false });
+}
+
+void NodeResources::write_buffer(const std::string& name, const ResourceUsage usage)
+{
+    accesses.push_back({ name, usage, false, true });
+}
+
+void NodeResources::read_image(const std::string& name, const ResourceUsage usage)
+{
+    accesses.push_back({ name, usage, true, false });
+}
+
+void NodeResources::write_image(const std::string& name, const ResourceUsage usage)
+{
+    accesses.push_back({ name, usage, true, true });
+}
+
+RenderGraph::RenderGraph(std::shared_ptr<Context> c, tf::Executor& e)
+    : context(std::move(c)),
+    profiler(context, context->frames_in_flight),
+    executor(&e)
+{
+    const auto thread_count = static_cast<u32>(executor->num_workers());
+
+    // One extra set of pools for the calling thread, taskflow may run tasks inline on it.
+    command_pools = std::make_unique<ThreadCommandPools>(
+        context, context->queue_family_indices.graphics_family.value(), thread_count + 1, context->frames_in_flight);
+
+    if (context->queue_family_indices.has_compute_queue())
+    {
+        compute_command_pools = std::make_unique<ThreadCommandPools>(
+            context, context->queue_family_indices.compute_family.value(), thread_count + 1, context->frames_in_flight);
+
+        frame_compute_points.assign(context->frames_in_flight, { QueueType::Compute, 0 });
+    }
+}
+
+RenderGraph::~RenderGraph()
+{
+    // Tasks reference the plan, so the flow has to go before the passes.
+    taskflow.reset();
+
+    for (const auto allocation : transient_memory)
+        vmaFreeMemory(context->allocator, allocation);
 }
 
 void RenderGraph::setup_node_resources(ResourceManager& res) const
 {
-    for (const auto& [type, nodes] : passes)
+    // Disabled and culled nodes are prepared as well, toggling them only recompiles the plan.
+    for (const auto& entry : node_entries)
     {
-        for (const auto& node : nodes)
-        {
-            node->setup_resources(context, res);
-        }
+        entry.node->setup_resources(context, res);
     }
 }
 
 void RenderGraph::ready_node_resources(ResourceManager& res) const
 {
-    for (const auto& [type, nodes] : passes)
+    // Disabled and culled nodes are prepared as well, toggling them only recompiles the plan.
+    for (const auto& entry : node_entries)
     {
-        for (const auto& node : nodes)
-        {
-            node->ready_resources(context, res);
-        }
+        entry.node->ready_resources(context, res);
     }
 }
 
-void RenderGraph::update_node_resources(ResourceManager& res, flecs::world* world) const
+void RenderGraph::update_node_resources(ResourceManager& res, const RenderSnapshot& snapshot) const
 {
-    for (const auto& [type, nodes] : passes)
+    for (const auto& pass : passes)
     {
-        for (const auto& node : nodes)
+        for (const usize n : pass.nodes)
         {
-            node->update_resources(context, res, world);
+            node_entries[n].node->update_resources(context, res, snapshot);
         }
     }
 }
 
 void RenderGraph::setup_nodes(ResourceManager& res) const
 {
-    for (const auto& [type, nodes] : passes)
+    // Disabled and culled nodes are prepared as well, toggling them only recompiles the plan.
+    for (const auto& entry : node_entries)
     {
-        for (const auto& node : nodes)
-        {
-            node->setup(context, res);
-        }
+        entry.node->setup(context, res);
     }
 }
 
-void RenderGraph::run(const VkCommandBuffer cmd, ResourceManager& res, flecs::world* world) const
+void RenderGraph::create_transients(ResourceManager& res)
 {
-    for (const auto& [type, nodes] : passes)
+    for (const auto id : transient_textures)
+    {
+        if (const auto result = res.remove_texture(id); !result.has_value())
+            spdlog::warn("Transient image was already removed from the resource manager");
+    }
+    transient_textures.clear();
+
+    // The transients may still be in use by frames in flight, so their memory goes together with the images.
+    if (!transient_memory.empty())
+    {
+        context->timeline->retire([allocator = context->allocator, memory = std::move(transient_memory)]()
+        {
+            for (const auto allocation : memory)
+                vmaFreeMemory(allocator, allocation);
+        });
+    }
+    transient_memory.clear();
+    transient_aliases.clear();
+
+    if (transient_descs.empty())
+        return;
+
+    // Lifetime of every transient as the first and last node, in execution order, that uses it.
+    std::unordered_map<std::string, std::pair<usize, usize>> lifetimes{};
+    usize node_index{ 0 };
+    for (const auto& pass : passes)
+    {
+        for (const usize n : pass.nodes)
+        {
+            for (const auto& access : node_entries[n].resources.accesses)
+            {
+                if (!transient_descs.contains(access.name))
+                    continue;
+
+                if (const auto it = lifetimes.find(access.name); it != lifetimes.end())
+                    it->second.second = node_index;
+                else
+                    lifetimes.insert({ access.name, { node_index, node_index } });
+            }
+            ++node_index;
+        }
+    }
+
+    struct Placement
+    {
+        std::string name{};
+        TextureId texture{};
+        VkMemoryRequirements requirements{};
+        usize first{ 0 };
+        usize last{ 0 };
+        VkDeviceSize offset{ 0 };
+    };
+
+    std::vector<Placement> placements{};
+    for (const auto& [name, desc] : transient_descs)
+    {
+        // Still created for culled and disabled nodes, never touched, so it may alias anything in use.
+        if (!lifetimes.contains(name))
+            lifetimes.insert({ name, { std::numeric_limits<usize>::max(), std::numeric_limits<usize>::max() } });
+
+        const u32 width = desc.extent.width > 0 ? desc.extent.width : static_cast<u32>(static_cast<f32>(context->surface_extent.width) * desc.scale);
+        const u32 height = desc.extent.height > 0 ? desc.extent.height : static_cast<u32>(static_cast<f32>(context->surface_extent.height) * desc.scale);
+
+        Texture texture(context, VK_IMAGE_TYPE_2D, desc.format, desc.aspect, desc.usage, VK_IMAGE_TILING_OPTIMAL, VK_SAMPLE_COUNT_1_BIT,
+                        0, std::max(width, 1u), std::max(height, 1u), 1, desc.mip_levels, desc.array_layers, false);
+        const auto requirements = texture.get_memory_requirements();
+
+        const auto id = res.add_texture(std::move(texture), name);
+        if (!id.has_value())
+        {
+            spdlog::error("Transient image name: {} is already used by another texture", name);
+            throw std::runtime_error("Failed to create transient image");
+        }
+
+        transient_textures.push_back(id.value());
+        const auto [first, last] = lifetimes.at(name);
+        placements.push_back({ name, id.value(), requirements, first, last, 0 });
+    }
+
+    // Largest first, each image goes to the lowest offset not used by an image that is alive at the same time.
+    std::ranges::sort(placements, [](const Placement& a, const Placement& b) { return a.requirements.size > b.requirements.size; });
+
+    std::unordered_map<u32, std::vector<usize>> heaps{};
+    for (usize i{ 0 }; i < placements.size(); ++i)
+    {
+        auto& placement = placements[i];
+        auto& heap = heaps[placement.requirements.memoryTypeBits];
+
+        std::vector<usize> live{};
+        for (const usize j : heap)
+        {
+            if (placements[j].first <= placement.last && placement.first <= placements[j].last)
+                live.push_back(j);
+        }
+        std::ranges::sort(live, {}, [&placements](const usize j) { return placements[j].offset; });
+
+        const auto alignment = placement.requirements.alignment;
+        VkDeviceSize offset{ 0 };
+        for (const usize j : live)
+        {
+            const auto aligned = (offset + alignment - 1) / alignment * alignment;
+            if (aligned + placement.requirements.size <= placements[j].offset)
+                break;
+
+            offset = std::max(offset, placements[j].offset + placements[j].requirements.size);
+        }
+        placement.offset = (offset + alignment - 1) / alignment * alignment;
+
+        heap.push_back(i);
+    }
+
+    VkDeviceSize total_size{ 0 };
+    VkDeviceSize aliased_size{ 0 };
+    for (const auto& [memory_type_bits, heap] : heaps)
     {
-        for (const auto& node : nodes)
+        VkMemoryRequirements requirements{};
+        requirements.memoryTypeBits = memory_type_bits;
+        for (const usize i : heap)
+        {
+            requirements.size = std::max(requirements.size, placements[i].offset + placements[i].requirements.size);
+            requirements.alignment = std::max(requirements.alignment, placements[i].requirements.alignment);
+            total_size += placements[i].requirements.size;
+        }
+        aliased_size += requirements.size;
+
+        VmaAllocationCreateInfo alloc_ci{};
+        alloc_ci.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        alloc_ci.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+        VmaAllocation allocation{ nullptr };
+        if (vmaAllocateMemory(context->allocator, &requirements, &alloc_ci, &allocation, nullptr) != VK_SUCCESS)
         {
-            node->run(cmd, context, res, world);
+            spdlog::error("Failed to allocate {} bytes of transient memory", requirements.size);
+            throw std::runtime_error("Failed to allocate transient memory");
+        }
+        transient_memory.push_back(allocation);
+
+        for (const usize i : heap)
+        {
+            res.get_texture(placements[i].texture)->get().bind_memory(allocation, placements[i].offset);
+
+            auto& aliases = transient_aliases[placements[i].name];
+            for (const usize j : heap)
+            {
+                const bool overlaps = placements[i].offset < placements[j].offset + placements[j].requirements.size &&
+                    placements[j].offset < placements[i].offset + placements[i].requirements.size;
+                if (i != j && overlaps)
+                    aliases.push_back(placements[j].name);
+            }
         }
     }
+
+    spdlog::info("Render graph transients: {} images, {} bytes aliased into {} bytes", placements.size(), total_size, aliased_size);
 }
 
-void RenderGraph::draw_ui(flecs::world* world) const
+void RenderGraph::compile_barriers(ResourceManager& res)
 {
-    for (const auto& [type, nodes] : passes)
+    struct TrackedResource
     {
-        for (const auto& node : nodes)
+        ResourceState state{};
+        VkBuffer buffer{ nullptr };
+        Texture* texture{ nullptr };
+    };
+
+    struct PlannedAccess
+    {
+        usize pass{ 0 };
+        usize node{ 0 };
+        std::string name{};
+        ResourceState required{};
+        bool write{ false };
+    };
+
+    // Gather accesses in execution order, merging multiple declarations of one resource within a node.
+    std::unordered_map<std::string, TrackedResource> resources{};
+    std::vector<PlannedAccess> planned{};
+    for (usize p{ 0 }; p < passes.size(); ++p)
+    {
+        auto& pass = passes[p];
+        pass.barriers.clear();
+        pass.barriers.resize(pass.nodes.size());
+
+        for (usize n{ 0 }; n < pass.nodes.size(); ++n)
         {
-            node->draw_ui(world);
+            const usize first = planned.size();
+            for (const auto& [name, usage, image, write] : node_entries[pass.nodes[n]].resources.accesses)
+            {
+                if (!resources.contains(name))
+                {
+                    TrackedResource tracked{};
+                    if (image)
+                    {
+                        const auto texture = res.get_texture_by_name(name);
+                        if (!texture.has_value())
+                        {
+                            spdlog::error("Render graph node accesses unknown image: {}", name);
+                            throw std::runtime_error("Unknown render graph resource");
+                        }
+                        tracked.texture = &texture->get();
+                        tracked.state.layout = tracked.texture->layout;
+                    }
+                    else
+                    {
+                        const auto buffer = res.get_buffer_by_name(name);
+                        if (!buffer.has_value())
+                        {
+                            spdlog::error("Render graph node accesses unknown buffer: {}", name);
+                            throw std::runtime_error("Unknown render graph resource");
+                        }
+                        tracked.buffer = buffer->get().buffer;
+                    }
+                    resources.insert({ name, tracked });
+                }
+
+                const auto required = usage_state(usage, write, pass.type);
+                auto existing = std::find_if(planned.begin() + static_cast<isize>(first), planned.end(),
+                                             [&name](const PlannedAccess& a) { return a.name == name; });
+                if (existing == planned.end())
+                {
+                    planned.push_back({ p, n, name, required, write });
+                    continue;
+                }
+
+                if (image && existing->required.layout != required.layout)
+                {
+                    spdlog::error("Node uses image: {} in two different layouts", name);
+                    throw std::runtime_error("Conflicting image layouts within one node");
+                }
+
+                existing->required.stages |= required.stages;
+                existing->required.access |= required.access;
+                existing->write |= write;
+            }
         }
     }
+
+    // Transients sharing memory are one resource to the queues, a use of either has to be ordered against the other.
+    const auto for_each_alias = [this](const std::string& name, const auto& fn) {
+        fn(name);
+        if (const auto it = transient_aliases.find(name); it != transient_aliases.end())
+        {
+            for (const auto& alias : it->second)
+                fn(alias);
+        }
+    };
+
+    // An async pass must not touch anything an earlier graphics pass of the same frame uses, there is no semaphore
+    // in that direction. Such passes fall back to the graphics queue, which may in turn demote passes depending on them.
+    bool demoted{ true };
+    while (demoted)
+    {
+        demoted = false;
+        std::unordered_set<std::string> graphics_used{};
+        for (const auto& access : planned)
+        {
+            auto& pass = passes[access.pass];
+            if (!pass.async)
+            {
+                for_each_alias(access.name, [&](const std::string& name) { graphics_used.insert(name); });
+                continue;
+            }
+
+            if (graphics_used.contains(access.name))
+            {
+                spdlog::warn("Compute pass shares: {} or its memory with an earlier graphics pass and runs on the graphics queue", access.name);
+                pass.async = false;
+                demoted = true;
+                break;
+            }
+        }
+
+        if (demoted)
+            update_async_passes();
+    }
+
+    // Graphics passes that touch anything an async pass used earlier in the frame have to wait for it.
+    std::unordered_map<std::string, usize> last_async_use{};
+    for (auto& pass : passes)
+        pass.resource_dependencies.clear();
+    for (const auto& access : planned)
+    {
+        auto& pass = passes[access.pass];
+        if (pass.async)
+        {
+            for_each_alias(access.name, [&](const std::string& name) { last_async_use.insert_or_assign(name, access.pass); });
+            continue;
+        }
+
+        if (const auto it = last_async_use.find(access.name); it != last_async_use.end())
+            pass.resource_dependencies.push_back(it->second);
+    }
+
+    // The graph runs every frame, so the state at the start of a frame is the state at the end of the previous one.
+    // Walk the accesses twice, the first walk only establishes that steady state.
+    std::unordered_map<std::string, VkImageLayout> compiled_layouts{};
+    for (u32 iteration{ 0 }; iteration < 2; ++iteration)
+    {
+        std::unordered_set<std::string> used_this_frame{};
+
+        if (iteration == 1)
+        {
+            for (const auto& [name, tracked] : resources)
+            {
+                if (tracked.texture)
+                    compiled_layouts.insert({ name, tracked.state.layout });
+            }
+        }
+
+        for (const auto& [pass_index, node_index, name, required, write] : planned)
+        {
+            auto& tracked = resources.at(name);
+
+            // A transient starts every frame with undefined contents, but its memory may still be in use by an alias or by
+            // its own accesses of the previous frame.
+            if (const auto aliases = transient_aliases.find(name); aliases != transient_aliases.end() && !used_this_frame.contains(name))
+            {
+                ResourceState fresh{};
+                fresh.write_stages = tracked.state.write_stages | tracked.state.read_stages;
+                fresh.write_access = tracked.state.write_access;
+                for (const auto& alias : aliases->second)
+                {
+                    if (const auto it = resources.find(alias); it != resources.end())
+                    {
+                        fresh.write_stages |= it->second.state.write_stages | it->second.state.read_stages;
+                        fresh.write_access |= it->second.state.write_access;
+                    }
+                }
+                tracked.state = fresh;
+            }
+            used_this_frame.insert(name);
+
+            auto barrier = transition(tracked.state, required, write, tracked.texture != nullptr);
+
+            if (iteration == 0 || !barrier.has_value())
+                continue;
+
+            if (passes[pass_index].async)
+                restrict_to_compute_queue(barrier.value());
+
+            auto& node_barriers = passes[pass_index].barriers[node_index];
+            if (tracked.texture)
+            {
+                VkImageMemoryBarrier2 image_barrier{};
+                image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+                image_barrier.image = tracked.texture->image;
+                image_barrier.subresourceRange = { tracked.texture->aspect, 0, tracked.texture->mip_levels, 0, tracked.texture->array_layers };
+                image_barrier.srcStageMask = barrier->src_stages;
+                image_barrier.srcAccessMask = barrier->src_access;
+                image_barrier.dstStageMask = barrier->dst_stages;
+                image_barrier.dstAccessMask = barrier->dst_access;
+                image_barrier.oldLayout = barrier->old_layout;
+                image_barrier.newLayout = barrier->new_layout;
+                node_barriers.image_barriers.push_back(image_barrier);
+            }
+            else
+            {
+                VkBufferMemoryBarrier2 buffer_barrier{};
+                buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+                buffer_barrier.buffer = tracked.buffer;
+                buffer_barrier.offset = 0;
+                buffer_barrier.size = VK_WHOLE_SIZE;
+                buffer_barrier.srcStageMask = barrier->src_stages;
+                buffer_barrier.srcAccessMask = barrier->src_access;
+                buffer_barrier.dstStageMask = barrier->dst_stages;
+                buffer_barrier.dstAccessMask = barrier->dst_access;
+                node_barriers.buffer_barriers.push_back(buffer_barrier);
+            }
+        }
+    }
+
+    // Images are still in whatever layout they were created or uploaded in, bring them into the steady state once.
+    initial_barriers.clear();
+    for (const auto& [name, tracked] : resources)
+    {
+        if (!tracked.texture || transient_descs.contains(name))
+            continue;
+
+        const auto steady_layout = compiled_layouts.at(name);
+        if (tracked.texture->layout != steady_layout)
+        {
+            VkImageMemoryBarrier2 image_barrier{};
+            image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            image_barrier.image = tracked.texture->image;
+            image_barrier.subresourceRange = { tracked.texture->aspect, 0, tracked.texture->mip_levels, 0, tracked.texture->array_layers };
+            image_barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            image_barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+            image_barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            image_barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+            image_barrier.oldLayout = tracked.texture->layout;
+            image_barrier.newLayout = steady_layout;
+            initial_barriers.push_back(image_barrier);
+        }
+
+        // Every frame ends in the steady state layout.
+        tracked.texture->layout = steady_layout;
+    }
 }
 
-void RenderGraph::add_node(std::unique_ptr<RenderNode> node, const std::string& name, const std::string& pass)
+void RenderGraph::wait_async_work() const
 {
-    nodes_to_add.insert({ name, std::move(node) });
-    node_to_pass_add_map.insert({ name, pass });
+    for (const auto point : frame_compute_points)
+        context->timeline->wait(point);
 }
 
-void RenderGraph::add_node_edge(const std::string& from, const std::string& to)
+void RenderGraph::run(const u32 frame, ResourceManager& res, const RenderSnapshot& snapshot)
 {
-    if (!node_edges_to_create.contains(from))
+    command_pools->reset(frame);
+    if (compute_command_pools)
     {
-        node_edges_to_create.insert({ from, {to} });
+        // The renderer only waits for the graphics work of the slot, async work may still be in flight.
+        context->timeline->wait(frame_compute_points[frame]);
+        compute_command_pools->reset(frame);
     }
-    else
+
+    // Everything recorded in this slot has finished, so its timestamps can be read without waiting.
+    profiler.begin_frame(frame);
+
+    // Graphics work must not start before the one time transitions, even when an async pass records them.
+    const bool initial_on_compute = !initial_barriers.empty() && !passes.empty() && passes[0].async;
+
+    run_frame = frame;
+    run_resources = &res;
+    run_snapshot = &snapshot;
+    executor->run(*taskflow).wait();
+    initial_barriers.clear();
+
+    auto& timeline = *context->timeline;
+
+    // Every async pass gets its own submission and timeline value, so graphics work waits on exactly what it needs.
+    std::vector<u64> pass_values(passes.size(), 0);
+    u64 required{ 0 };
+    if (compute_command_pools)
     {
-        auto& edges = node_edges_to_create.at(from);
-        edges.emplace_back(to);
+        // Graphics work of this frame has to wait for the async passes of the previous one.
+        required = timeline.last_submitted(QueueType::Compute).value;
+
+        // And async passes of this frame must not overtake the graphics work of the previous one.
+        const auto previous_frame = timeline.wait_info(timeline.last_submitted(QueueType::Graphics));
+        bool first{ true };
+        for (usize p{ 0 }; p < passes.size(); ++p)
+        {
+            if (!passes[p].async)
+                continue;
+
+            VkCommandBufferSubmitInfo command_info{};
+            command_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+            command_info.commandBuffer = pass_command_buffers[p];
+
+            // Later submissions on the same queue are ordered by the compiled barriers.
+            const std::span<const VkSemaphoreSubmitInfo> waits(&previous_frame, first && previous_frame.value > 0 ? 1 : 0);
+            pass_values[p] = timeline.submit(QueueType::Compute, { &command_info, 1 }, waits).value;
+            first = false;
+        }
+        frame_compute_points[frame] = timeline.last_submitted(QueueType::Compute);
     }
+
+    // Split the graphics passes wherever they need a later point on the compute timeline.
+    std::vector<VkCommandBufferSubmitInfo> batch{};
+    u64 batch_wait{ 0 };
+    const auto submit_batch = [&]()
+    {
+        if (batch.empty())
+            return;
+
+        const auto wait = timeline.wait_info({ QueueType::Compute, batch_wait });
+        timeline.submit(QueueType::Graphics, batch, { &wait, batch_wait > 0 ? 1u : 0u });
+        batch.clear();
+    };
+
+    for (usize p{ 0 }; p < passes.size(); ++p)
+    {
+        const auto& pass = passes[p];
+        if (pass.async)
+            continue;
+
+        if (initial_on_compute)
+            required = std::max(required, pass_values[0]);
+        for (const usize dependency : pass.dependencies)
+            required = std::max(required, pass_values[dependency]);
+        for (const usize dependency : pass.resource_dependencies)
+            required = std::max(required, pass_values[dependency]);
+
+        if (required > batch_wait)
+        {
+            submit_batch();
+            batch_wait = required;
+        }
+
+        VkCommandBufferSubmitInfo command_info{};
+        command_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        command_info.commandBuffer = pass_command_buffers[p];
+        batch.push_back(command_info);
+    }
+    submit_batch();
+}
+
+void RenderGraph::draw_ui(flecs::world* world)
+{
+    for (const auto& entry : node_entries)
+    {
+        entry.node->draw_ui(world);
+    }
+
+    profiler.draw_ui();
+}
+
+void RenderGraph::add_node(std::unique_ptr<RenderNode> node, const std::string& name, const std::string& pass)
+{
+    node_entries.push_back({ name, pass, std::move(node), {}, true });
+}
+
+void RenderGraph::add_node_edge(const std::string& from, const std::string& to)
+{
+    node_edges.emplace_back(from, to);
+}
+
+void RenderGraph::add_transient_image(const std::string& name, const TransientImageDesc& desc)
+{
+    transient_descs.insert({ name, desc });
+}
+
+void RenderGraph::add_output(const std::string& name)
+{
+    outputs.insert(name);
 }
 
 void RenderGraph::add_pass(const std::string& name, const RenderPassType type)
 {
-    passes_to_add.insert({ name, RenderPass(type) });
+    pass_entries.push_back({ name, type, true });
 }
 
 void RenderGraph::add_pass_edge(const std::string& from, const std::string& to)
 {
-    if (!pass_edges_to_create.contains(from))
+    pass_edges.emplace_back(from, to);
+}
+
+void RenderGraph::set_pass_enabled(const std::string& name, const bool enabled)
+{
+    const auto it = std::ranges::find(pass_entries, name, &PassEntry::name);
+    if (it == pass_entries.end())
     {
-        pass_edges_to_create.insert({ from, {to} });
+        spdlog::warn("Tried to toggle unknown render pass: {}", name);
+        return;
     }
-    else
+
+    it->enabled = enabled;
+}
+
+void RenderGraph::set_node_enabled(const std::string& name, const bool enabled)
+{
+    const auto it = std::ranges::find(node_entries, name, &NodeEntry::name);
+    if (it == node_entries.end())
     {
-        auto& edges = pass_edges_to_create.at(from);
-        edges.emplace_back(to);
+        spdlog::warn("Tried to toggle unknown render node: {}", name);
+        return;
     }
+
+    it->enabled = enabled;
 }
 
-void RenderGraph::setup()
+u64 RenderGraph::topology_hash() const
 {
-    usize next_pass_id{ 0 };
-    std::vector<std::vector<usize>> render_passes(passes_to_add.size());
-    for (const auto& key: passes_to_add | std::views::keys)
+    u64 hash{ 0 };
+    for (const auto& [name, type, enabled] : pass_entries)
     {
-        const auto pass_id = usize{ next_pass_id++ };
+        hash = hash_string(hash, name);
+        hash = hash_combine(hash, static_cast<u64>(type) << 1 | static_cast<u64>(enabled));
+    }
+
+    for (const auto& entry : node_entries)
+    {
+        hash = hash_string(hash, entry.name);
+        hash = hash_string(hash, entry.pass);
+        hash = hash_combine(hash, static_cast<u64>(entry.enabled));
+        for (const auto& [name, usage, image, write] : entry.resources.accesses)
+        {
+            hash = hash_string(hash, name);
+            hash = hash_combine(hash, static_cast<u64>(usage) << 2 | static_cast<u64>(image) << 1 | static_cast<u64>(write));
+        }
+    }
 
-        RenderPass pass = std::move(passes_to_add.at(key));
+    for (const auto& [from, to] : pass_edges)
+        hash = hash_string(hash_string(hash, from), to);
+    for (const auto& [from, to] : node_edges)
+        hash = hash_string(hash_string(hash, from), to);
 
-        pass_map.insert({ pass_id, std::move(pass) });
-        named_passes.insert({ key, pass_id });
+    // Set iteration order is unspecified, so outputs are combined order independently.
+    u64 outputs_hash{ 0 };
+    for (const auto& name : outputs)
+        outputs_hash ^= std::hash<std::string>{}(name);
+
+    return hash_combine(hash, outputs_hash);
+}
+
+bool RenderGraph::setup()
+{
+    for (auto& entry : node_entries)
+    {
+        entry.resources.accesses.clear();
+        entry.node->declare_resources(entry.resources);
     }
-    passes_to_add.clear();
 
-    for (const auto& [key, value]: pass_edges_to_create)
+    const u64 hash = topology_hash();
+    if (compiled && hash == compiled_hash)
+        return false;
+
+    compile_plan();
+    compiled_hash = hash;
+    compiled = true;
+
+    return true;
+}
+
+void RenderGraph::compile_plan()
+{
+    // Names are resolved once here, everything after works on indices.
+    std::unordered_map<std::string, usize> pass_indices{};
+    for (usize i{ 0 }; i < pass_entries.size(); ++i)
+        pass_indices.insert({ pass_entries[i].name, i });
+
+    std::unordered_map<std::string, usize> node_indices{};
+    std::vector<usize> node_pass(node_entries.size());
+    for (usize i{ 0 }; i < node_entries.size(); ++i)
     {
-        for (const auto& name: value)
+        const auto it = pass_indices.find(node_entries[i].pass);
+        if (it == pass_indices.end())
         {
-            const auto pass_id = named_passes.at(key);
-            render_passes[pass_id].emplace_back(named_passes.at(name));
+            spdlog::error("Render node: {} belongs to unknown pass: {}", node_entries[i].name, node_entries[i].pass);
+            throw std::runtime_error("Render node belongs to unknown pass");
         }
+        node_pass[i] = it->second;
+        node_indices.insert({ node_entries[i].name, i });
     }
-    pass_edges_to_create.clear();
 
-    usize next_node_id{ 0 };
-    std::vector<std::vector<usize>> render_nodes(nodes_to_add.size());
-    for (const auto& key : nodes_to_add | std::views::keys)
+    const auto resolve = [](const std::unordered_map<std::string, usize>& indices, const std::string& name)
     {
-        const auto& pass_name = node_to_pass_add_map.at(key);
-        const auto& pass_id = named_passes.at(pass_name);
+        const auto it = indices.find(name);
+        if (it == indices.end())
+        {
+            spdlog::error("Render graph edge references unknown pass or node: {}", name);
+            throw std::runtime_error("Render graph edge references unknown pass or node");
+        }
+        return it->second;
+    };
 
-        const auto node_id = usize{ next_node_id++ };
-        std::unique_ptr<RenderNode> node = std::move(nodes_to_add.at(key));
+    std::vector<std::vector<usize>> pass_adj(pass_entries.size());
+    std::vector<std::vector<usize>> pass_predecessors(pass_entries.size());
+    for (const auto& [from, to] : pass_edges)
+    {
+        const usize from_index = resolve(pass_indices, from);
+        const usize to_index = resolve(pass_indices, to);
+        pass_adj[from_index].push_back(to_index);
+        pass_predecessors[to_index].push_back(from_index);
+    }
+
+    // Nodes execute grouped by pass, so only edges within one pass affect their order.
+    std::vector<std::vector<usize>> node_adj(node_entries.size());
+    for (const auto& [from, to] : node_edges)
+    {
+        const usize from_index = resolve(node_indices, from);
+        const usize to_index = resolve(node_indices, to);
+        if (node_pass[from_index] == node_pass[to_index])
+            node_adj[from_index].push_back(to_index);
+    }
 
-        node_map.insert({ node_id, std::move(node) });
-        named_nodes.insert({ key, node_id });
-        node_to_pass.insert({ node_id, pass_id });
+    std::vector<std::vector<usize>> pass_nodes(pass_entries.size());
+    for (const usize n : topological_sort(node_adj))
+    {
+        if (node_entries[n].enabled && pass_entries[node_pass[n]].enabled)
+            pass_nodes[node_pass[n]].push_back(n);
     }
-    nodes_to_add.clear();
+    const auto pass_order = topological_sort(pass_adj);
 
-    for (const auto& [key, value] : node_edges_to_create)
+    // Walk backwards, a node is live if a live node later in the frame reads what it writes. Writes to anything
+    // but transients outlive the frame, and a node declaring no writes may have effects the graph cannot see.
+    std::unordered_set<std::string> consumed{};
+    usize culled{ 0 };
+    for (const usize p : std::views::reverse(pass_order))
     {
-        for (const auto& name : value)
+        auto& live_nodes = pass_nodes[p];
+        std::vector<usize> kept{};
+        for (const usize n : std::views::reverse(live_nodes))
         {
-            const auto node_id = named_nodes.at(key);
-            const auto pass_id = node_to_pass.at(node_id);
-            render_nodes[node_id].emplace_back(named_nodes.at(name));
+            const auto& accesses = node_entries[n].resources.accesses;
+
+            bool writes{ false };
+            bool live{ false };
+            for (const auto& access : accesses)
+            {
+                if (!access.write)
+                    continue;
+
+                writes = true;
+                live = live || !access.image || !transient_descs.contains(access.name) ||
+                    consumed.contains(access.name) || outputs.contains(access.name);
+            }
 
+            if (writes && !live)
+            {
+                ++culled;
+                continue;
+            }
+
+            for (const auto& access : accesses)
+            {
+                if (!access.write)
+                    consumed.insert(access.name);
+            }
+            kept.push_back(n);
         }
+
+        std::ranges::reverse(kept);
+        live_nodes = std::move(kept);
     }
 
-    const auto pass = topological_sort(render_passes);
-    const auto nodes = topological_sort(render_nodes);
-    for (usize i : pass)
+    taskflow.reset();
+    passes.clear();
+
+    std::vector<usize> plan_index(pass_entries.size(), std::numeric_limits<usize>::max());
+    for (const usize p : pass_order)
     {
-        RenderPass p = std::move(pass_map.at(i));
+        if (pass_nodes[p].empty())
+            continue;
+
+        plan_index[p] = passes.size();
+
+        RenderPass pass{};
+        pass.name = pass_entries[p].name;
+        pass.type = pass_entries[p].type;
+        pass.nodes = std::move(pass_nodes[p]);
+        passes.push_back(std::move(pass));
+    }
 
-        for (usize j : nodes)
+    // Pass edges in terms of the plan, edges through culled passes are followed to the live passes behind them.
+    for (const usize p : pass_order)
+    {
+        if (plan_index[p] == std::numeric_limits<usize>::max())
+            continue;
+
+        auto& dependencies = passes[plan_index[p]].dependencies;
+        std::vector<bool> visited(pass_entries.size(), false);
+        std::vector<usize> stack = pass_predecessors[p];
+        while (!stack.empty())
         {
-            if (node_to_pass.at(j) == i)
-            {
-                std::unique_ptr<RenderNode> n = std::move(node_map.at(j));
-                p.nodes.emplace_back(std::move(n));
-            }
+            const usize predecessor = stack.back();
+            stack.pop_back();
+            if (visited[predecessor])
+                continue;
+            visited[predecessor] = true;
+
+            if (plan_index[predecessor] != std::numeric_limits<usize>::max())
+                dependencies.push_back(plan_index[predecessor]);
+            else
+                stack.insert(stack.end(), pass_predecessors[predecessor].begin(), pass_predecessors[predecessor].end());
         }
+    }
+
+    for (auto& pass : passes)
+        pass.async = pass.type == RenderPassType::Compute && context->queue_family_indices.has_compute_queue();
+    update_async_passes();
+
+    pass_command_buffers.assign(passes.size(), nullptr);
+
+    taskflow = std::make_unique<tf::Taskflow>();
+    for (usize p{ 0 }; p < passes.size(); ++p)
+    {
+        taskflow->emplace(
+            [this, p]()
+            {
+                const auto& pass = passes[p];
+                const i32 worker = executor->this_worker_id();
+                const u32 thread = worker < 0 ? static_cast<u32>(executor->num_workers()) : static_cast<u32>(worker);
+
+                const auto cmd = pass.async ? compute_command_pools->begin(thread, run_frame) : command_pools->begin(thread, run_frame);
+                const bool profile = !pass.async || profiler.has_compute_timestamps();
+                const u32 pass_scope = profile ? profiler.begin_scope(cmd, pass.name) : invalid_profiler_scope;
+
+                // Only the first pass in submission order may record the one time transitions.
+                if (p == 0 && !initial_barriers.empty())
+                {
+                    VkDependencyInfo dep_info{};
+                    dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+                    dep_info.pImageMemoryBarriers = initial_barriers.data();
+                    dep_info.imageMemoryBarrierCount = static_cast<u32>(initial_barriers.size());
 
-        passes.emplace_back(std::move(p));
+                    vkCmdPipelineBarrier2(cmd, &dep_info);
+                }
+
+                for (usize i{ 0 }; i < pass.nodes.size(); ++i)
+                {
+                    if (i < pass.barriers.size())
+                        record_barriers(cmd, pass.barriers[i]);
+
+                    const auto& entry = node_entries[pass.nodes[i]];
+                    const u32 node_scope = profile ? profiler.begin_scope(cmd, entry.name, 1) : invalid_profiler_scope;
+                    entry.node->run(cmd, context, *run_resources, *run_snapshot);
+                    if (profile)
+                        profiler.end_scope(cmd, node_scope);
+                }
+
+                if (profile)
+                    profiler.end_scope(cmd, pass_scope);
+                vkEndCommandBuffer(cmd);
+                pass_command_buffers[p] = cmd;
+            });
+    }
+
+    spdlog::info("Render graph compiled: {} passes, {} nodes culled", passes.size(), culled);
+}
+
+void RenderGraph::update_async_passes()
+{
+    // Passes are in execution order, so every dependency is final by the time a pass is visited.
+    for (auto& pass : passes)
+    {
+        for (const usize dependency : pass.dependencies)
+            pass.async = pass.async && passes[dependency].async;
     }
-    pass_map.clear();
-    node_map.clear();
-    node_to_pass.clear();
 }
 }
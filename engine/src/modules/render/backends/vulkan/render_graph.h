@@ -1,13 +1,70 @@
 #pragma once
 #include "vk_context.h"
+#include "vk_command.h"
+#include "vk_profiler.h"
 #include "resources/vk_resource_manager.h"
 
 #include <string>
+#include <unordered_set>
+
+namespace tf
+{
+class Executor;
+class Taskflow;
+}
 
 namespace mas::gfx::vulkan
 {
 class RenderGraph;
 
+enum class ResourceUsage
+{
+    Uniform,
+    Vertex,
+    Index,
+    Indirect,
+    Sampled,
+    Storage,
+    ColorAttachment,
+    DepthAttachment,
+    TransferSrc,
+    TransferDst,
+};
+
+struct ResourceAccess
+{
+    std::string name{};
+    ResourceUsage usage{ ResourceUsage::Sampled };
+    bool image{ false };
+    bool write{ false };
+};
+
+// Image owned by the graph that only lives between its first and last use within a frame.
+// Transients whose lifetimes do not overlap share memory.
+struct TransientImageDesc
+{
+    VkFormat format{ VK_FORMAT_R8G8B8A8_UNORM };
+    VkImageUsageFlags usage{ 0 };
+    VkImageAspectFlags aspect{ VK_IMAGE_ASPECT_COLOR_BIT };
+    // Size relative to the swapchain, ignored if extent is set.
+    f32 scale{ 1.0f };
+    VkExtent2D extent{ 0, 0 };
+    u32 mip_levels{ 1 };
+    u32 array_layers{ 1 };
+};
+
+// Collects the named buffers and images a node touches, the graph derives all barriers from these.
+class NodeResources
+{
+public:
+    void read_buffer(const std::string& name, ResourceUsage usage);
+    void write_buffer(const std::string& name, ResourceUsage usage);
+    void read_image(const std::string& name, ResourceUsage usage);
+    void write_image(const std::string& name, ResourceUsage usage);
+
+    std::vector<ResourceAccess> accesses{};
+};
+
 class RenderNode
 {
 public:
@@ -22,15 +79,20 @@ public:
     virtual void ready_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager) {}
 
     // Update shader resources. For example update buffer with data from cpu. Only update resources created in this node.
-    virtual void update_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager, flecs::world* world) {}
+    // Runs on the render thread, scene data comes from the snapshot rather than the world.
+    virtual void update_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot) {}
+
+    // Declare every named resource this node reads or writes, and how. Used to generate barriers between nodes.
+    virtual void declare_resources(NodeResources& resources) {}
 
     // Create pipeline and any descriptors.
     virtual void setup(const std::shared_ptr<Context>& context, ResourceManager& resource_manager) {}
 
     // Record commands to the command buffer for execution.
-    virtual void run(VkCommandBuffer cmd, const std::shared_ptr<Context>& context, ResourceManager& resource_manager, flecs::world* world) {}
+    // Nodes of different passes record concurrently on worker threads, nodes within one pass record in order.
+    virtual void run(VkCommandBuffer cmd, const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot) {}
 
-    // Use Imgui to create ui for this node.
+    // Use Imgui to create ui for this node. Runs on the main thread while the render thread is idle.
     virtual void draw_ui(flecs::world* world) {}
 
 };
@@ -43,34 +105,80 @@ enum class RenderPassType
 
 class RenderGraph
 {
+    struct NodeBarriers
+    {
+        std::vector<VkImageMemoryBarrier2> image_barriers{};
+        std::vector<VkBufferMemoryBarrier2> buffer_barriers{};
+    };
+
+    struct PassEntry
+    {
+        std::string name{};
+        RenderPassType type{ RenderPassType::Render };
+        bool enabled{ true };
+    };
+
+    struct NodeEntry
+    {
+        std::string name{};
+        std::string pass{};
+        std::unique_ptr<RenderNode> node{ nullptr };
+        // Declarations as of the last setup, part of the topology hash.
+        NodeResources resources{};
+        bool enabled{ true };
+    };
+
+    // One pass of the compiled execution plan, nodes are indices into node_entries in execution order.
     struct RenderPass
     {
-        RenderPass(RenderPassType type) : type(type) {}
-        ~RenderPass() = default;
-        DISABLE_COPY(RenderPass)
-        RenderPass(RenderPass&& other) = default;
-        RenderPass& operator=(RenderPass&&) = default;
-
-        RenderPassType type;
-        std::vector<std::unique_ptr<RenderNode>> nodes;
+        std::string name{};
+        RenderPassType type{ RenderPassType::Render };
+        std::vector<usize> nodes;
+        std::vector<NodeBarriers> barriers;
+
+        // Indices of the passes this pass waits on, from pass edges and from shared resources.
+        std::vector<usize> dependencies;
+        std::vector<usize> resource_dependencies;
+        // Compute passes that only depend on other async passes run on the async compute queue.
+        bool async{ false };
     };
 
 public:
-    explicit RenderGraph(std::shared_ptr<Context> c);
-    ~RenderGraph() = default;
+    // Passes are recorded on the executor's workers.
+    RenderGraph(std::shared_ptr<Context> c, tf::Executor& e);
+    ~RenderGraph();
     DISABLE_COPY_AND_MOVE(RenderGraph)
 
     void setup_node_resources(ResourceManager& res) const;
 
     void ready_node_resources(ResourceManager& res) const;
 
-    void update_node_resources(ResourceManager& res, flecs::world* world) const;
+    void update_node_resources(ResourceManager& res, const RenderSnapshot& snapshot) const;
 
     void setup_nodes(ResourceManager& res) const;
 
-    void run(const VkCommandBuffer cmd, ResourceManager& res, flecs::world* world) const;
+    // (Re)create all transient images for the current swapchain size and place them in aliased memory.
+    void create_transients(ResourceManager& res);
+
+    // Resolve the resources declared by the nodes and generate the barriers recorded in front of each node.
+    void compile_barriers(ResourceManager& res);
+
+    // Wait for the async compute work of every frame slot, the renderer waits for the graphics work itself.
+    void wait_async_work() const;
+
+    // Record every pass into its own command buffer on worker threads and submit them. Graphics passes are split
+    // into batches wherever they have to wait for async compute.
+    // Must only be called once the graphics work of the frame slot has finished.
+    void run(u32 frame, ResourceManager& res, const RenderSnapshot& snapshot);
+
+    // Node ui and the gpu profiler timeline.
+    void draw_ui(flecs::world* world);
 
-    void draw_ui(flecs::world* world) const;
+    [[nodiscard]] GpuProfiler& get_profiler() { return profiler; }
+    [[nodiscard]] const GpuProfiler& get_profiler() const { return profiler; }
+
+    // The recording workers, shared with the rest of the engine. Nodes may use them while updating resources.
+    [[nodiscard]] tf::Executor& get_executor() { return *executor; }
 
     void add_node(std::unique_ptr<RenderNode> node, const std::string& name, const std::string& pass);
 
@@ -80,25 +188,59 @@ public:
 
     void add_pass_edge(const std::string& from, const std::string& to);
 
-    void setup();
+    void add_transient_image(const std::string& name, const TransientImageDesc& desc);
+
+    // Keep every node contributing to this resource alive, even if no node of the graph reads it.
+    void add_output(const std::string& name);
+
+    void set_pass_enabled(const std::string& name, bool enabled);
+
+    void set_node_enabled(const std::string& name, bool enabled);
+
+    // Compile the execution plan, culling nodes whose writes nobody reads. Cheap when nothing changed, so it can run
+    // every frame. Returns true if the plan was rebuilt, transients and barriers then have to be recreated.
+    bool setup();
 
 private:
-    std::shared_ptr<Context> context{ nullptr };
+    void compile_plan();
 
-    std::vector<RenderPass> passes;
+    void update_async_passes();
 
-    std::unordered_map<std::string, usize> named_nodes;
-    std::unordered_map<std::string, usize> named_passes;
+    [[nodiscard]] u64 topology_hash() const;
 
-    std::unordered_map<std::string, std::unique_ptr<RenderNode>> nodes_to_add;
-    std::unordered_map<std::string, std::string> node_to_pass_add_map;
-    std::unordered_map<std::string, RenderPass> passes_to_add;
+    std::shared_ptr<Context> context{ nullptr };
+    GpuProfiler profiler;
 
-    std::unordered_map<std::string, std::vector<std::string>> node_edges_to_create;
-    std::unordered_map<std::string, std::vector<std::string>> pass_edges_to_create;
+    std::vector<PassEntry> pass_entries;
+    std::vector<NodeEntry> node_entries;
+    std::vector<std::pair<std::string, std::string>> pass_edges;
+    std::vector<std::pair<std::string, std::string>> node_edges;
+    std::unordered_set<std::string> outputs;
 
-    std::unordered_map<usize, RenderPass> pass_map;
-    std::unordered_map<usize, std::unique_ptr<RenderNode>> node_map;
-    std::unordered_map<usize, usize> node_to_pass;
+    // Compiled execution plan, only live passes and nodes.
+    std::vector<RenderPass> passes;
+    u64 compiled_hash{ 0 };
+    bool compiled{ false };
+
+    tf::Executor* executor{ nullptr };
+    // Built once per plan, the tasks read the frame arguments below.
+    std::unique_ptr<tf::Taskflow> taskflow;
+    u32 run_frame{ 0 };
+    ResourceManager* run_resources{ nullptr };
+    const RenderSnapshot* run_snapshot{ nullptr };
+    std::unique_ptr<ThreadCommandPools> command_pools;
+    std::unique_ptr<ThreadCommandPools> compute_command_pools;
+    std::vector<VkCommandBuffer> pass_command_buffers;
+    // Last async compute submission of every frame slot.
+    std::vector<TimelinePoint> frame_compute_points;
+
+    // Transitions from the layouts images were in when the graph was compiled, recorded once on the next run.
+    std::vector<VkImageMemoryBarrier2> initial_barriers;
+
+    std::unordered_map<std::string, TransientImageDesc> transient_descs;
+    std::vector<TextureId> transient_textures;
+    std::vector<VmaAllocation> transient_memory;
+    // Transients sharing memory with each other, the first use of one has to wait for the others.
+    std::unordered_map<std::string, std::vector<std::string>> transient_aliases;
 };
 }
\ No newline at end of file
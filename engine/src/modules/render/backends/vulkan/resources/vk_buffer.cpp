@@ -37,11 +37,14 @@ Buffer::Buffer(std::shared_ptr<Context> c, const VkDeviceSize size, const VkBuff
 {
     context = std::move(c);
 
+    const auto queue_families = context->shared_queue_families();
+
     VkBufferCreateInfo buffer_ci{};
     buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buffer_ci.usage = usage_flags;
-    buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    buffer_ci.pQueueFamilyIndices = &context->queue_family_indices.graphics_family.value();
+    buffer_ci.sharingMode = queue_families.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    buffer_ci.queueFamilyIndexCount = static_cast<u32>(queue_families.size());
+    buffer_ci.pQueueFamilyIndices = queue_families.data();
     buffer_ci.size = size;
     buffer_ci.pNext = nullptr;
 
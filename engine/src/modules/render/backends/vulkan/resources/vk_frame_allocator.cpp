@@ -0,0 +1,92 @@
+#include "vk_frame_allocator.h"
+
+#include "spdlog/spdlog.h"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace mas::gfx::vulkan
+{
+namespace
+{
+VkDeviceSize align_up(const VkDeviceSize value, const VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+VkDeviceSize device_min_alignment(const VkPhysicalDevice phys_device)
+{
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(phys_device, &properties);
+
+    return std::max(properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment);
+}
+}
+
+FrameAllocator::FrameAllocator(std::shared_ptr<Context> c, const u32 frame_count, const VkDeviceSize size_per_frame)
+    : context(std::move(c)),
+    buffer(context, size_per_frame * frame_count,
+           VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+           VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT),
+    frame_size(size_per_frame),
+    min_alignment(device_min_alignment(context->phys_device))
+{
+    buffer.set_debug_name("FrameAllocator");
+
+    VkBufferDeviceAddressInfo address_info{};
+    address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    address_info.buffer = buffer.buffer;
+    base_address = vkGetBufferDeviceAddress(context->device, &address_info);
+}
+
+void FrameAllocator::begin_frame(const u32 frame)
+{
+    assert(frame * frame_size < buffer.allocation_info.size);
+
+    current_frame = frame;
+    head.store(0, std::memory_order_relaxed);
+}
+
+void FrameAllocator::flush() const
+{
+    if (const auto used = head.load(std::memory_order_relaxed); used > 0)
+        vmaFlushAllocation(context->allocator, buffer.allocation, current_frame * frame_size, std::min(used, frame_size));
+}
+
+FrameAllocation FrameAllocator::allocate(const VkDeviceSize size, const VkDeviceSize alignment)
+{
+    const auto align = std::max(alignment, min_alignment);
+
+    VkDeviceSize offset = head.load(std::memory_order_relaxed);
+    VkDeviceSize aligned{ 0 };
+    do
+    {
+        aligned = align_up(offset, align);
+        if (aligned + size > frame_size)
+        {
+            spdlog::error("Frame allocator out of memory, requested: {0} with {1} of {2} bytes used", size, offset, frame_size);
+            throw std::runtime_error("Frame allocator out of memory");
+        }
+    }
+    while (!head.compare_exchange_weak(offset, aligned + size, std::memory_order_relaxed));
+
+    const auto buffer_offset = current_frame * frame_size + aligned;
+
+    FrameAllocation allocation{};
+    allocation.buffer = buffer.buffer;
+    allocation.offset = buffer_offset;
+    allocation.size = size;
+    allocation.device_address = base_address + buffer_offset;
+    allocation.mapped = static_cast<u8*>(buffer.allocation_info.pMappedData) + buffer_offset;
+
+    return allocation;
+}
+
+FrameAllocation FrameAllocator::push(const void* data, const VkDeviceSize size, const VkDeviceSize alignment)
+{
+    auto allocation = allocate(size, alignment);
+    memcpy(allocation.mapped, data, size);
+
+    return allocation;
+}
+}
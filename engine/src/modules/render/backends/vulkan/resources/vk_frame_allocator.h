@@ -0,0 +1,58 @@
+#pragma once
+#include "../vk_context.h"
+#include "vk_buffer.h"
+
+#include <atomic>
+
+namespace mas::gfx::vulkan
+{
+constexpr VkDeviceSize default_frame_allocator_size{ 8 * 1024 * 1024 };
+
+// A sub range of the frame allocator's buffer, only valid until the same frame slot comes around again.
+struct FrameAllocation
+{
+    VkBuffer buffer{ nullptr };
+    VkDeviceSize offset{ 0 };
+    VkDeviceSize size{ 0 };
+    VkDeviceAddress device_address{ 0 };
+    void* mapped{ nullptr };
+};
+
+// Linear allocator over one persistently mapped buffer, split into one region per frame in flight.
+// Allocation is a lock free bump of an offset, so per frame constants cost a memcpy and nothing else.
+class FrameAllocator
+{
+public:
+    FrameAllocator() = delete;
+    ~FrameAllocator() = default;
+    DISABLE_COPY_AND_MOVE(FrameAllocator)
+    FrameAllocator(std::shared_ptr<Context> c, u32 frame_count, VkDeviceSize size_per_frame = default_frame_allocator_size);
+
+    // Must only be called once the graphics work of the frame slot has finished, everything allocated in that slot is reclaimed.
+    void begin_frame(u32 frame);
+
+    // Make the writes of the current frame visible to the device, a no-op on coherent memory.
+    void flush() const;
+
+    [[nodiscard]] FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+
+    [[nodiscard]] FrameAllocation push(const void* data, VkDeviceSize size, VkDeviceSize alignment = 0);
+
+    template <typename T>
+    [[nodiscard]] FrameAllocation push(const T& data, const VkDeviceSize alignment = 0)
+    {
+        return push(&data, sizeof(T), alignment);
+    }
+
+    [[nodiscard]] VkBuffer get_buffer() const { return buffer.buffer; }
+
+private:
+    std::shared_ptr<Context> context{ nullptr };
+    Buffer buffer;
+    VkDeviceAddress base_address{ 0 };
+    VkDeviceSize frame_size{ 0 };
+    VkDeviceSize min_alignment{ 0 };
+    u32 current_frame{ 0 };
+    std::atomic<VkDeviceSize> head{ 0 };
+};
+}
@@ -2,13 +2,42 @@
 
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
+#include <fstream>
 #include <ranges>
 #include <stdexcept>
 
 namespace mas::gfx::vulkan
 {
+namespace
+{
+// Sphere around the center of the bounding box, not the tightest fit but cheap and stable.
+glm::vec4 mesh_bounds(const std::vector<VertexP3N3U2T4>& vertices)
+{
+    if (vertices.empty())
+        return glm::vec4{ 0.0f };
+
+    glm::vec3 min{ vertices.front().pos };
+    glm::vec3 max{ vertices.front().pos };
+    for (const auto& vertex : vertices)
+    {
+        min = glm::min(min, vertex.pos);
+        max = glm::max(max, vertex.pos);
+    }
+
+    const glm::vec3 center = (min + max) * 0.5f;
+    f32 radius{ 0.0f };
+    for (const auto& vertex : vertices)
+        radius = std::max(radius, glm::length(vertex.pos - center));
+
+    return { center, radius };
+}
+}
+
 ResourceManager::ResourceManager(std::shared_ptr<Context> c)
-    : context(std::move(c)), command(Command(context, context->graphics_queue, context->queue_family_indices.graphics_family.value(), 1))
+    : context(std::move(c)), command(Command(context, context->graphics_queue, context->queue_family_indices.graphics_family.value(), 1)),
+    shader_cache(context),
+    frame_allocator(context, context->frames_in_flight)
 {}
 
 std::expected<BufferId, ResourceError> ResourceManager::add_buffer(Buffer buffer, const std::string& name)
@@ -47,9 +76,13 @@ std::expected<TextureId, ResourceError> ResourceManager::add_texture(Texture tex
 
 std::expected<void, ResourceError> ResourceManager::remove_buffer(const BufferId id)
 {
-    if (buffer_map.contains(id))
+    if (const auto it = buffer_map.find(id); it != buffer_map.end())
     {
-        buffer_map.erase(id);
+        // Frames in flight may still read it.
+        context->timeline->retire([buffer = std::move(it->second)]() {});
+        buffer_map.erase(it);
+        // Frees the name, so a replacement can be added under it.
+        std::erase_if(named_buffers, [id](const auto& entry) { return entry.second == id; });
         return {};
     }
 
@@ -58,9 +91,13 @@ std::expected<void, ResourceError> ResourceManager::remove_buffer(const BufferId
 
 std::expected<void, ResourceError> ResourceManager::remove_texture(const TextureId id)
 {
-    if (texture_map.contains(id))
+    if (const auto it = texture_map.find(id); it != texture_map.end())
     {
-        texture_map.erase(id);
+        // Frames in flight may still read it.
+        context->timeline->retire([texture = std::move(it->second)]() {});
+        texture_map.erase(it);
+        // Frees the name, so a replacement can be added under it.
+        std::erase_if(named_textures, [id](const auto& entry) { return entry.second == id; });
         return {};
     }
 
@@ -135,6 +172,96 @@ std::optional<TextureId> ResourceManager::get_texture_id(const std::string& name
     return std::nullopt;
 }
 
+std::expected<ShaderId, ResourceError> ResourceManager::load_shader(const std::string& path)
+{
+    if (named_shaders.contains(path))
+    {
+        return named_shaders[path];
+    }
+
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+    {
+        spdlog::error("Failed to open shader file: {}", path);
+        return std::unexpected(ResourceError::NotFound);
+    }
+
+    const auto file_size = static_cast<usize>(file.tellg());
+    if (file_size == 0 || file_size % sizeof(u32) != 0)
+    {
+        spdlog::error("Shader file is not valid SPIR-V: {}", path);
+        return std::unexpected(ResourceError::InvalidData);
+    }
+
+    std::vector<u32> spirv(file_size / sizeof(u32));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(spirv.data()), static_cast<std::streamsize>(file_size)))
+    {
+        spdlog::error("Failed to read shader file: {}", path);
+        return std::unexpected(ResourceError::NotFound);
+    }
+
+    // The reflection library reports malformed modules by throwing.
+    const auto hash = ShaderCache::hash_spirv(spirv);
+    std::shared_ptr<const ShaderReflection> reflection{ nullptr };
+    try
+    {
+        reflection = shader_cache.reflect(spirv, hash);
+    }
+    catch (const std::exception& e)
+    {
+        spdlog::error("Failed to reflect shader: {} ({})", path, e.what());
+        return std::unexpected(ResourceError::InvalidData);
+    }
+
+    auto shader = Shader(context, spirv, hash, std::move(reflection));
+    shader.set_debug_name(path);
+
+    const auto id = ShaderId{ next_shader_id++ };
+    named_shaders.insert({ path, id });
+    shader_map.insert({ id, std::move(shader) });
+
+    return id;
+}
+
+std::optional<std::reference_wrapper<Shader>> ResourceManager::get_shader(const ShaderId id)
+{
+    if (shader_map.contains(id))
+    {
+        return std::reference_wrapper(shader_map.at(id));
+    }
+
+    return std::nullopt;
+}
+
+std::optional<MeshEntry> ResourceManager::get_mesh(const MeshId id) const
+{
+    if (const auto it = mesh_registry.find(id); it != mesh_registry.end())
+    {
+        return it->second;
+    }
+
+    return std::nullopt;
+}
+
+const PipelineLayout& ResourceManager::get_pipeline_layout(const std::vector<ShaderId>& shaders)
+{
+    std::vector<const ShaderReflection*> reflections{};
+    reflections.reserve(shaders.size());
+    for (const auto id : shaders)
+    {
+        assert(shader_map.contains(id));
+        reflections.push_back(shader_map.at(id).reflection.get());
+    }
+
+    return shader_cache.get_pipeline_layout(reflections);
+}
+
+FrameAllocator& ResourceManager::get_frame_allocator()
+{
+    return frame_allocator;
+}
+
 void ResourceManager::upload_models(const std::vector<std::tuple<Model, gfx::MeshData, gfx::MaterialData>>& model_data)
 {
     for (usize i{ 0 }; i < model_data.size(); ++i)
@@ -170,12 +297,11 @@ void ResourceManager::upload_models(const std::vector<std::tuple<Model, gfx::Mes
         buffer_map.insert({ vertex_buffer_id , std::move(vertex_buffer) });
         buffer_map.insert({ index_buffer_id , std::move(index_buffer) });
 
-        MeshEntry mesh_entry{ vertex_buffer_id, index_buffer_id };
+        MeshEntry mesh_entry{ vertex_buffer_id, index_buffer_id, static_cast<u32>(indices.size()), mesh_bounds(vertices) };
 
         mesh_registry.insert({ mesh_id, mesh_entry });
         material_registry.insert({ material_id, material_entry });
     }
-    vkDeviceWaitIdle(context->device);
 }
 
 TextureId ResourceManager::upload_texture(const VkFormat format, const TextureData& data)
@@ -3,6 +3,8 @@
 #include "../vk_command.h"
 #include "vk_buffer.h"
 #include "vk_texture.h"
+#include "vk_shader.h"
+#include "vk_frame_allocator.h"
 
 #include <unordered_map>
 #include <string>
@@ -14,12 +16,16 @@ enum class ResourceError
 {
     AlreadyExists,
     NotFound,
+    InvalidData,
 };
 
 struct MeshEntry
 {
     BufferId vertex_buffer{ id::invalid_id };
     BufferId index_buffer{ id::invalid_id };
+    u32 index_count{ 0 };
+    // Bounding sphere in model space, center in xyz and radius in w.
+    glm::vec4 bounds{ 0.0f };
 };
 
 struct MaterialEntry
@@ -52,6 +58,20 @@ public:
     [[nodiscard]] std::optional<std::reference_wrapper<Texture>> get_texture_by_name(const std::string& name);
     [[nodiscard]] std::optional<TextureId> get_texture_id(const std::string& name);
 
+    // Load a SPIR-V file, loading the same path twice returns the already loaded shader. NotFound if the file can not
+    // be read, InvalidData if it is not SPIR-V the engine can reflect.
+    [[nodiscard]] std::expected<ShaderId, ResourceError> load_shader(const std::string& path);
+
+    [[nodiscard]] std::optional<std::reference_wrapper<Shader>> get_shader(ShaderId id);
+
+    [[nodiscard]] std::optional<MeshEntry> get_mesh(MeshId id) const;
+
+    // Reflected and deduplicated layout for a pipeline made up of the given shader stages.
+    [[nodiscard]] const PipelineLayout& get_pipeline_layout(const std::vector<ShaderId>& shaders);
+
+    // Per frame scratch memory for constants, reset by the renderer when the frame slot is reused.
+    [[nodiscard]] FrameAllocator& get_frame_allocator();
+
     void upload_models(const std::vector<std::tuple<Model, gfx::MeshData, gfx::MaterialData>>& model_data);
 
 private:
@@ -64,14 +84,20 @@ private:
 
     id::IdType next_buffer_id{ 0 };
     id::IdType next_text_id{ 0 };
+    id::IdType next_shader_id{ 0 };
 
     std::unordered_map<std::string, BufferId> named_buffers{};
     std::unordered_map<std::string, TextureId> named_textures{};
+    std::unordered_map<std::string, ShaderId> named_shaders{};
 
     std::unordered_map<id::IdType, MeshEntry> mesh_registry{};
     std::unordered_map<id::IdType, MaterialEntry> material_registry{};
 
     std::unordered_map<id::IdType, Buffer> buffer_map{};
     std::unordered_map<id::IdType, Texture> texture_map{};
+    std::unordered_map<id::IdType, Shader> shader_map{};
+
+    ShaderCache shader_cache;
+    FrameAllocator frame_allocator;
 };
 }
\ No newline at end of file
@@ -0,0 +1,467 @@
+#include "vk_shader.h"
+
+#include "spdlog/spdlog.h"
+#include "spirv_cross/spirv_cross.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <ranges>
+#include <stdexcept>
+
+namespace mas::gfx::vulkan
+{
+namespace
+{
+constexpr u64 fnv_offset_basis{ 14695981039346656037ull };
+constexpr u64 fnv_prime{ 1099511628211ull };
+
+u64 hash_bytes(const void* data, const usize size, u64 hash = fnv_offset_basis)
+{
+    const auto bytes = static_cast<const u8*>(data);
+    for (usize i{ 0 }; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= fnv_prime;
+    }
+
+    return hash;
+}
+
+template <typename T>
+u64 hash_value(const T& value, const u64 hash)
+{
+    return hash_bytes(&value, sizeof(T), hash);
+}
+
+VkShaderStageFlagBits to_vk_stage(const spv::ExecutionModel model)
+{
+    switch (model)
+    {
+        case spv::ExecutionModelVertex: return VK_SHADER_STAGE_VERTEX_BIT;
+        case spv::ExecutionModelTessellationControl: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        case spv::ExecutionModelTessellationEvaluation: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        case spv::ExecutionModelGeometry: return VK_SHADER_STAGE_GEOMETRY_BIT;
+        case spv::ExecutionModelFragment: return VK_SHADER_STAGE_FRAGMENT_BIT;
+        case spv::ExecutionModelGLCompute: return VK_SHADER_STAGE_COMPUTE_BIT;
+        default:
+            spdlog::error("Unsupported shader execution model: {}", static_cast<u32>(model));
+            throw std::runtime_error("Unsupported shader execution model");
+    }
+}
+
+u32 descriptor_count(const spirv_cross::SPIRType& type)
+{
+    u32 count{ 1 };
+    for (usize i{ 0 }; i < type.array.size(); ++i)
+    {
+        // A size of zero marks a runtime array, which we treat as a bindless array.
+        if (type.array[i] == 0)
+            return max_bindless_descriptors;
+
+        if (type.array_size_literal[i])
+            count *= type.array[i];
+    }
+
+    return count;
+}
+
+void add_binding(ShaderReflection& reflection, const spirv_cross::Compiler& compiler, const spirv_cross::Resource& resource, const VkDescriptorType type)
+{
+    const u32 set = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+    binding.descriptorType = type;
+    binding.descriptorCount = descriptor_count(compiler.get_type(resource.type_id));
+    binding.stageFlags = reflection.stage;
+    binding.pImmutableSamplers = nullptr;
+
+    auto it = std::ranges::find_if(reflection.sets, [set](const DescriptorSetLayoutInfo& info) { return info.set == set; });
+    if (it == reflection.sets.end())
+    {
+        reflection.sets.push_back({ set, {} });
+        it = reflection.sets.end() - 1;
+    }
+
+    it->bindings.push_back(binding);
+}
+
+bool is_texel_buffer(const spirv_cross::Compiler& compiler, const spirv_cross::Resource& resource)
+{
+    return compiler.get_type(resource.type_id).image.dim == spv::DimBuffer;
+}
+
+ShaderReflection reflect_spirv(const std::vector<u32>& spirv)
+{
+    const spirv_cross::Compiler compiler(spirv);
+    const auto resources = compiler.get_shader_resources(compiler.get_active_interface_variables());
+
+    ShaderReflection reflection{};
+    reflection.stage = to_vk_stage(compiler.get_execution_model());
+    reflection.entry_point = compiler.get_entry_points_and_stages().front().name;
+
+    for (const auto& res : resources.uniform_buffers)
+        add_binding(reflection, compiler, res, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    for (const auto& res : resources.storage_buffers)
+        add_binding(reflection, compiler, res, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    for (const auto& res : resources.storage_images)
+        add_binding(reflection, compiler, res, is_texel_buffer(compiler, res) ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    for (const auto& res : resources.sampled_images)
+        add_binding(reflection, compiler, res, is_texel_buffer(compiler, res) ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    for (const auto& res : resources.separate_images)
+        add_binding(reflection, compiler, res, is_texel_buffer(compiler, res) ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+    for (const auto& res : resources.separate_samplers)
+        add_binding(reflection, compiler, res, VK_DESCRIPTOR_TYPE_SAMPLER);
+    for (const auto& res : resources.subpass_inputs)
+        add_binding(reflection, compiler, res, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
+    for (const auto& res : resources.acceleration_structures)
+        add_binding(reflection, compiler, res, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR);
+
+    // Only the members the shader actually touches end up in the range.
+    for (const auto& res : resources.push_constant_buffers)
+    {
+        const auto ranges = compiler.get_active_buffer_ranges(res.id);
+        if (ranges.empty())
+            continue;
+
+        usize begin{ std::numeric_limits<usize>::max() };
+        usize end{ 0 };
+        for (const auto& range : ranges)
+        {
+            begin = std::min(begin, range.offset);
+            end = std::max(end, range.offset + range.range);
+        }
+
+        VkPushConstantRange push_range{};
+        push_range.stageFlags = reflection.stage;
+        push_range.offset = static_cast<u32>(begin & ~usize{ 3 });
+        push_range.size = static_cast<u32>(((end + 3) & ~usize{ 3 }) - push_range.offset);
+        reflection.push_constant_ranges.push_back(push_range);
+    }
+
+    if (reflection.stage == VK_SHADER_STAGE_COMPUTE_BIT)
+    {
+        for (u32 i{ 0 }; i < 3; ++i)
+            reflection.local_size[i] = compiler.get_execution_mode_argument(spv::ExecutionModeLocalSize, i);
+    }
+
+    for (auto& [set, bindings] : reflection.sets)
+    {
+        std::ranges::sort(bindings, {}, &VkDescriptorSetLayoutBinding::binding);
+    }
+    std::ranges::sort(reflection.sets, {}, &DescriptorSetLayoutInfo::set);
+
+    return reflection;
+}
+
+u64 hash_bindings(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+    u64 hash{ fnv_offset_basis };
+    for (const auto& binding : bindings)
+    {
+        hash = hash_value(binding.binding, hash);
+        hash = hash_value(binding.descriptorType, hash);
+        hash = hash_value(binding.descriptorCount, hash);
+        hash = hash_value(binding.stageFlags, hash);
+    }
+
+    return hash;
+}
+
+bool same_bindings(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b)
+{
+    return std::ranges::equal(a, b, [](const VkDescriptorSetLayoutBinding& x, const VkDescriptorSetLayoutBinding& y)
+    {
+        return x.binding == y.binding && x.descriptorType == y.descriptorType && x.descriptorCount == y.descriptorCount &&
+            x.stageFlags == y.stageFlags;
+    });
+}
+
+bool same_layout(const PipelineLayout& a, const PipelineLayout& b)
+{
+    return a.set_layouts == b.set_layouts &&
+        std::ranges::equal(a.push_constant_ranges, b.push_constant_ranges, [](const VkPushConstantRange& x, const VkPushConstantRange& y)
+        {
+            return x.stageFlags == y.stageFlags && x.offset == y.offset && x.size == y.size;
+        });
+}
+
+VkDescriptorSetLayout create_descriptor_set_layout(const VkDevice device, const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+    std::vector<VkDescriptorBindingFlags> binding_flags(bindings.size(), 0);
+    for (usize i{ 0 }; i < bindings.size(); ++i)
+    {
+        if (bindings[i].descriptorCount == max_bindless_descriptors)
+            binding_flags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_ci{};
+    flags_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flags_ci.bindingCount = static_cast<u32>(binding_flags.size());
+    flags_ci.pBindingFlags = binding_flags.data();
+
+    VkDescriptorSetLayoutCreateInfo layout_ci{};
+    layout_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_ci.bindingCount = static_cast<u32>(bindings.size());
+    layout_ci.pBindings = bindings.data();
+    layout_ci.pNext = &flags_ci;
+
+    VkDescriptorSetLayout layout{ nullptr };
+    if (vkCreateDescriptorSetLayout(device, &layout_ci, nullptr, &layout) != VK_SUCCESS)
+    {
+        spdlog::error("Failed to create descriptor set layout");
+        throw std::runtime_error("Failed to create descriptor set layout");
+    }
+
+    return layout;
+}
+}
+
+Shader::~Shader()
+{
+    if (module)
+        vkDestroyShaderModule(context->device, module, nullptr);
+}
+
+Shader::Shader(Shader&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+Shader& Shader::operator=(Shader&& other) noexcept
+{
+    this->context = std::move(other.context);
+    this->module = other.module;
+    this->hash = other.hash;
+    this->reflection = std::move(other.reflection);
+
+    other.context = nullptr;
+    other.module = nullptr;
+    other.hash = 0;
+    other.reflection = nullptr;
+
+    return *this;
+}
+
+Shader::Shader(std::shared_ptr<Context> c, const std::vector<u32>& spirv, const u64 spirv_hash, std::shared_ptr<const ShaderReflection> shader_reflection)
+{
+    context = std::move(c);
+    hash = spirv_hash;
+    reflection = std::move(shader_reflection);
+
+    VkShaderModuleCreateInfo module_ci{};
+    module_ci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_ci.codeSize = spirv.size() * sizeof(u32);
+    module_ci.pCode = spirv.data();
+
+    if (vkCreateShaderModule(context->device, &module_ci, nullptr, &module) != VK_SUCCESS)
+    {
+        spdlog::error("Failed to create shader module");
+        throw std::runtime_error("Failed to create shader module");
+    }
+}
+
+VkPipelineShaderStageCreateInfo Shader::stage_info() const
+{
+    VkPipelineShaderStageCreateInfo stage_ci{};
+    stage_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stage_ci.stage = reflection->stage;
+    stage_ci.module = module;
+    stage_ci.pName = reflection->entry_point.c_str();
+
+    return stage_ci;
+}
+
+void Shader::set_debug_name(const std::string& name)
+{
+    if constexpr (enable_validation)
+    {
+        auto name_info = VkDebugUtilsObjectNameInfoEXT{};
+        name_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+        name_info.objectHandle = reinterpret_cast<u64>(module);
+        name_info.objectType = VK_OBJECT_TYPE_SHADER_MODULE;
+        name_info.pObjectName = name.c_str();
+
+        vkSetDebugUtilsObjectNameEXT(context->device, &name_info);
+    }
+}
+
+ShaderCache::ShaderCache(std::shared_ptr<Context> c)
+{
+    context = std::move(c);
+}
+
+ShaderCache::~ShaderCache()
+{
+    for (const auto& pipeline_layout : pipeline_layouts | std::views::values)
+        vkDestroyPipelineLayout(context->device, pipeline_layout.layout, nullptr);
+
+    for (const auto& set_layout : set_layouts | std::views::values)
+        vkDestroyDescriptorSetLayout(context->device, set_layout.layout, nullptr);
+}
+
+u64 ShaderCache::hash_spirv(const std::vector<u32>& spirv)
+{
+    return hash_bytes(spirv.data(), spirv.size() * sizeof(u32));
+}
+
+std::shared_ptr<const ShaderReflection> ShaderCache::reflect(const std::vector<u32>& spirv, const u64 spirv_hash)
+{
+    const auto find = [&]() -> std::shared_ptr<const ShaderReflection>
+    {
+        const auto [begin, end] = reflections.equal_range(spirv_hash);
+        for (auto it = begin; it != end; ++it)
+        {
+            if (it->second.spirv == spirv)
+                return it->second.reflection;
+        }
+        return nullptr;
+    };
+
+    {
+        std::lock_guard lock(mutex);
+        if (auto reflection = find())
+            return reflection;
+    }
+
+    // Reflect outside the lock, parsing is by far the most expensive part.
+    auto reflection = std::make_shared<const ShaderReflection>(reflect_spirv(spirv));
+
+    std::lock_guard lock(mutex);
+    if (auto existing = find())
+        return existing;
+
+    reflections.insert({ spirv_hash, { spirv, reflection } });
+    return reflection;
+}
+
+VkDescriptorSetLayout ShaderCache::get_descriptor_set_layout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+    const auto hash = hash_bindings(bindings);
+
+    std::lock_guard lock(mutex);
+    const auto [begin, end] = set_layouts.equal_range(hash);
+    for (auto it = begin; it != end; ++it)
+    {
+        if (same_bindings(it->second.bindings, bindings))
+            return it->second.layout;
+    }
+
+    const auto layout = create_descriptor_set_layout(context->device, bindings);
+    set_layouts.insert({ hash, { bindings, layout } });
+
+    return layout;
+}
+
+const PipelineLayout& ShaderCache::get_pipeline_layout(const std::vector<const ShaderReflection*>& shader_reflections)
+{
+    // Merge bindings of all stages, the same binding used in several stages becomes one binding visible to all of them.
+    std::vector<DescriptorSetLayoutInfo> sets{};
+    std::vector<VkPushConstantRange> push_ranges{};
+    for (const auto reflection : shader_reflections)
+    {
+        for (const auto& [set, bindings] : reflection->sets)
+        {
+            auto set_it = std::ranges::find_if(sets, [set](const DescriptorSetLayoutInfo& info) { return info.set == set; });
+            if (set_it == sets.end())
+            {
+                sets.push_back({ set, {} });
+                set_it = sets.end() - 1;
+            }
+
+            for (const auto& binding : bindings)
+            {
+                auto binding_it = std::ranges::find(set_it->bindings, binding.binding, &VkDescriptorSetLayoutBinding::binding);
+                if (binding_it == set_it->bindings.end())
+                {
+                    set_it->bindings.push_back(binding);
+                    continue;
+                }
+
+                if (binding_it->descriptorType != binding.descriptorType)
+                {
+                    spdlog::error("Shader stages disagree on the type of set: {} binding: {}", set, binding.binding);
+                    throw std::runtime_error("Mismatched descriptor types between shader stages");
+                }
+
+                binding_it->stageFlags |= binding.stageFlags;
+                binding_it->descriptorCount = std::max(binding_it->descriptorCount, binding.descriptorCount);
+            }
+        }
+
+        for (const auto& range : reflection->push_constant_ranges)
+        {
+            const auto range_it = std::ranges::find(push_ranges, range.stageFlags, &VkPushConstantRange::stageFlags);
+            if (range_it == push_ranges.end())
+            {
+                push_ranges.push_back(range);
+                continue;
+            }
+
+            const u32 end = std::max(range_it->offset + range_it->size, range.offset + range.size);
+            range_it->offset = std::min(range_it->offset, range.offset);
+            range_it->size = end - range_it->offset;
+        }
+    }
+
+    // Stages that read the exact same range share one entry.
+    std::vector<VkPushConstantRange> merged_ranges{};
+    for (const auto& range : push_ranges)
+    {
+        const auto it = std::ranges::find_if(merged_ranges, [&range](const VkPushConstantRange& r) { return r.offset == range.offset && r.size == range.size; });
+        if (it != merged_ranges.end())
+            it->stageFlags |= range.stageFlags;
+        else
+            merged_ranges.push_back(range);
+    }
+
+    std::ranges::sort(sets, {}, &DescriptorSetLayoutInfo::set);
+    std::ranges::sort(merged_ranges, {}, &VkPushConstantRange::offset);
+
+    // Unused set indices in between still need a layout, an empty one is shared by all of them.
+    PipelineLayout pipeline_layout{};
+    pipeline_layout.push_constant_ranges = merged_ranges;
+    const u32 set_count = sets.empty() ? 0 : sets.back().set + 1;
+    for (u32 i{ 0 }; i < set_count; ++i)
+    {
+        auto set_it = std::ranges::find(sets, i, &DescriptorSetLayoutInfo::set);
+        if (set_it == sets.end())
+        {
+            pipeline_layout.set_layouts.push_back(get_descriptor_set_layout({}));
+            continue;
+        }
+
+        std::ranges::sort(set_it->bindings, {}, &VkDescriptorSetLayoutBinding::binding);
+        pipeline_layout.set_layouts.push_back(get_descriptor_set_layout(set_it->bindings));
+    }
+
+    u64 hash{ fnv_offset_basis };
+    for (const auto set_layout : pipeline_layout.set_layouts)
+        hash = hash_value(set_layout, hash);
+    for (const auto& range : merged_ranges)
+        hash = hash_value(range, hash);
+
+    std::lock_guard lock(mutex);
+    const auto [begin, end] = pipeline_layouts.equal_range(hash);
+    for (auto it = begin; it != end; ++it)
+    {
+        if (same_layout(it->second, pipeline_layout))
+            return it->second;
+    }
+
+    VkPipelineLayoutCreateInfo layout_ci{};
+    layout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_ci.setLayoutCount = static_cast<u32>(pipeline_layout.set_layouts.size());
+    layout_ci.pSetLayouts = pipeline_layout.set_layouts.data();
+    layout_ci.pushConstantRangeCount = static_cast<u32>(pipeline_layout.push_constant_ranges.size());
+    layout_ci.pPushConstantRanges = pipeline_layout.push_constant_ranges.data();
+
+    if (vkCreatePipelineLayout(context->device, &layout_ci, nullptr, &pipeline_layout.layout) != VK_SUCCESS)
+    {
+        spdlog::error("Failed to create pipeline layout");
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    return pipeline_layouts.insert({ hash, std::move(pipeline_layout) })->second;
+}
+}
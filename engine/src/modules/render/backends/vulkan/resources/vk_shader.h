@@ -0,0 +1,102 @@
+#pragma once
+#include "../vk_context.h"
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace mas::gfx::vulkan
+{
+DEFINE_TYPED_ID(Shader)
+
+// Descriptor count used for runtime sized (bindless) arrays found during reflection.
+constexpr u32 max_bindless_descriptors{ 1024 };
+
+struct DescriptorSetLayoutInfo
+{
+    u32 set{ 0 };
+    std::vector<VkDescriptorSetLayoutBinding> bindings{};
+};
+
+// Everything the engine needs to know about a single SPIR-V module to build layouts for it.
+struct ShaderReflection
+{
+    VkShaderStageFlagBits stage{ VK_SHADER_STAGE_ALL };
+    std::string entry_point{};
+    std::vector<DescriptorSetLayoutInfo> sets{};
+    std::vector<VkPushConstantRange> push_constant_ranges{};
+    std::array<u32, 3> local_size{ 1, 1, 1 };
+};
+
+struct PipelineLayout
+{
+    VkPipelineLayout layout{ nullptr };
+    std::vector<VkDescriptorSetLayout> set_layouts{};
+    std::vector<VkPushConstantRange> push_constant_ranges{};
+};
+
+class Shader
+{
+public:
+    Shader() = delete;
+    ~Shader();
+    DISABLE_COPY(Shader)
+    Shader(Shader&& other) noexcept;
+    Shader& operator=(Shader&& other) noexcept;
+    Shader(std::shared_ptr<Context> c, const std::vector<u32>& spirv, u64 spirv_hash, std::shared_ptr<const ShaderReflection> shader_reflection);
+
+    [[nodiscard]] VkPipelineShaderStageCreateInfo stage_info() const;
+
+    void set_debug_name(const std::string& name);
+
+private:
+    std::shared_ptr<Context> context{ nullptr };
+
+public:
+    VkShaderModule module{ nullptr };
+    u64 hash{ 0 };
+    std::shared_ptr<const ShaderReflection> reflection{ nullptr };
+};
+
+// Caches reflection results keyed by SPIR-V hash and deduplicates descriptor set and pipeline layouts,
+// so pipelines built from shaders with matching interfaces end up with the exact same VkPipelineLayout.
+class ShaderCache
+{
+public:
+    ShaderCache() = delete;
+    ~ShaderCache();
+    DISABLE_COPY_AND_MOVE(ShaderCache)
+    explicit ShaderCache(std::shared_ptr<Context> c);
+
+    [[nodiscard]] static u64 hash_spirv(const std::vector<u32>& spirv);
+
+    [[nodiscard]] std::shared_ptr<const ShaderReflection> reflect(const std::vector<u32>& spirv, u64 spirv_hash);
+
+    [[nodiscard]] VkDescriptorSetLayout get_descriptor_set_layout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+    // Merges the reflection of every stage into one minimal pipeline layout.
+    [[nodiscard]] const PipelineLayout& get_pipeline_layout(const std::vector<const ShaderReflection*>& reflections);
+
+private:
+    std::shared_ptr<Context> context{ nullptr };
+    std::mutex mutex{};
+
+    struct ReflectionEntry
+    {
+        std::vector<u32> spirv{};
+        std::shared_ptr<const ShaderReflection> reflection{ nullptr };
+    };
+
+    struct SetLayoutEntry
+    {
+        std::vector<VkDescriptorSetLayoutBinding> bindings{};
+        VkDescriptorSetLayout layout{ nullptr };
+    };
+
+    // Keyed by hash, entries sharing a hash are told apart by comparing what was hashed.
+    std::unordered_multimap<u64, ReflectionEntry> reflections{};
+    std::unordered_multimap<u64, SetLayoutEntry> set_layouts{};
+    std::unordered_multimap<u64, PipelineLayout> pipeline_layouts{};
+};
+}
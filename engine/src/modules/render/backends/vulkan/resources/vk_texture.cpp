@@ -5,6 +5,7 @@
 #include "spdlog/spdlog.h"
 #include "glm/ext/matrix_common.hpp"
 
+#include <cassert>
 #include <stdexcept>
 
 namespace mas::gfx::vulkan
@@ -13,7 +14,10 @@ Texture::~Texture()
 {
     if (image)
     {
-        vmaDestroyImage(context->allocator, image, allocation);
+        if (owns_memory)
+            vmaDestroyImage(context->allocator, image, allocation);
+        else
+            vkDestroyImage(context->device, image, nullptr);
         image = nullptr;
     }
 
@@ -64,6 +68,8 @@ Texture& Texture::operator=(Texture&& other) noexcept
     this->array_layers = other.array_layers;
     this->extent = other.extent;
     this->cube = other.cube;
+    this->layout = other.layout;
+    this->owns_memory = other.owns_memory;
 
     return *this;
 }
@@ -72,7 +78,7 @@ Texture::Texture(
     std::shared_ptr<Context> c, const VkImageType image_type, const VkFormat format,
     const VkImageAspectFlags aspect, const VkImageUsageFlags usage,
     const VkImageTiling tiling, const VkSampleCountFlagBits samples, const VkImageCreateFlags flags,
-    const u32 width, const u32 height, const u32 depth, const u32 mip_levels, const u32 array_layers)
+    const u32 width, const u32 height, const u32 depth, const u32 mip_levels, const u32 array_layers, const bool allocate_memory)
 {
     context = std::move(c);
     this->format = format;
@@ -81,7 +87,7 @@ Texture::Texture(
     extent = VkExtent3D{ width, height, depth };
     this->mip_levels = mip_levels;
     this->array_layers = array_layers;
-    cube = flags == VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+    cube = (flags & VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != 0;
 
     if (flags & VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT)
     {
@@ -92,6 +98,8 @@ Texture::Texture(
         }
     }
 
+    const auto queue_families = context->shared_queue_families();
+
     VkImageCreateInfo image_ci{};
     image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     image_ci.imageType = image_type;
@@ -99,20 +107,57 @@ Texture::Texture(
     image_ci.tiling = tiling;
     image_ci.initialLayout = layout;
     image_ci.usage = usage;
-    image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_ci.sharingMode = queue_families.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    image_ci.queueFamilyIndexCount = static_cast<u32>(queue_families.size());
+    image_ci.pQueueFamilyIndices = queue_families.data();
     image_ci.samples = samples;
     image_ci.flags = flags;
     image_ci.extent = VkExtent3D{ width, height, depth };
     image_ci.mipLevels = mip_levels;
     image_ci.arrayLayers = array_layers;
 
+    if (!allocate_memory)
+    {
+        owns_memory = false;
+        if (vkCreateImage(context->device, &image_ci, nullptr, &image) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create image");
+
+        return;
+    }
+
     VmaAllocationCreateInfo alloc_info{};
     alloc_info.usage = VMA_MEMORY_USAGE_AUTO;
 
     if (vmaCreateImage(context->allocator, &image_ci, &alloc_info, &image, &allocation, &allocation_info) != VK_SUCCESS)
         throw std::runtime_error("Failed to create image");
 
-    const VkImageViewType view_type = flags & VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D;
+    create_view();
+}
+
+VkMemoryRequirements Texture::get_memory_requirements() const
+{
+    VkMemoryRequirements requirements{};
+    vkGetImageMemoryRequirements(context->device, image, &requirements);
+
+    return requirements;
+}
+
+void Texture::bind_memory(const VmaAllocation shared_allocation, const VkDeviceSize offset)
+{
+    assert(!owns_memory);
+
+    if (vmaBindImageMemory2(context->allocator, shared_allocation, offset, image, nullptr) != VK_SUCCESS)
+        throw std::runtime_error("Failed to bind image memory");
+
+    allocation = shared_allocation;
+    vmaGetAllocationInfo(context->allocator, allocation, &allocation_info);
+
+    create_view();
+}
+
+void Texture::create_view()
+{
+    const VkImageViewType view_type = cube ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D;
 
     VkImageViewCreateInfo view_ci{};
     view_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -221,16 +266,7 @@ void Texture::set_layout_now(const VkImageLayout new_layout, const VkPipelineSta
     dep_info.imageMemoryBarrierCount = 1;
 
     vkCmdPipelineBarrier2(cmd, &dep_info);
-    vkEndCommandBuffer(cmd);
-
-    VkSubmitInfo submit_info{};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.pCommandBuffers = &cmd;
-    submit_info.commandBufferCount = 1;
-
-    vkQueueSubmit(context->graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(context->graphics_queue);
-    vkResetCommandBuffer(cmd, 0);
+    command.flush();
 
     layout = new_layout;
 }
@@ -17,7 +17,13 @@ public:
     Texture& operator=(Texture&& other) noexcept;
     Texture(std::shared_ptr<Context> c, VkImageType image_type, VkFormat format,
             VkImageAspectFlags aspect, VkImageUsageFlags usage,VkImageTiling tiling, VkSampleCountFlagBits samples,
-            VkImageCreateFlags flags, u32 width, u32 height, u32 depth, u32 mip_levels, u32 array_layers);
+            VkImageCreateFlags flags, u32 width, u32 height, u32 depth, u32 mip_levels, u32 array_layers, bool allocate_memory = true);
+
+    // Requirements of an image created without memory.
+    [[nodiscard]] VkMemoryRequirements get_memory_requirements() const;
+
+    // Bind an image created without memory to a range of memory owned by someone else, used for aliasing.
+    void bind_memory(VmaAllocation shared_allocation, VkDeviceSize offset);
 
     void create_sampler(VkFilter mag_filter = VK_FILTER_LINEAR, VkFilter min_filter = VK_FILTER_LINEAR,
                         VkSamplerMipmapMode mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
@@ -35,7 +41,10 @@ public:
     void set_debug_name(const std::string& name);
 
 private:
+    void create_view();
+
     std::shared_ptr<Context> context{ nullptr };
+    bool owns_memory{ true };
 
 public:
     VkImage image{ nullptr };
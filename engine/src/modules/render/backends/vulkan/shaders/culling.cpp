@@ -0,0 +1,606 @@
+#include "culling.h"
+#include "node_common.h"
+#include "modules/spatial/bounds.h"
+
+#include "imgui/imgui.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace mas::gfx::vulkan
+{
+namespace
+{
+constexpr u32 cull_group_size{ 64 };
+constexpr u32 hiz_group_size{ 8 };
+
+constexpr u32 frustum_flag{ 1 };
+constexpr u32 occlusion_flag{ 2 };
+
+// Depth does not depend on the material, so only these bits split the runs of groups drawn together.
+constexpr DrawKey depth_state_mask{ draw_key::pass_mask | draw_key::pipeline_mask | draw_key::mesh_mask };
+
+// Layouts below match the std430 structs of cull.comp, cull_compact.comp, hiz.comp and depth.vert.
+// The transform is read from the instance's slot of the scene buffer.
+struct GpuInstance
+{
+    u32 slot{ 0 };
+    u32 group{ 0 };
+};
+
+struct GpuGroup
+{
+    glm::vec4 bounds{ 0.0f };
+    u32 first_instance{ 0 };
+    u32 index_count{ 0 };
+    // Index of the first group of the run this group is drawn with.
+    u32 run_start{ 0 };
+    u32 pad{ 0 };
+};
+
+struct GpuCullView
+{
+    glm::vec4 planes[6]{};
+    glm::mat4 prev_view_proj{ 1.0f };
+};
+
+struct CullPush
+{
+    VkDeviceAddress instances{ 0 };
+    VkDeviceAddress scene{ 0 };
+    VkDeviceAddress groups{ 0 };
+    VkDeviceAddress counts{ 0 };
+    VkDeviceAddress visible{ 0 };
+    VkDeviceAddress hiz{ 0 };
+    VkDeviceAddress view{ 0 };
+    u32 instance_count{ 0 };
+    u32 flags{ 0 };
+};
+
+struct CompactPush
+{
+    VkDeviceAddress groups{ 0 };
+    VkDeviceAddress instance_counts{ 0 };
+    VkDeviceAddress commands{ 0 };
+    VkDeviceAddress draw_counts{ 0 };
+    u32 group_count{ 0 };
+    u32 pad{ 0 };
+};
+
+struct HiZPush
+{
+    VkDeviceAddress src{ 0 };
+    VkDeviceAddress dst{ 0 };
+    u32 src_size[2]{};
+    u32 dst_size[2]{};
+};
+
+struct DepthPush
+{
+    glm::mat4 view_proj{ 1.0f };
+    VkDeviceAddress scene{ 0 };
+    VkDeviceAddress visible{ 0 };
+};
+
+struct HiZHeader
+{
+    u32 width{ 0 };
+    u32 height{ 0 };
+    u32 levels{ 0 };
+    u32 valid{ 0 };
+};
+
+// Records the group packets of the depth prepass, only rebinding what changed between runs.
+struct DepthReplay
+{
+    VkCommandBuffer cmd{ nullptr };
+    ResourceManager* resource_manager{ nullptr };
+    const CullingState* state{ nullptr };
+    VkPipeline pipeline{ nullptr };
+    VkBuffer commands{ nullptr };
+    VkBuffer counts{ nullptr };
+
+    void bind(const DrawPacket& packet, const DrawKey changed) const
+    {
+        if ((changed & (draw_key::pass_mask | draw_key::pipeline_mask)) != 0)
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+        if ((changed & draw_key::mesh_mask) != 0)
+        {
+            const auto& mesh = state->group_meshes[packet.payload];
+            constexpr VkDeviceSize offset{ 0 };
+            vkCmdBindVertexBuffers(cmd, 0, 1, &resource_manager->get_buffer(mesh.vertex_buffer).value().get().buffer, &offset);
+            vkCmdBindIndexBuffer(cmd, resource_manager->get_buffer(mesh.index_buffer).value().get().buffer, 0, VK_INDEX_TYPE_UINT32);
+        }
+    }
+
+    // The run's commands and draw count start at its first group, at most one command per group of the run.
+    void draw(const u32 first, const u32 count) const
+    {
+        vkCmdDrawIndexedIndirectCount(cmd, commands, sizeof(VkDrawIndexedIndirectCommand) * first, counts, sizeof(u32) * first,
+                                      count, sizeof(VkDrawIndexedIndirectCommand));
+    }
+};
+}
+
+CullNode::CullNode(std::shared_ptr<CullingState> s, tf::Executor& e)
+    : state(std::move(s)),
+    executor(&e)
+{}
+
+CullNode::~CullNode()
+{
+    if (pipeline)
+        vkDestroyPipeline(context->device, pipeline, nullptr);
+    if (compact_pipeline)
+        vkDestroyPipeline(context->device, compact_pipeline, nullptr);
+}
+
+void CullNode::setup_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager)
+{
+    constexpr VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+    auto instance_counts = Buffer(context, sizeof(u32) * max_instance_groups, usage);
+    instance_counts.set_debug_name("InstanceCounts");
+    auto commands = Buffer(context, sizeof(VkDrawIndexedIndirectCommand) * max_instance_groups, usage);
+    commands.set_debug_name("DrawCommands");
+    auto draw_counts = Buffer(context, sizeof(u32) * max_instance_groups, usage);
+    draw_counts.set_debug_name("DrawCounts");
+    auto visible = Buffer(context, sizeof(u32) * max_culled_instances, usage);
+    visible.set_debug_name("VisibleInstances");
+
+    if (!resource_manager.add_buffer(std::move(instance_counts), "InstanceCounts").has_value() ||
+        !resource_manager.add_buffer(std::move(commands), "DrawCommands").has_value() ||
+        !resource_manager.add_buffer(std::move(draw_counts), "DrawCounts").has_value() ||
+        !resource_manager.add_buffer(std::move(visible), "VisibleInstances").has_value())
+    {
+        spdlog::error("Culling buffers already exist");
+        throw std::runtime_error("Culling buffers already exist");
+    }
+}
+
+void CullNode::update_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot)
+{
+    state->instance_count = 0;
+    state->group_count = 0;
+    state->packets.clear();
+    state->group_meshes.clear();
+
+    if (!snapshot.camera.has_value())
+    {
+        has_prev_view = false;
+        return;
+    }
+
+    const auto& camera = snapshot.camera.value();
+
+    // Sorting one packet per object groups the objects by Model and orders every group front to back.
+    instance_packets.clear();
+    instance_packets.reserve(snapshot.objects.size());
+    for (usize i{ 0 }; i < snapshot.objects.size(); ++i)
+    {
+        const auto& [transform, model, slot] = snapshot.objects[i];
+        const auto material = id::index(model.material_id);
+        const auto mesh = id::index(model.mesh_id);
+
+        // Ids past the key fields would share a group with other Models, such objects are not drawn. Neither are
+        // objects without a slot in the scene buffer.
+        if (!fits_draw_key(material, mesh) || slot >= max_scene_slots)
+            continue;
+
+        const f32 distance = -(camera.view * transform[3]).z;
+        const auto key = make_draw_key(DrawPass::Opaque, 0, static_cast<u32>(material), static_cast<u32>(mesh),
+                                       quantize_depth(distance, camera.z_near, camera.z_far));
+        instance_packets.add(key, static_cast<u32>(i));
+    }
+    instance_packets.sort(*executor);
+
+    const auto packets = instance_packets.get_packets();
+    const usize capacity = std::min<usize>(packets.size(), max_culled_instances);
+    if (capacity == 0)
+        return;
+
+    auto& frame_allocator = resource_manager.get_frame_allocator();
+    const usize max_groups = std::min<usize>(capacity, max_instance_groups);
+    const auto instance_allocation = frame_allocator.allocate(sizeof(GpuInstance) * capacity, alignof(glm::vec4));
+    const auto group_allocation = frame_allocator.allocate(sizeof(GpuGroup) * max_groups, alignof(glm::vec4));
+    auto* instances = static_cast<GpuInstance*>(instance_allocation.mapped);
+    auto* groups = static_cast<GpuGroup*>(group_allocation.mapped);
+
+    // Every run of packets with the same state is one group, laid out contiguously in the instance buffer.
+    u32 instance_count{ 0 };
+    u32 group_count{ 0 };
+    u32 run_start{ 0 };
+    bool skip_group{ false };
+    for (usize i{ 0 }; i < packets.size() && instance_count < capacity; ++i)
+    {
+        const auto& packet = packets[i];
+        const auto& object = snapshot.objects[packet.payload];
+
+        if (i == 0 || (packet.key & draw_key::state_mask) != (packets[i - 1].key & draw_key::state_mask))
+        {
+            if (group_count == max_groups)
+                break;
+
+            // Not uploaded yet.
+            const auto mesh = resource_manager.get_mesh(object.model.mesh_id);
+            skip_group = !mesh.has_value();
+            if (skip_group)
+                continue;
+
+            // Runs split exactly where the depth prepass replay splits its draws.
+            if (group_count == 0 || (packet.key & depth_state_mask) != (state->packets.get_packets().back().key & depth_state_mask))
+                run_start = group_count;
+
+            groups[group_count] = { mesh->bounds, instance_count, mesh->index_count, run_start };
+            // Keyed by its nearest instance, the first one after sorting.
+            state->packets.add(packet.key, group_count);
+            state->group_meshes.push_back(mesh.value());
+            ++group_count;
+        }
+
+        if (skip_group)
+            continue;
+
+        instances[instance_count++] = { object.slot, group_count - 1 };
+    }
+
+    if (instance_count == 0)
+        return;
+
+    state->view_proj = camera.proj * camera.view;
+    state->instances = instance_allocation.device_address;
+    state->instance_count = instance_count;
+    state->group_count = group_count;
+    groups_address = group_allocation.device_address;
+
+    GpuCullView view{};
+    const auto frustum = make_frustum(state->view_proj);
+    std::ranges::copy(frustum.planes, view.planes);
+    view.prev_view_proj = has_prev_view ? prev_view_proj : state->view_proj;
+    view_address = frame_allocator.push(view, alignof(glm::vec4)).device_address;
+
+    prev_view_proj = state->view_proj;
+    has_prev_view = true;
+}
+
+void CullNode::declare_resources(NodeResources& resources)
+{
+    // Both counts are cleared, then atomically incremented, so read as well as written.
+    resources.write_buffer("InstanceCounts", ResourceUsage::TransferDst);
+    resources.read_buffer("InstanceCounts", ResourceUsage::Storage);
+    resources.write_buffer("InstanceCounts", ResourceUsage::Storage);
+    resources.write_buffer("DrawCounts", ResourceUsage::TransferDst);
+    resources.read_buffer("DrawCounts", ResourceUsage::Storage);
+    resources.write_buffer("DrawCounts", ResourceUsage::Storage);
+    resources.write_buffer("DrawCommands", ResourceUsage::Storage);
+    resources.write_buffer("VisibleInstances", ResourceUsage::Storage);
+    resources.read_buffer("SceneTransforms", ResourceUsage::Storage);
+    resources.read_buffer("HiZ", ResourceUsage::Storage);
+}
+
+void CullNode::setup(const std::shared_ptr<Context>& context, ResourceManager& resource_manager)
+{
+    this->context = context;
+
+    const auto shader = load_node_shader(resource_manager, "./assets/shaders/cull.comp.spv");
+    layout = resource_manager.get_pipeline_layout({ shader }).layout;
+    pipeline = create_compute_pipeline(context, resource_manager, shader, layout);
+
+    const auto compact_shader = load_node_shader(resource_manager, "./assets/shaders/cull_compact.comp.spv");
+    compact_layout = resource_manager.get_pipeline_layout({ compact_shader }).layout;
+    compact_pipeline = create_compute_pipeline(context, resource_manager, compact_shader, compact_layout);
+}
+
+void CullNode::run(const VkCommandBuffer cmd, const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot)
+{
+    if (state->instance_count == 0)
+        return;
+
+    // Every group and every run starts out empty, culling counts the visible instances in and compaction the groups
+    // that have any.
+    const auto& instance_counts = get_named_buffer(resource_manager, "InstanceCounts");
+    const auto& draw_counts = get_named_buffer(resource_manager, "DrawCounts");
+    vkCmdFillBuffer(cmd, instance_counts.buffer, 0, sizeof(u32) * state->group_count, 0);
+    vkCmdFillBuffer(cmd, draw_counts.buffer, 0, sizeof(u32) * state->group_count, 0);
+
+    compute_barrier(cmd, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+    CullPush push{};
+    push.instances = state->instances;
+    push.scene = buffer_address(context->device, get_named_buffer(resource_manager, "SceneTransforms").buffer);
+    push.groups = groups_address;
+    push.counts = buffer_address(context->device, instance_counts.buffer);
+    push.visible = buffer_address(context->device, get_named_buffer(resource_manager, "VisibleInstances").buffer);
+    push.hiz = buffer_address(context->device, get_named_buffer(resource_manager, "HiZ").buffer);
+    push.view = view_address;
+    push.instance_count = state->instance_count;
+    push.flags = (frustum_culling ? frustum_flag : 0) | (occlusion_culling ? occlusion_flag : 0);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vkCmdDispatch(cmd, (state->instance_count + cull_group_size - 1) / cull_group_size, 1, 1);
+
+    compute_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    CompactPush compact{};
+    compact.groups = groups_address;
+    compact.instance_counts = push.counts;
+    compact.commands = buffer_address(context->device, get_named_buffer(resource_manager, "DrawCommands").buffer);
+    compact.draw_counts = buffer_address(context->device, draw_counts.buffer);
+    compact.group_count = state->group_count;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, compact_pipeline);
+    vkCmdPushConstants(cmd, compact_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(compact), &compact);
+    vkCmdDispatch(cmd, (state->group_count + cull_group_size - 1) / cull_group_size, 1, 1);
+}
+
+void CullNode::draw_ui(flecs::world* world)
+{
+    if (!ImGui::Begin("Culling"))
+    {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Checkbox("Frustum culling", &frustum_culling);
+    ImGui::Checkbox("Occlusion culling", &occlusion_culling);
+    const auto& stats = state->replay_stats;
+    ImGui::Text("%u instances in %u groups", state->instance_count, state->group_count);
+    ImGui::Text("%u draw calls, %u pipeline and %u mesh binds", stats.draws, stats.pipeline_binds, stats.mesh_binds);
+
+    ImGui::End();
+}
+
+DepthPrepassNode::DepthPrepassNode(std::shared_ptr<CullingState> s)
+    : state(std::move(s))
+{}
+
+DepthPrepassNode::~DepthPrepassNode()
+{
+    if (pipeline)
+        vkDestroyPipeline(context->device, pipeline, nullptr);
+}
+
+void DepthPrepassNode::declare_resources(NodeResources& resources)
+{
+    resources.read_buffer("DrawCommands", ResourceUsage::Indirect);
+    resources.read_buffer("DrawCounts", ResourceUsage::Indirect);
+    resources.read_buffer("VisibleInstances", ResourceUsage::Storage);
+    resources.read_buffer("SceneTransforms", ResourceUsage::Storage);
+    resources.write_image("SceneDepth", ResourceUsage::DepthAttachment);
+}
+
+void DepthPrepassNode::setup(const std::shared_ptr<Context>& context, ResourceManager& resource_manager)
+{
+    this->context = context;
+
+    const auto shader = load_node_shader(resource_manager, "./assets/shaders/depth.vert.spv");
+    layout = resource_manager.get_pipeline_layout({ shader }).layout;
+    const auto stage = resource_manager.get_shader(shader).value().get().stage_info();
+
+    // Only the position is read, the rest of the vertex is skipped by the stride.
+    VkVertexInputBindingDescription binding{};
+    binding.binding = 0;
+    binding.stride = sizeof(VertexP3N3U2T4);
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription position{};
+    position.location = 0;
+    position.binding = 0;
+    position.format = VK_FORMAT_R32G32B32_SFLOAT;
+    position.offset = offsetof(VertexP3N3U2T4, pos);
+
+    VkPipelineVertexInputStateCreateInfo vertex_input{};
+    vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input.vertexBindingDescriptionCount = 1;
+    vertex_input.pVertexBindingDescriptions = &binding;
+    vertex_input.vertexAttributeDescriptionCount = 1;
+    vertex_input.pVertexAttributeDescriptions = &position;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewport{};
+    viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport.viewportCount = 1;
+    viewport.scissorCount = 1;
+
+    // No culling of faces, the winding depends on the camera's projection which the engine does not fix.
+    VkPipelineRasterizationStateCreateInfo rasterization{};
+    rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterization.cullMode = VK_CULL_MODE_NONE;
+    rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterization.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisample{};
+    multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = VK_TRUE;
+    depth_stencil.depthWriteEnable = VK_TRUE;
+    depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    VkPipelineColorBlendStateCreateInfo color_blend{};
+    color_blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+
+    constexpr VkDynamicState dynamic_states[]{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamic{};
+    dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic.dynamicStateCount = 2;
+    dynamic.pDynamicStates = dynamic_states;
+
+    VkPipelineRenderingCreateInfo rendering{};
+    rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    rendering.depthAttachmentFormat = scene_depth_format;
+
+    VkGraphicsPipelineCreateInfo pipeline_ci{};
+    pipeline_ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_ci.pNext = &rendering;
+    pipeline_ci.stageCount = 1;
+    pipeline_ci.pStages = &stage;
+    pipeline_ci.pVertexInputState = &vertex_input;
+    pipeline_ci.pInputAssemblyState = &input_assembly;
+    pipeline_ci.pViewportState = &viewport;
+    pipeline_ci.pRasterizationState = &rasterization;
+    pipeline_ci.pMultisampleState = &multisample;
+    pipeline_ci.pDepthStencilState = &depth_stencil;
+    pipeline_ci.pColorBlendState = &color_blend;
+    pipeline_ci.pDynamicState = &dynamic;
+    pipeline_ci.layout = layout;
+
+    if (vkCreateGraphicsPipelines(context->device, nullptr, 1, &pipeline_ci, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        spdlog::error("Failed to create depth prepass pipeline");
+        throw std::runtime_error("Failed to create depth prepass pipeline");
+    }
+}
+
+void DepthPrepassNode::run(const VkCommandBuffer cmd, const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot)
+{
+    const auto& depth = resource_manager.get_texture_by_name("SceneDepth").value().get();
+    const VkExtent2D extent{ depth.extent.width, depth.extent.height };
+
+    VkRenderingAttachmentInfo depth_attachment{};
+    depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depth_attachment.imageView = depth.image_view;
+    depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depth_attachment.clearValue.depthStencil = { 1.0f, 0 };
+
+    VkRenderingInfo rendering_info{};
+    rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    rendering_info.renderArea = { { 0, 0 }, extent };
+    rendering_info.layerCount = 1;
+    rendering_info.pDepthAttachment = &depth_attachment;
+
+    vkCmdBeginRendering(cmd, &rendering_info);
+
+    if (state->instance_count > 0)
+    {
+        const VkViewport viewport{ 0.0f, 0.0f, static_cast<f32>(extent.width), static_cast<f32>(extent.height), 0.0f, 1.0f };
+        const VkRect2D scissor{ { 0, 0 }, extent };
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+        const auto scene = buffer_address(context->device, get_named_buffer(resource_manager, "SceneTransforms").buffer);
+        const auto visible = buffer_address(context->device, get_named_buffer(resource_manager, "VisibleInstances").buffer);
+        const DepthPush push{ state->view_proj, scene, visible };
+        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
+
+        // Groups of one mesh are only adjacent within a material, the runs follow the material first packet order.
+        DepthReplay replay{ cmd, &resource_manager, state.get(), pipeline, get_named_buffer(resource_manager, "DrawCommands").buffer,
+                            get_named_buffer(resource_manager, "DrawCounts").buffer };
+        state->replay_stats = state->packets.replay(replay, depth_state_mask);
+    }
+
+    vkCmdEndRendering(cmd);
+}
+
+HiZNode::~HiZNode()
+{
+    if (pipeline)
+        vkDestroyPipeline(context->device, pipeline, nullptr);
+}
+
+void HiZNode::ready_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager)
+{
+    // Same size as the scene depth transient, which follows the swapchain.
+    const VkExtent2D extent{ std::max(context->surface_extent.width, 1u), std::max(context->surface_extent.height, 1u) };
+    if (!levels.empty() && levels.front().width == extent.width && levels.front().height == extent.height)
+        return;
+
+    levels.clear();
+    VkDeviceSize texels{ 0 };
+    for (VkExtent2D level = extent;; level = { std::max(level.width / 2, 1u), std::max(level.height / 2, 1u) })
+    {
+        levels.push_back(level);
+        texels += static_cast<VkDeviceSize>(level.width) * level.height;
+        if (level.width == 1 && level.height == 1)
+            break;
+    }
+
+    if (const auto old = resource_manager.get_buffer_id("HiZ"); old.has_value())
+    {
+        if (!resource_manager.remove_buffer(old.value()).has_value())
+            spdlog::warn("HiZ buffer was already removed from the resource manager");
+    }
+
+    // Starts zeroed, so the header reads as invalid until the first pyramid has been built.
+    const std::vector<u8> zeroes(sizeof(HiZHeader) + texels * sizeof(f32), 0);
+    auto buffer = Buffer(context, zeroes.size(),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                         zeroes.data());
+    buffer.set_debug_name("HiZ");
+
+    if (!resource_manager.add_buffer(std::move(buffer), "HiZ").has_value())
+    {
+        spdlog::error("HiZ buffer already exists");
+        throw std::runtime_error("HiZ buffer already exists");
+    }
+}
+
+void HiZNode::declare_resources(NodeResources& resources)
+{
+    resources.read_image("SceneDepth", ResourceUsage::TransferSrc);
+    resources.write_buffer("HiZ", ResourceUsage::TransferDst);
+    resources.write_buffer("HiZ", ResourceUsage::Storage);
+}
+
+void HiZNode::setup(const std::shared_ptr<Context>& context, ResourceManager& resource_manager)
+{
+    this->context = context;
+
+    const auto shader = load_node_shader(resource_manager, "./assets/shaders/hiz.comp.spv");
+    layout = resource_manager.get_pipeline_layout({ shader }).layout;
+    pipeline = create_compute_pipeline(context, resource_manager, shader, layout);
+}
+
+void HiZNode::run(const VkCommandBuffer cmd, const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot)
+{
+    const auto& depth = resource_manager.get_texture_by_name("SceneDepth").value().get();
+    const auto& hiz = get_named_buffer(resource_manager, "HiZ");
+
+    // Both follow the swapchain, but only match once the graph resources have been rebuilt for it.
+    if (depth.extent.width != levels.front().width || depth.extent.height != levels.front().height)
+        return;
+
+    const HiZHeader header{ levels.front().width, levels.front().height, static_cast<u32>(levels.size()), 1 };
+    vkCmdUpdateBuffer(cmd, hiz.buffer, 0, sizeof(header), &header);
+
+    VkBufferImageCopy copy{};
+    copy.bufferOffset = sizeof(HiZHeader);
+    copy.imageSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+    copy.imageExtent = depth.extent;
+    vkCmdCopyImageToBuffer(cmd, depth.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, hiz.buffer, 1, &copy);
+
+    compute_barrier(cmd, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    const auto base = buffer_address(context->device, hiz.buffer) + sizeof(HiZHeader);
+    VkDeviceSize src_offset{ 0 };
+    for (usize i{ 1 }; i < levels.size(); ++i)
+    {
+        const auto& src = levels[i - 1];
+        const auto& dst = levels[i];
+        const VkDeviceSize dst_offset = src_offset + static_cast<VkDeviceSize>(src.width) * src.height * sizeof(f32);
+
+        const HiZPush push{ base + src_offset, base + dst_offset, { src.width, src.height }, { dst.width, dst.height } };
+        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+        vkCmdDispatch(cmd, (dst.width + hiz_group_size - 1) / hiz_group_size, (dst.height + hiz_group_size - 1) / hiz_group_size, 1);
+
+        if (i + 1 < levels.size())
+            compute_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+        src_offset = dst_offset;
+    }
+}
+}
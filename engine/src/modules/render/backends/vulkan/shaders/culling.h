@@ -0,0 +1,109 @@
+#pragma once
+#include "../vk_context.h"
+#include "../render_graph.h"
+#include "../draw_packets.h"
+#include "scene.h"
+#include "../resources/vk_resource_manager.h"
+
+namespace mas::gfx::vulkan
+{
+// Upper bounds of the persistent indirect buffers, instances past them are not drawn.
+constexpr u32 max_culled_instances{ 65536 };
+constexpr u32 max_instance_groups{ 4096 };
+
+// Format of the SceneDepth transient the depth prepass renders into.
+constexpr VkFormat scene_depth_format{ VK_FORMAT_D32_SFLOAT };
+
+// Written by the cull node in update_resources, read by the draws recorded after it in the same frame.
+// Instances sharing a Model form one group, drawn by one instanced indirect command once culling has counted its
+// visible instances. Group i owns packet i, the packets are in key order. Each run of groups sharing a mesh owns the
+// commands and the draw count at the index of its first group, groups without survivors are compacted out of it.
+struct CullingState
+{
+    VkDeviceAddress instances{ 0 };
+    u32 instance_count{ 0 };
+    u32 group_count{ 0 };
+    DrawPacketList packets{};
+    std::vector<MeshEntry> group_meshes{};
+    glm::mat4 view_proj{ 1.0f };
+    DrawReplayStats replay_stats{};
+};
+
+// Groups the extracted objects by Model, then frustum and Hi-Z occlusion culls every instance in a compute pass. A
+// second pass writes a command for every group with survivors and counts them into their run's draw count.
+// Instances only carry their scene slot, transforms are read from the SceneTransforms buffer.
+// Occlusion is tested against the depth pyramid of the previous frame, reprojected with the previous frame's camera.
+class CullNode final : public RenderNode
+{
+public:
+    // Instance packets are sorted on the executor's workers.
+    CullNode(std::shared_ptr<CullingState> s, tf::Executor& e);
+    ~CullNode() override;
+
+    void setup_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager) override;
+    void update_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot) override;
+    void declare_resources(NodeResources& resources) override;
+    void setup(const std::shared_ptr<Context>& context, ResourceManager& resource_manager) override;
+    void run(VkCommandBuffer cmd, const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot) override;
+    void draw_ui(flecs::world* world) override;
+
+private:
+    std::shared_ptr<CullingState> state{ nullptr };
+    tf::Executor* executor{ nullptr };
+    std::shared_ptr<Context> context{ nullptr };
+    VkPipeline pipeline{ nullptr };
+    VkPipelineLayout layout{ nullptr };
+    VkPipeline compact_pipeline{ nullptr };
+    VkPipelineLayout compact_layout{ nullptr };
+
+    VkDeviceAddress groups_address{ 0 };
+    VkDeviceAddress view_address{ 0 };
+    glm::mat4 prev_view_proj{ 1.0f };
+    bool has_prev_view{ false };
+    bool frustum_culling{ true };
+    bool occlusion_culling{ true };
+
+    // One packet per object, reused every frame.
+    DrawPacketList instance_packets{};
+};
+
+// Depth of the surviving instances, the groups are replayed from their packets as one indirect count draw per run of
+// groups sharing a mesh. Groups are sorted by material before mesh, so a mesh used with several materials takes
+// several draws.
+class DepthPrepassNode final : public RenderNode
+{
+public:
+    explicit DepthPrepassNode(std::shared_ptr<CullingState> s);
+    ~DepthPrepassNode() override;
+
+    void declare_resources(NodeResources& resources) override;
+    void setup(const std::shared_ptr<Context>& context, ResourceManager& resource_manager) override;
+    void run(VkCommandBuffer cmd, const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot) override;
+
+private:
+    std::shared_ptr<CullingState> state{ nullptr };
+    std::shared_ptr<Context> context{ nullptr };
+    VkPipeline pipeline{ nullptr };
+    VkPipelineLayout layout{ nullptr };
+};
+
+// Reduces the scene depth into a max depth pyramid stored in the HiZ buffer, read by the next frame's culling.
+class HiZNode final : public RenderNode
+{
+public:
+    ~HiZNode() override;
+
+    void ready_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager) override;
+    void declare_resources(NodeResources& resources) override;
+    void setup(const std::shared_ptr<Context>& context, ResourceManager& resource_manager) override;
+    void run(VkCommandBuffer cmd, const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot) override;
+
+private:
+    std::shared_ptr<Context> context{ nullptr };
+    VkPipeline pipeline{ nullptr };
+    VkPipelineLayout layout{ nullptr };
+
+    // Size of every level, level 0 matches the scene depth.
+    std::vector<VkExtent2D> levels{};
+};
+}
@@ -0,0 +1,76 @@
+#include "node_common.h"
+
+#include "spdlog/spdlog.h"
+
+#include <stdexcept>
+
+namespace mas::gfx::vulkan
+{
+VkDeviceAddress buffer_address(const VkDevice device, const VkBuffer buffer)
+{
+    VkBufferDeviceAddressInfo address_info{};
+    address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    address_info.buffer = buffer;
+
+    return vkGetBufferDeviceAddress(device, &address_info);
+}
+
+Buffer& get_named_buffer(ResourceManager& resource_manager, const std::string& name)
+{
+    const auto buffer = resource_manager.get_buffer_by_name(name);
+    if (!buffer.has_value())
+    {
+        spdlog::error("Node buffer: {} does not exist", name);
+        throw std::runtime_error("Node buffer does not exist");
+    }
+
+    return buffer.value().get();
+}
+
+ShaderId load_node_shader(ResourceManager& resource_manager, const std::string& path)
+{
+    const auto shader = resource_manager.load_shader(path);
+    if (!shader.has_value())
+    {
+        spdlog::error("Failed to load node shader: {}", path);
+        throw std::runtime_error("Failed to load node shader");
+    }
+
+    return shader.value();
+}
+
+VkPipeline create_compute_pipeline(const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const ShaderId shader,
+                                   const VkPipelineLayout layout)
+{
+    VkComputePipelineCreateInfo pipeline_ci{};
+    pipeline_ci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_ci.stage = resource_manager.get_shader(shader).value().get().stage_info();
+    pipeline_ci.layout = layout;
+
+    VkPipeline pipeline{ nullptr };
+    if (vkCreateComputePipelines(context->device, nullptr, 1, &pipeline_ci, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        spdlog::error("Failed to create compute pipeline");
+        throw std::runtime_error("Failed to create compute pipeline");
+    }
+
+    return pipeline;
+}
+
+void compute_barrier(const VkCommandBuffer cmd, const VkPipelineStageFlags2 src_stage, const VkAccessFlags2 src_access)
+{
+    VkMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = src_stage;
+    barrier.srcAccessMask = src_access;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+    VkDependencyInfo dep_info{};
+    dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dep_info.memoryBarrierCount = 1;
+    dep_info.pMemoryBarriers = &barrier;
+
+    vkCmdPipelineBarrier2(cmd, &dep_info);
+}
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "../vk_context.h"
+#include "../resources/vk_resource_manager.h"
+
+#include <string>
+
+// Helpers shared by the render graph nodes.
+namespace mas::gfx::vulkan
+{
+[[nodiscard]] VkDeviceAddress buffer_address(VkDevice device, VkBuffer buffer);
+
+// Throws if the node's buffer has not been added to the resource manager.
+[[nodiscard]] Buffer& get_named_buffer(ResourceManager& resource_manager, const std::string& name);
+
+[[nodiscard]] ShaderId load_node_shader(ResourceManager& resource_manager, const std::string& path);
+
+[[nodiscard]] VkPipeline create_compute_pipeline(const std::shared_ptr<Context>& context, ResourceManager& resource_manager, ShaderId shader,
+                                                 VkPipelineLayout layout);
+
+// Makes earlier writes visible to storage reads and writes of the compute dispatches that follow.
+void compute_barrier(VkCommandBuffer cmd, VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access);
+}
@@ -0,0 +1,168 @@
+#include "scene.h"
+#include "node_common.h"
+
+#include "imgui/imgui.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace mas::gfx::vulkan
+{
+namespace
+{
+constexpr u32 scatter_group_size{ 64 };
+
+// Layouts below match the std430 structs of scene_scatter.comp.
+struct GpuSceneUpdate
+{
+    u32 slot{ 0 };
+    u32 pad[3]{};
+    SceneTransform transform{};
+};
+
+struct ScatterPush
+{
+    VkDeviceAddress updates{ 0 };
+    VkDeviceAddress scene{ 0 };
+    u32 update_count{ 0 };
+};
+}
+
+void SceneState::apply(const std::span<const SceneUpdate> updates)
+{
+    for (const auto& [slot, transform] : updates)
+    {
+        if (slot >= max_scene_slots)
+        {
+            if (!capped)
+                spdlog::warn("Scene slots past {} are not drawn", max_scene_slots);
+            capped = true;
+            continue;
+        }
+
+        if (slot >= capacity)
+            capacity = std::bit_ceil(slot + 1);
+
+        if (slot >= transforms.size())
+        {
+            transforms.resize(slot + 1);
+            dirty.resize(slot + 1, false);
+        }
+
+        transforms[slot] = transform;
+        if (!dirty[slot])
+        {
+            dirty[slot] = true;
+            dirty_slots.push_back(slot);
+        }
+    }
+}
+
+void create_scene_buffer(const std::shared_ptr<Context>& context, ResourceManager& resource_manager, SceneState& state)
+{
+    std::vector<SceneTransform> initial(state.capacity);
+    std::copy(state.transforms.begin(), state.transforms.end(), initial.begin());
+
+    if (const auto old = resource_manager.get_buffer_id("SceneTransforms"); old.has_value())
+    {
+        if (!resource_manager.remove_buffer(old.value()).has_value())
+            spdlog::warn("Scene buffer was already removed from the resource manager");
+    }
+
+    auto transforms = Buffer(context, sizeof(SceneTransform) * initial.size(),
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, initial.data());
+    transforms.set_debug_name("SceneTransforms");
+
+    if (!resource_manager.add_buffer(std::move(transforms), "SceneTransforms").has_value())
+    {
+        spdlog::error("Scene buffer already exists");
+        throw std::runtime_error("Scene buffer already exists");
+    }
+
+    state.buffer_slots = state.capacity;
+    for (const u32 slot : state.dirty_slots)
+        state.dirty[slot] = false;
+    state.dirty_slots.clear();
+}
+
+SceneNode::SceneNode(std::shared_ptr<SceneState> s)
+    : state(std::move(s))
+{}
+
+SceneNode::~SceneNode()
+{
+    if (pipeline)
+        vkDestroyPipeline(context->device, pipeline, nullptr);
+}
+
+void SceneNode::setup_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager)
+{
+    create_scene_buffer(context, resource_manager, *state);
+}
+
+void SceneNode::update_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot)
+{
+    update_count = static_cast<u32>(std::min<usize>(state->dirty_slots.size(), max_scene_updates));
+    if (update_count == 0)
+        return;
+
+    const auto allocation = resource_manager.get_frame_allocator().allocate(sizeof(GpuSceneUpdate) * update_count, alignof(glm::vec4));
+    auto* updates = static_cast<GpuSceneUpdate*>(allocation.mapped);
+
+    // Slots pending the longest go first, whatever does not fit waits for the next frame.
+    for (u32 i{ 0 }; i < update_count; ++i)
+    {
+        const u32 slot = state->dirty_slots[i];
+        updates[i] = { slot, {}, state->transforms[slot] };
+        state->dirty[slot] = false;
+    }
+    state->dirty_slots.erase(state->dirty_slots.begin(), state->dirty_slots.begin() + update_count);
+
+    updates_address = allocation.device_address;
+}
+
+void SceneNode::declare_resources(NodeResources& resources)
+{
+    resources.write_buffer("SceneTransforms", ResourceUsage::Storage);
+}
+
+void SceneNode::setup(const std::shared_ptr<Context>& context, ResourceManager& resource_manager)
+{
+    this->context = context;
+
+    const auto shader = load_node_shader(resource_manager, "./assets/shaders/scene_scatter.comp.spv");
+    layout = resource_manager.get_pipeline_layout({ shader }).layout;
+    pipeline = create_compute_pipeline(context, resource_manager, shader, layout);
+}
+
+void SceneNode::run(const VkCommandBuffer cmd, const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot)
+{
+    if (update_count == 0)
+        return;
+
+    ScatterPush push{};
+    push.updates = updates_address;
+    push.scene = buffer_address(context->device, get_named_buffer(resource_manager, "SceneTransforms").buffer);
+    push.update_count = update_count;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vkCmdDispatch(cmd, (update_count + scatter_group_size - 1) / scatter_group_size, 1, 1);
+}
+
+void SceneNode::draw_ui(flecs::world* world)
+{
+    if (!ImGui::Begin("Scene"))
+    {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("%u slots of %u, %u uploaded last frame", static_cast<u32>(state->transforms.size()), state->buffer_slots, update_count);
+    ImGui::Text("%u pending", static_cast<u32>(state->dirty_slots.size()));
+
+    ImGui::End();
+}
+}
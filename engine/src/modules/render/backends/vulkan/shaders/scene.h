@@ -0,0 +1,64 @@
+#pragma once
+#include "../vk_context.h"
+#include "../render_graph.h"
+#include "../resources/vk_resource_manager.h"
+
+#include <deque>
+#include <span>
+
+namespace mas::gfx::vulkan
+{
+// Slots the scene buffer starts with, it doubles whenever a slot past it is assigned.
+constexpr u32 initial_scene_slots{ 65536 };
+// Slots past this are not drawn, it bounds the scene buffer to 96 MB.
+constexpr u32 max_scene_slots{ 1 << 21 };
+// Updates past this stay pending and go out with the following frames, which bounds the upload of a frame.
+constexpr u32 max_scene_updates{ 32768 };
+
+// Cpu side of the SceneTransforms buffer. The updates of every snapshot are applied here, on the main thread while
+// the render thread is idle, so none are lost when a frame is skipped. The scene node uploads whatever is pending.
+struct SceneState
+{
+    void apply(std::span<const SceneUpdate> updates);
+
+    std::vector<SceneTransform> transforms{};
+    // Oldest first.
+    std::deque<u32> dirty_slots{};
+    std::vector<bool> dirty{};
+    // Slots the scene buffer has to hold and slots the current one holds, create_scene_buffer replaces it when they
+    // differ.
+    u32 capacity{ initial_scene_slots };
+    u32 buffer_slots{ 0 };
+    bool capped{ false };
+};
+
+// Replace the SceneTransforms buffer with one holding capacity slots, filled with every transform applied so far and
+// zero past them, so nothing is pending afterwards. Frames in flight keep the old buffer until they retire, but the
+// barriers refer to it and have to be compiled again.
+void create_scene_buffer(const std::shared_ptr<Context>& context, ResourceManager& resource_manager, SceneState& state);
+
+// Keeps one transform per scene slot resident on the gpu. Only the transforms that changed are uploaded, as a list
+// of slot and transform pairs that a compute pass scatters into the scene buffer.
+class SceneNode final : public RenderNode
+{
+public:
+    explicit SceneNode(std::shared_ptr<SceneState> s);
+    ~SceneNode() override;
+
+    void setup_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager) override;
+    void update_resources(const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot) override;
+    void declare_resources(NodeResources& resources) override;
+    void setup(const std::shared_ptr<Context>& context, ResourceManager& resource_manager) override;
+    void run(VkCommandBuffer cmd, const std::shared_ptr<Context>& context, ResourceManager& resource_manager, const RenderSnapshot& snapshot) override;
+    void draw_ui(flecs::world* world) override;
+
+private:
+    std::shared_ptr<SceneState> state{ nullptr };
+    std::shared_ptr<Context> context{ nullptr };
+    VkPipeline pipeline{ nullptr };
+    VkPipelineLayout layout{ nullptr };
+
+    VkDeviceAddress updates_address{ 0 };
+    u32 update_count{ 0 };
+};
+}
@@ -81,13 +81,79 @@ void Command::flush(const u32 index) const
 {
     vkEndCommandBuffer(command_buffers[index]);
 
-    VkSubmitInfo submit_info{};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.pCommandBuffers = &command_buffers[index];
-    submit_info.commandBufferCount = 1;
+    VkCommandBufferSubmitInfo command_info{};
+    command_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    command_info.commandBuffer = command_buffers[index];
 
-    vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(queue);
+    // Only wait for this submission, frames in flight on the same queue keep running.
+    const auto queue_type = queue == context->compute_queue ? QueueType::Compute : QueueType::Graphics;
+    context->timeline->wait(context->timeline->submit(queue_type, { &command_info, 1 }));
     vkResetCommandBuffer(command_buffers[index], 0);
 }
+
+ThreadCommandPools::~ThreadCommandPools()
+{
+    for (const auto& pool : pools)
+        vkDestroyCommandPool(context->device, pool.command_pool, nullptr);
+}
+
+ThreadCommandPools::ThreadCommandPools(std::shared_ptr<Context> c, const u32 queue_family_index, const u32 thread_count, const u32 frame_count)
+{
+    context = std::move(c);
+    frames = frame_count;
+    pools.resize(static_cast<usize>(thread_count) * frame_count);
+
+    VkCommandPoolCreateInfo command_pool_ci{};
+    command_pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    command_pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    command_pool_ci.queueFamilyIndex = queue_family_index;
+
+    for (auto& pool : pools)
+    {
+        if (vkCreateCommandPool(context->device, &command_pool_ci, nullptr, &pool.command_pool) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create command pool!");
+    }
+}
+
+void ThreadCommandPools::reset(const u32 frame)
+{
+    assert(frame < frames);
+
+    for (usize i{ frame }; i < pools.size(); i += frames)
+    {
+        vkResetCommandPool(context->device, pools[i].command_pool, 0);
+        pools[i].next = 0;
+    }
+}
+
+VkCommandBuffer ThreadCommandPools::begin(const u32 thread, const u32 frame)
+{
+    assert(static_cast<usize>(thread) * frames + frame < pools.size());
+    auto& pool = pools[static_cast<usize>(thread) * frames + frame];
+
+    if (pool.next == pool.command_buffers.size())
+    {
+        VkCommandBufferAllocateInfo allocate_info{};
+        allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocate_info.commandPool = pool.command_pool;
+        allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocate_info.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer{ nullptr };
+        if (vkAllocateCommandBuffers(context->device, &allocate_info, &command_buffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create command buffer");
+
+        pool.command_buffers.push_back(command_buffer);
+    }
+
+    const auto command_buffer = pool.command_buffers[pool.next++];
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+
+    return command_buffer;
 }
+}
\ No newline at end of file
@@ -24,4 +24,32 @@ private:
     VkCommandPool command_pool{ nullptr };
     std::vector<VkCommandBuffer> command_buffers{};
 };
+
+// One command pool per thread and frame in flight, so recording threads never share a pool.
+// Buffers are handed out linearly and the whole pool is reset at once when the frame slot is reused.
+class ThreadCommandPools
+{
+public:
+    ThreadCommandPools() = delete;
+    ~ThreadCommandPools();
+    DISABLE_COPY_AND_MOVE(ThreadCommandPools)
+    ThreadCommandPools(std::shared_ptr<Context> c, u32 queue_family_index, u32 thread_count, u32 frame_count);
+
+    // Must only be called once the work recorded in the frame slot has finished on the gpu.
+    void reset(u32 frame);
+
+    [[nodiscard]] VkCommandBuffer begin(u32 thread, u32 frame);
+
+private:
+    struct Pool
+    {
+        VkCommandPool command_pool{ nullptr };
+        std::vector<VkCommandBuffer> command_buffers{};
+        usize next{ 0 };
+    };
+
+    std::shared_ptr<Context> context{ nullptr };
+    u32 frames{ 0 };
+    std::vector<Pool> pools{};
+};
 }
\ No newline at end of file
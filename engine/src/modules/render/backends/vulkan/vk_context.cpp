@@ -46,7 +46,6 @@ bool is_device_suitable(const VkPhysicalDevice physical_device, const std::vecto
 QueueFamilyIndices find_queue_families(const VkPhysicalDevice p, const VkSurfaceKHR surface)
 {
     assert(p);
-    assert(surface);
 
     QueueFamilyIndices indices;
     u32 qf_count{ 0 };
@@ -63,6 +62,22 @@ QueueFamilyIndices find_queue_families(const VkPhysicalDevice p, const VkSurface
         }
     }
 
+    for (u32 i{ 0 }; i < qf_count; ++i)
+    {
+        if ((q_families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(q_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            indices.compute_family = i;
+            break;
+        }
+    }
+
+    // Nothing is presented when headless, the graphics queue stands in so the indices stay complete.
+    if (!surface)
+    {
+        indices.present_family = indices.graphics_family;
+        return indices;
+    }
+
     for (u32 i{ 0 }; i < qf_count; ++i)
     {
         VkBool32 present_support{ false };
@@ -78,25 +93,32 @@ QueueFamilyIndices find_queue_families(const VkPhysicalDevice p, const VkSurface
     return indices;
 }
 }
-Context::Context(GLFWwindow* w)
+Context::Context(GLFWwindow* w, const u32 frame_count, const VkExtent2D offscreen_extent)
 {
     spdlog::info("Initialising vulkan");
+    frames_in_flight = std::clamp(frame_count, 1u, max_frames_in_flight);
+    spdlog::info("Frames in flight: {}", frames_in_flight);
+
     if (const auto result = volkInitialize(); result != VK_SUCCESS)
         throw std::runtime_error("Failed to initialise volk");
 
     window = w;
-    instance = create_instance();
+    instance = create_instance(is_headless());
     volkLoadInstance(instance);
 
     if constexpr (enable_validation)
         debug::init(instance);
 
-    if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
+    if (is_headless())
+        spdlog::info("Running headless, rendering to {}x{} offscreen images", offscreen_extent.width, offscreen_extent.height);
+    else if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
         throw std::runtime_error("Failed to create glfw window surface!");
 
     create_device();
     volkLoadDevice(device);
 
+    timeline = std::make_unique<GpuTimeline>(device, graphics_queue, compute_queue);
+
     VmaVulkanFunctions vma_vulkan_func{};
     vma_vulkan_func.vkGetInstanceProcAddr = vkGetInstanceProcAddr;
     vma_vulkan_func.vkGetDeviceProcAddr = vkGetDeviceProcAddr;
@@ -128,14 +150,22 @@ Context::Context(GLFWwindow* w)
 
     vmaCreateAllocator(&alloc_ci, &allocator);
 
-    finalize_swapchain();
+    if (is_headless())
+        create_offscreen_images(offscreen_extent);
+    else
+        finalize_swapchain(framebuffer_extent());
 }
 
 Context::~Context()
 {
+    timeline.reset();
+
     for (const auto image_view : surface_image_views)
         vkDestroyImageView(device, image_view, nullptr);
 
+    for (usize i{ 0 }; i < offscreen_allocations.size(); ++i)
+        vmaDestroyImage(allocator, surface_images[i], offscreen_allocations[i]);
+
     vkDestroySwapchainKHR(device, swap_chain, nullptr);
 
     vkDestroySurfaceKHR(instance, surface, nullptr);
@@ -150,12 +180,36 @@ Context::~Context()
     vkDestroyInstance(instance, nullptr);
 }
 
-void Context::resize_swapchain()
+void Context::resize_swapchain(const VkExtent2D framebuffer)
+{
+    // Offscreen images keep the size they were created with.
+    if (is_headless())
+        return;
+
+    finalize_swapchain(framebuffer);
+}
+
+VkExtent2D Context::framebuffer_extent() const
+{
+    if (is_headless())
+        return surface_extent;
+
+    i32 width{ 0 }, height{ 0 };
+    glfwGetFramebufferSize(window, &width, &height);
+
+    return { static_cast<u32>(width), static_cast<u32>(height) };
+}
+
+std::vector<u32> Context::shared_queue_families() const
 {
-    finalize_swapchain();
+    std::vector<u32> families{ queue_family_indices.graphics_family.value() };
+    if (queue_family_indices.has_compute_queue())
+        families.push_back(queue_family_indices.compute_family.value());
+
+    return families;
 }
 
-VkInstance Context::create_instance()
+VkInstance Context::create_instance(const bool headless)
 {
     VkApplicationInfo app_info{ VK_STRUCTURE_TYPE_APPLICATION_INFO };
     app_info.pApplicationName = "Mastodon";
@@ -164,8 +218,9 @@ VkInstance Context::create_instance()
     app_info.engineVersion = VK_MAKE_VERSION(0, 0, 1);
     app_info.apiVersion = VK_API_VERSION_1_3;
 
+    // Glfw is not initialised when headless and no surface extensions are needed.
     u32 glfw_ext_count{ 0 };
-    const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+    const char** glfw_extensions = headless ? nullptr : glfwGetRequiredInstanceExtensions(&glfw_ext_count);
 
     u32 supported_ext_count{ 0 };
     vkEnumerateInstanceExtensionProperties(nullptr, &supported_ext_count, nullptr);
@@ -235,9 +290,10 @@ void Context::create_device()
     std::vector<VkPhysicalDevice> physical_devices(phys_device_count);
     vkEnumeratePhysicalDevices(instance, &phys_device_count, physical_devices.data());
 
-    const std::vector<const char*> req_extensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-    };
+    // Culling writes draw counts on the gpu, the draws read them back through vkCmdDrawIndexedIndirectCount.
+    std::vector<const char*> req_extensions{ VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME };
+    if (!is_headless())
+        req_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
     phys_device = physical_devices[0];
     for (usize i{ 0 }; i < physical_devices.size(); ++i)
@@ -259,6 +315,8 @@ void Context::create_device()
 
     queue_family_indices = find_queue_families(phys_device, surface);
     std::set<u32> unique_qf = { queue_family_indices.graphics_family.value(), queue_family_indices.present_family.value() };
+    if (queue_family_indices.has_compute_queue())
+        unique_qf.insert(queue_family_indices.compute_family.value());
 
     std::vector<VkDeviceQueueCreateInfo> queue_cis;
     constexpr f32 queue_priority{ 1.0f };
@@ -283,10 +341,16 @@ void Context::create_device()
     auto buffer_device_address = VkPhysicalDeviceBufferDeviceAddressFeatures{};
     buffer_device_address.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
     buffer_device_address.pNext = &desc_index;
+    auto timeline_semaphore = VkPhysicalDeviceTimelineSemaphoreFeatures{};
+    timeline_semaphore.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timeline_semaphore.pNext = &buffer_device_address;
+    auto host_query_reset = VkPhysicalDeviceHostQueryResetFeatures{};
+    host_query_reset.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES;
+    host_query_reset.pNext = &timeline_semaphore;
 
     VkPhysicalDeviceFeatures2 features2{};
     features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
-    features2.pNext = &buffer_device_address;
+    features2.pNext = &host_query_reset;
 
     vkGetPhysicalDeviceFeatures2(phys_device, &features2);
 
@@ -298,6 +362,12 @@ void Context::create_device()
         throw std::runtime_error("Device does not support features required by vulkan renderer");
     if (buffer_device_address.bufferDeviceAddress != VkBool32{ 1 })
         throw std::runtime_error("Device does not support features required by vulkan renderer");
+    if (timeline_semaphore.timelineSemaphore != VkBool32{ 1 })
+        throw std::runtime_error("Device does not support features required by vulkan renderer");
+    if (host_query_reset.hostQueryReset != VkBool32{ 1 })
+        throw std::runtime_error("Device does not support features required by vulkan renderer");
+    if (features2.features.multiDrawIndirect != VkBool32{ 1 })
+        throw std::runtime_error("Device does not support features required by vulkan renderer");
 
     VkPhysicalDeviceFeatures enabled_features{};
 
@@ -320,10 +390,15 @@ void Context::create_device()
 
     vkGetDeviceQueue(device, queue_family_indices.graphics_family.value(), 0, &graphics_queue);
     vkGetDeviceQueue(device, queue_family_indices.present_family.value(), 0, &present_queue);
+    if (queue_family_indices.has_compute_queue())
+    {
+        vkGetDeviceQueue(device, queue_family_indices.compute_family.value(), 0, &compute_queue);
+        spdlog::info("Async compute queue enabled");
+    }
 
 }
 
-void Context::finalize_swapchain()
+void Context::finalize_swapchain(const VkExtent2D framebuffer)
 {
     assert(phys_device);
     assert(device);
@@ -372,22 +447,16 @@ void Context::finalize_swapchain()
             surface_format = format;
     }
 
-    i32 width{ 0 }, height{ 0 };
-    glfwGetFramebufferSize(window, &width, &height);
-
-    VkExtent2D actual_extent = {
-        static_cast<u32>(width),
-        static_cast<u32>(height)
-    };
-
+    VkExtent2D actual_extent = framebuffer;
     actual_extent.width = std::clamp(actual_extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
     actual_extent.height = std::clamp(actual_extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
 
     surface_extent = actual_extent;
 
-    u32 image_count{ capabilities.minImageCount };
-    if (capabilities.minImageCount <= 2)
-        image_count = 2;
+    // One image per frame in flight plus the one being presented, so acquiring never waits on the display.
+    u32 image_count = std::max({ capabilities.minImageCount, 2u, frames_in_flight + 1 });
+    if (capabilities.maxImageCount > 0)
+        image_count = std::min(image_count, capabilities.maxImageCount);
 
     VkSwapchainCreateInfoKHR c_info{};
     c_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -399,7 +468,8 @@ void Context::finalize_swapchain()
     c_info.imageArrayLayers = 1;
     c_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-    const auto [graphics_family, present_family] = queue_family_indices;
+    const auto& graphics_family = queue_family_indices.graphics_family;
+    const auto& present_family = queue_family_indices.present_family;
     const u32 indices[] = { graphics_family.value(), present_family.value() };
     if (graphics_family.value() != present_family.value())
     {
@@ -424,10 +494,14 @@ void Context::finalize_swapchain()
 
     if (old_swap_chain != nullptr)
     {
-        for (const auto image_view : surface_image_views)
-            vkDestroyImageView(device, image_view, nullptr);
+        timeline->retire([d = device, old_swap_chain, image_views = std::move(surface_image_views)]()
+        {
+            for (const auto image_view : image_views)
+                vkDestroyImageView(d, image_view, nullptr);
 
-        vkDestroySwapchainKHR(device, old_swap_chain, nullptr);
+            vkDestroySwapchainKHR(d, old_swap_chain, nullptr);
+        });
+        surface_image_views.clear();
     }
 
     vkGetSwapchainImagesKHR(device, swap_chain, &image_count, nullptr);
@@ -456,4 +530,47 @@ void Context::finalize_swapchain()
             throw std::runtime_error("Failed to create swap chain image views");
     }
 }
+
+void Context::create_offscreen_images(const VkExtent2D extent)
+{
+    surface_format = { VK_FORMAT_R8G8B8A8_SRGB, VK_COLORSPACE_SRGB_NONLINEAR_KHR };
+    surface_extent = extent;
+
+    VkImageCreateInfo image_ci{};
+    image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_ci.imageType = VK_IMAGE_TYPE_2D;
+    image_ci.format = surface_format.format;
+    image_ci.extent = { extent.width, extent.height, 1 };
+    image_ci.mipLevels = 1;
+    image_ci.arrayLayers = 1;
+    image_ci.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+    // Transfer source so the final frame can be read back.
+    image_ci.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VmaAllocationCreateInfo alloc_ci{};
+    alloc_ci.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+    // One image per frame slot stands in for the swapchain, the renderer uses the frame index as image index.
+    surface_images.resize(frames_in_flight);
+    surface_image_views.resize(frames_in_flight);
+    offscreen_allocations.resize(frames_in_flight);
+    for (usize i{ 0 }; i < frames_in_flight; ++i)
+    {
+        if (vmaCreateImage(allocator, &image_ci, &alloc_ci, &surface_images[i], &offscreen_allocations[i], nullptr) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create offscreen image!");
+
+        VkImageViewCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        create_info.image = surface_images[i];
+        create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        create_info.format = surface_format.format;
+        create_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        if (vkCreateImageView(device, &create_info, nullptr, &surface_image_views[i]) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create offscreen image views");
+    }
+}
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "common.h"
 #include "modules/render/render_module.h"
+#include "vk_timeline.h"
 
 #include "volk/volk.h"
 #include "vma/vk_mem_alloc.h"
@@ -14,7 +15,8 @@ struct GLFWwindow;
 
 namespace mas::gfx::vulkan
 {
-constexpr u32 back_buffer_count{ 2 };
+// Upper bound for the configurable number of frames in flight.
+constexpr u32 max_frames_in_flight{ 3 };
 
 #if _DEBUG
 constexpr bool enable_validation{ true };
@@ -25,12 +27,13 @@ constexpr bool enable_validation{ true };
 struct QueueFamilyIndices
 {
     std::optional<u32> graphics_family = std::nullopt;
-    //std::optional<u32> compute_family = std::nullopt;
+    // Only set for a dedicated compute family, used for async compute.
+    std::optional<u32> compute_family = std::nullopt;
     //std::optional<u32> transfer_family = std::nullopt;
     std::optional<u32> present_family = std::nullopt;
 
     [[nodiscard]] bool has_graphics_queue() const { return graphics_family.has_value(); }
-    //[[nodiscard]] bool has_compute_queue() const { return compute_family.has_value(); }
+    [[nodiscard]] bool has_compute_queue() const { return compute_family.has_value(); }
     //[[nodiscard]] bool has_transfer_queue() const { return transfer_family.has_value(); }
     [[nodiscard]] bool has_present_queue() const { return present_family.has_value(); }
 
@@ -40,21 +43,39 @@ struct QueueFamilyIndices
 class Context
 {
 public:
-    explicit Context(GLFWwindow* w);
+    // Without a window the context is headless. There is no surface or swapchain, frames are rendered into
+    // one offscreen image per frame in flight of offscreen_extent instead.
+    Context(GLFWwindow* w, u32 frame_count, VkExtent2D offscreen_extent = {});
     ~Context();
     DISABLE_COPY_AND_MOVE(Context)
 
-    void resize_swapchain();
+    // Recreates the swapchain from the old one. Images of the old swapchain are retired on the timeline,
+    // so frames still in flight can finish without idling the device. Safe to call from the render thread,
+    // the framebuffer size has to be queried on the main thread.
+    void resize_swapchain(VkExtent2D framebuffer);
+
+    // Current size of the window framebuffer, zero while minimized. Main thread only.
+    [[nodiscard]] VkExtent2D framebuffer_extent() const;
+
+    // Queue families a resource has to be shared between. Resources are used concurrently by the graphics and
+    // async compute queue instead of transferring ownership every frame.
+    [[nodiscard]] std::vector<u32> shared_queue_families() const;
+
+    [[nodiscard]] bool is_headless() const { return window == nullptr; }
 
 private:
-    static VkInstance create_instance();
+    static VkInstance create_instance(bool headless);
 
     void create_device();
 
-    void finalize_swapchain();
+    void finalize_swapchain(VkExtent2D framebuffer);
+
+    void create_offscreen_images(VkExtent2D extent);
 
 public:
     GLFWwindow* window{ nullptr };
+    // Frame slots the cpu may record ahead of the gpu, every per frame resource is created this many times.
+    u32 frames_in_flight{ 2 };
     VkInstance instance{ nullptr };
     VkSurfaceKHR surface{ nullptr };
     VkPhysicalDevice phys_device{ nullptr };
@@ -62,11 +83,15 @@ public:
     QueueFamilyIndices queue_family_indices{};
     VkQueue graphics_queue{ nullptr };
     VkQueue present_queue{ nullptr };
+    VkQueue compute_queue{ nullptr };
+    std::unique_ptr<GpuTimeline> timeline{ nullptr };
     VmaAllocator allocator{ nullptr };
     VkSwapchainKHR swap_chain{ nullptr };
     VkSurfaceFormatKHR surface_format{};
     VkExtent2D surface_extent{};
+    // Swapchain images, or the offscreen images when headless.
     std::vector<VkImage> surface_images{};
     std::vector<VkImageView> surface_image_views{};
+    std::vector<VmaAllocation> offscreen_allocations{};
 };
 }
\ No newline at end of file
@@ -0,0 +1,298 @@
+#include "vk_profiler.h"
+
+#include "imgui/imgui.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace mas::gfx::vulkan
+{
+namespace
+{
+// Weight of the newest sample in the rolling averages, roughly a 30 frame window.
+constexpr f64 average_weight{ 1.0 / 30.0 };
+
+u32 timestamp_valid_bits(const VkPhysicalDevice phys_device, const u32 queue_family)
+{
+    u32 count{ 0 };
+    vkGetPhysicalDeviceQueueFamilyProperties(phys_device, &count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(count);
+    vkGetPhysicalDeviceQueueFamilyProperties(phys_device, &count, families.data());
+
+    return queue_family < count ? families[queue_family].timestampValidBits : 0;
+}
+
+ImU32 scope_color(const std::string& name)
+{
+    const auto hash = std::hash<std::string>{}(name);
+    const f32 hue = static_cast<f32>(hash % 360) / 360.0f;
+
+    f32 r{ 0.0f };
+    f32 g{ 0.0f };
+    f32 b{ 0.0f };
+    ImGui::ColorConvertHSVtoRGB(hue, 0.55f, 0.85f, r, g, b);
+
+    return ImGui::GetColorU32(ImVec4(r, g, b, 1.0f));
+}
+}
+
+GpuProfiler::GpuProfiler(std::shared_ptr<Context> c, const u32 frame_count, const u32 max_scopes)
+    : context(std::move(c)),
+    max_scopes(max_scopes)
+{
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(context->phys_device, &properties);
+
+    const u32 valid_bits = timestamp_valid_bits(context->phys_device, context->queue_family_indices.graphics_family.value());
+    if (valid_bits == 0 || properties.limits.timestampPeriod <= 0.0f)
+    {
+        spdlog::warn("Graphics queue does not support timestamps, gpu profiling is disabled");
+        return;
+    }
+
+    enabled = true;
+    timestamp_period_ms = static_cast<f64>(properties.limits.timestampPeriod) / 1'000'000.0;
+    timestamp_mask = valid_bits >= 64 ? ~u64{ 0 } : (u64{ 1 } << valid_bits) - 1;
+
+    if (context->queue_family_indices.has_compute_queue())
+        compute_timestamps = timestamp_valid_bits(context->phys_device, context->queue_family_indices.compute_family.value()) > 0;
+
+    VkQueryPoolCreateInfo query_pool_ci{};
+    query_pool_ci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_ci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_ci.queryCount = max_scopes * 2;
+
+    query_pools.resize(frame_count);
+    for (auto& pool : query_pools)
+    {
+        if (vkCreateQueryPool(context->device, &query_pool_ci, nullptr, &pool) != VK_SUCCESS)
+        {
+            spdlog::error("Failed to create timestamp query pool");
+            throw std::runtime_error("Failed to create timestamp query pool");
+        }
+        vkResetQueryPool(context->device, pool, 0, query_pool_ci.queryCount);
+    }
+
+    frame_scopes.resize(frame_count, std::vector<Scope>(max_scopes));
+    frame_scope_counts.resize(frame_count, 0);
+    query_results.resize(static_cast<usize>(max_scopes) * 2);
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    for (const auto pool : query_pools)
+        vkDestroyQueryPool(context->device, pool, nullptr);
+}
+
+void GpuProfiler::begin_frame(const u32 frame)
+{
+    if (!enabled)
+        return;
+
+    frame_scope_counts[current_frame] = std::min(next_scope.load(std::memory_order_relaxed), max_scopes);
+
+    resolve(frame);
+
+    current_frame = frame;
+    next_scope.store(0, std::memory_order_relaxed);
+}
+
+void GpuProfiler::resolve(const u32 frame)
+{
+    const u32 count = frame_scope_counts[frame];
+    if (count == 0)
+        return;
+
+    // Every query of the slot was written, so anything but success means the frame has not actually finished.
+    const auto result = vkGetQueryPoolResults(context->device, query_pools[frame], 0, count * 2,
+                                              count * 2 * sizeof(u64), query_results.data(), sizeof(u64), VK_QUERY_RESULT_64_BIT);
+    vkResetQueryPool(context->device, query_pools[frame], 0, count * 2);
+    frame_scope_counts[frame] = 0;
+
+    if (result != VK_SUCCESS)
+        return;
+
+    u64 origin{ ~u64{ 0 } };
+    u64 end{ 0 };
+    for (u32 i{ 0 }; i < count; ++i)
+    {
+        origin = std::min(origin, query_results[i * 2] & timestamp_mask);
+        end = std::max(end, query_results[i * 2 + 1] & timestamp_mask);
+    }
+
+    timings.resize(count);
+    for (u32 i{ 0 }; i < count; ++i)
+    {
+        const auto& scope = frame_scopes[frame][i];
+        const u64 begin_ticks = query_results[i * 2] & timestamp_mask;
+        const u64 end_ticks = std::max(query_results[i * 2 + 1] & timestamp_mask, begin_ticks);
+
+        auto& timing = timings[i];
+        timing.name = scope.name;
+        timing.depth = scope.depth;
+        timing.begin_ms = static_cast<f64>(begin_ticks - origin) * timestamp_period_ms;
+        timing.duration_ms = static_cast<f64>(end_ticks - begin_ticks) * timestamp_period_ms;
+
+        auto [average, inserted] = averages.try_emplace(scope.name, timing.duration_ms);
+        if (!inserted)
+            average->second += (timing.duration_ms - average->second) * average_weight;
+        timing.average_ms = average->second;
+    }
+
+    // Scopes recorded on different threads land in any order, sort them into a readable timeline.
+    std::ranges::sort(timings, [](const ScopeTiming& a, const ScopeTiming& b)
+    {
+        return a.begin_ms != b.begin_ms ? a.begin_ms < b.begin_ms : a.depth < b.depth;
+    });
+
+    frame_ms = end > origin ? static_cast<f64>(end - origin) * timestamp_period_ms : 0.0;
+    ++resolved_frames;
+
+    if (recording)
+    {
+        for (const auto& timing : timings)
+        {
+            auto [index, inserted] = csv_name_indices.try_emplace(timing.name, static_cast<u32>(csv_names.size()));
+            if (inserted)
+                csv_names.push_back(timing.name);
+
+            csv_rows.push_back({ resolved_frames, index->second, timing.begin_ms, timing.duration_ms });
+        }
+    }
+}
+
+u32 GpuProfiler::begin_scope(const VkCommandBuffer cmd, const std::string& name, const u32 depth)
+{
+    if constexpr (enable_validation)
+    {
+        VkDebugUtilsLabelEXT label{};
+        label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+        label.pLabelName = name.c_str();
+        vkCmdBeginDebugUtilsLabelEXT(cmd, &label);
+    }
+
+    if (!enabled)
+        return invalid_profiler_scope;
+
+    const u32 scope = next_scope.fetch_add(1, std::memory_order_relaxed);
+    if (scope >= max_scopes)
+        return invalid_profiler_scope;
+
+    auto& [scope_name, scope_depth] = frame_scopes[current_frame][scope];
+    scope_name = name;
+    scope_depth = depth;
+
+    vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, query_pools[current_frame], scope * 2);
+
+    return scope;
+}
+
+void GpuProfiler::end_scope(const VkCommandBuffer cmd, const u32 scope)
+{
+    if (scope != invalid_profiler_scope)
+        vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, query_pools[current_frame], scope * 2 + 1);
+
+    if constexpr (enable_validation)
+        vkCmdEndDebugUtilsLabelEXT(cmd);
+}
+
+void GpuProfiler::draw_ui()
+{
+    if (!ImGui::Begin("GPU Profiler"))
+    {
+        ImGui::End();
+        return;
+    }
+
+    if (!enabled)
+    {
+        ImGui::TextUnformatted("Timestamps are not supported by this device");
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("GPU frame: %.3f ms", frame_ms);
+
+    ImGui::Checkbox("Record", &recording);
+    ImGui::SameLine();
+    if (ImGui::Button("Save CSV"))
+    {
+        if (dump_csv("gpu_timings.csv"))
+            spdlog::info("Wrote {} gpu timings to gpu_timings.csv", csv_rows.size());
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+        csv_rows.clear();
+    ImGui::SameLine();
+    ImGui::Text("%zu samples", csv_rows.size());
+
+    // One row per depth, every scope placed by its start relative to the first timestamp of the frame.
+    u32 max_depth{ 0 };
+    for (const auto& timing : timings)
+        max_depth = std::max(max_depth, timing.depth);
+
+    const f32 row_height = ImGui::GetTextLineHeightWithSpacing();
+    const f32 width = ImGui::GetContentRegionAvail().x;
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton("timeline", ImVec2(width, row_height * static_cast<f32>(max_depth + 1)));
+
+    auto* draw_list = ImGui::GetWindowDrawList();
+    const f64 scale = frame_ms > 0.0 ? static_cast<f64>(width) / frame_ms : 0.0;
+    for (const auto& timing : timings)
+    {
+        const ImVec2 min(origin.x + static_cast<f32>(timing.begin_ms * scale), origin.y + row_height * static_cast<f32>(timing.depth));
+        const ImVec2 max(std::max(min.x + 1.0f, min.x + static_cast<f32>(timing.duration_ms * scale)), min.y + row_height - 1.0f);
+
+        draw_list->AddRectFilled(min, max, scope_color(timing.name));
+        draw_list->PushClipRect(min, max, true);
+        draw_list->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32_BLACK, timing.name.c_str());
+        draw_list->PopClipRect();
+
+        if (ImGui::IsMouseHoveringRect(min, max))
+            ImGui::SetTooltip("%s\n%.3f ms (avg %.3f ms)", timing.name.c_str(), timing.duration_ms, timing.average_ms);
+    }
+
+    if (ImGui::BeginTable("timings", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV))
+    {
+        ImGui::TableSetupColumn("Scope");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("avg ms");
+        ImGui::TableHeadersRow();
+
+        for (const auto& timing : timings)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Indent(static_cast<f32>(timing.depth) * 12.0f + 0.001f);
+            ImGui::TextUnformatted(timing.name.c_str());
+            ImGui::Unindent(static_cast<f32>(timing.depth) * 12.0f + 0.001f);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", timing.duration_ms);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", timing.average_ms);
+        }
+
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
+bool GpuProfiler::dump_csv(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        spdlog::error("Failed to open: {} for writing gpu timings", path);
+        return false;
+    }
+
+    file << "frame,scope,begin_ms,duration_ms\n";
+    for (const auto& [frame, scope, begin_ms, duration_ms] : csv_rows)
+        file << frame << ',' << csv_names[scope] << ',' << begin_ms << ',' << duration_ms << '\n';
+
+    return true;
+}
+}
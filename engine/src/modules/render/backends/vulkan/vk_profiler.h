@@ -0,0 +1,93 @@
+#pragma once
+#include "vk_context.h"
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+
+namespace mas::gfx::vulkan
+{
+constexpr u32 default_profiler_scopes{ 256 };
+constexpr u32 invalid_profiler_scope{ ~0u };
+
+struct ScopeTiming
+{
+    std::string name{};
+    u32 depth{ 0 };
+    f64 begin_ms{ 0.0 };
+    f64 duration_ms{ 0.0 };
+    f64 average_ms{ 0.0 };
+};
+
+// Timestamp queries around command buffer regions, one query pool per frame in flight. Results are read back
+// when the frame slot comes around again, so reading them never stalls. Scopes also emit debug utils labels,
+// which makes them show up under the same names in capture tools.
+class GpuProfiler
+{
+public:
+    GpuProfiler() = delete;
+    ~GpuProfiler();
+    DISABLE_COPY_AND_MOVE(GpuProfiler)
+    GpuProfiler(std::shared_ptr<Context> c, u32 frame_count, u32 max_scopes = default_profiler_scopes);
+
+    // Must only be called once all work of the frame slot has finished. Resolves the timings recorded in it.
+    void begin_frame(u32 frame);
+
+    // Safe to call from several recording threads at once. Returns invalid_profiler_scope when out of queries.
+    u32 begin_scope(VkCommandBuffer cmd, const std::string& name, u32 depth = 0);
+    void end_scope(VkCommandBuffer cmd, u32 scope);
+
+    void draw_ui();
+
+    [[nodiscard]] bool dump_csv(const std::string& path) const;
+
+    [[nodiscard]] const std::vector<ScopeTiming>& get_timings() const { return timings; }
+
+    // Span of the last resolved frame, frames_in_flight frames behind the one being recorded.
+    [[nodiscard]] f64 get_frame_ms() const { return frame_ms; }
+
+    // Scopes must only be recorded on the async compute queue if its family supports timestamps.
+    [[nodiscard]] bool has_compute_timestamps() const { return compute_timestamps; }
+
+private:
+    void resolve(u32 frame);
+
+    struct Scope
+    {
+        std::string name{};
+        u32 depth{ 0 };
+    };
+
+    struct CsvRow
+    {
+        u64 frame{ 0 };
+        u32 scope{ 0 };
+        f64 begin_ms{ 0.0 };
+        f64 duration_ms{ 0.0 };
+    };
+
+    std::shared_ptr<Context> context{ nullptr };
+    u32 max_scopes{ 0 };
+    f64 timestamp_period_ms{ 0.0 };
+    u64 timestamp_mask{ 0 };
+    bool enabled{ false };
+    bool compute_timestamps{ false };
+
+    std::vector<VkQueryPool> query_pools{};
+    std::vector<std::vector<Scope>> frame_scopes{};
+    std::vector<u32> frame_scope_counts{};
+    std::vector<u64> query_results{};
+    u32 current_frame{ 0 };
+    std::atomic<u32> next_scope{ 0 };
+
+    u64 resolved_frames{ 0 };
+    f64 frame_ms{ 0.0 };
+    std::vector<ScopeTiming> timings{};
+    std::unordered_map<std::string, f64> averages{};
+
+    bool recording{ false };
+    std::vector<std::string> csv_names{};
+    std::unordered_map<std::string, u32> csv_name_indices{};
+    std::vector<CsvRow> csv_rows{};
+};
+}
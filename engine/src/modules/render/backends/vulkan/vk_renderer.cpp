@@ -2,24 +2,33 @@
 
 #include "imgui/imgui.h"
 #include "spdlog/spdlog.h"
+#include "tiny_gltf/stb_image_write.h"
 
+#include <fstream>
+#include <limits>
 #include <stdexcept>
 
 
+#include "shaders/culling.h"
+
 // TEMPORARY
 #include "shaders/test.h"
 
 namespace mas::gfx::vulkan
 {
-Renderer::Renderer(GLFWwindow* window, flecs::world* w)
-    : context(std::make_shared<Context>(window)),
+Renderer::Renderer(GLFWwindow* window, const RenderSettings& settings, tf::Executor& executor)
+    : context(std::make_shared<Context>(window, settings.frames_in_flight, settings.headless
+                                            ? VkExtent2D{ settings.headless->width, settings.headless->height }
+                                            : VkExtent2D{})),
     resource_manager(context),
-    render_graph(context),
+    render_graph(context, executor),
     ui_overlay(context),
-    draw_command(Command(context, context->graphics_queue, context->queue_family_indices.graphics_family.value(), back_buffer_count)),
-    world(w)
+    draw_command(Command(context, context->graphics_queue, context->queue_family_indices.graphics_family.value(), context->frames_in_flight)),
+    low_latency(settings.low_latency),
+    threaded(settings.render_thread)
 {
     create_render_sync_objects();
+    create_present_semaphores();
 
     auto test1 = std::make_unique<TestNode>();
     auto test2 = std::make_unique<TestNode>();
@@ -52,33 +61,254 @@ Renderer::Renderer(GLFWwindow* window, flecs::world* w)
     render_graph.add_pass_edge("second", "first");
     render_graph.add_pass_edge("second", "third");
 
-    render_graph.setup();
+    // Transforms live on the gpu in one slot per renderable entity, only the ones that changed are uploaded.
+    render_graph.add_node(std::make_unique<SceneNode>(scene), "scene_update", "scene");
+    render_graph.add_pass("scene", RenderPassType::Compute);
+
+    // Instances are grouped by Model and culled on the gpu against the frustum and last frame's depth pyramid. Every
+    // group with survivors becomes one instanced command, drawn with indirect count draws, and their depth builds the
+    // next pyramid.
+    auto culling = std::make_shared<CullingState>();
+    render_graph.add_transient_image("SceneDepth", { scene_depth_format,
+                                     VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                     VK_IMAGE_ASPECT_DEPTH_BIT });
+
+    render_graph.add_node(std::make_unique<CullNode>(culling, render_graph.get_executor()), "cull", "culling");
+    render_graph.add_node(std::make_unique<DepthPrepassNode>(culling), "depth_prepass", "depth");
+    render_graph.add_node(std::make_unique<HiZNode>(), "hiz_build", "hiz");
+
+    render_graph.add_pass("culling", RenderPassType::Compute);
+    render_graph.add_pass("depth", RenderPassType::Render);
+    render_graph.add_pass("hiz", RenderPassType::Compute);
+
+    render_graph.add_pass_edge("scene", "culling");
+    render_graph.add_pass_edge("culling", "depth");
+    render_graph.add_pass_edge("depth", "hiz");
+
+    if (threaded)
+        render_thread = std::thread(&Renderer::render_loop, this);
 }
 
 Renderer::~Renderer()
 {
-    vkDeviceWaitIdle(context->device);
-
-    for (usize i{ 0 }; i < back_buffer_count; ++i)
+    if (render_thread.joinable())
     {
-        vkDestroySemaphore(context->device, render_finished_semaphores[i], nullptr);
-        vkDestroySemaphore(context->device, image_available_semaphores[i], nullptr);
-        vkDestroyFence(context->device, in_flight_fences[i], nullptr);
+        {
+            std::lock_guard lock(render_mutex);
+            stopping = true;
+        }
+        render_cv.notify_all();
+        render_thread.join();
     }
+
+    vkDeviceWaitIdle(context->device);
+    context->timeline->collect_retired();
+
+    for (const auto semaphore : image_available_semaphores)
+        vkDestroySemaphore(context->device, semaphore, nullptr);
+
+    for (const auto semaphore : render_finished_semaphores)
+        vkDestroySemaphore(context->device, semaphore, nullptr);
 }
 
 void Renderer::add_models(const std::vector<std::tuple<Model, gfx::MeshData, gfx::MaterialData>>& model_data)
 {
+    wait_render_idle();
     resource_manager.upload_models(model_data);
 }
 
 void Renderer::startup_done() 
 {
+    wait_render_idle();
     render_graph.setup();
     render_graph.setup_node_resources(resource_manager);
-    render_graph.ready_node_resources(resource_manager);
-    render_graph.update_node_resources(resource_manager, world);
+    rebuild_graph_resources();
+    // The last snapshot handed over, or an empty one if nothing has been extracted yet.
+    render_graph.update_node_resources(resource_manager, extracted_frames[extract_index ^ 1].snapshot);
     render_graph.setup_nodes(resource_manager);
+    nodes_ready = true;
+}
+
+RenderSnapshot& Renderer::begin_extract()
+{
+    // The render thread never reads this frame, it only ever gets the other one.
+    return extracted_frames[extract_index].snapshot;
+}
+
+void Renderer::end_extract(flecs::world* world)
+{
+    auto& frame = extracted_frames[extract_index];
+    frame.framebuffer_extent = context->framebuffer_extent();
+
+    // Everything below touches state the render thread owns while it records, including the ui draw data.
+    wait_render_idle();
+    draw_ui(world);
+    scene->apply(frame.snapshot.scene_updates);
+
+    const u32 index = extract_index;
+    extract_index ^= 1;
+
+    if (!threaded)
+    {
+        render(frame);
+        return;
+    }
+
+    {
+        std::lock_guard lock(render_mutex);
+        pending_frame = index;
+    }
+    render_cv.notify_all();
+}
+
+void Renderer::render_loop()
+{
+    while (true)
+    {
+        u32 index{ 0 };
+        {
+            std::unique_lock lock(render_mutex);
+            render_cv.wait(lock, [this]() { return pending_frame.has_value() || stopping; });
+            if (!pending_frame)
+                return;
+            index = *pending_frame;
+        }
+
+        try
+        {
+            render(extracted_frames[index]);
+        }
+        catch (...)
+        {
+            spdlog::error("Render thread failed");
+            std::lock_guard lock(render_mutex);
+            render_error = std::current_exception();
+        }
+
+        {
+            std::lock_guard lock(render_mutex);
+            pending_frame.reset();
+        }
+        render_cv.notify_all();
+    }
+}
+
+void Renderer::wait_render_idle()
+{
+    if (!threaded)
+        return;
+
+    std::unique_lock lock(render_mutex);
+    render_cv.wait(lock, [this]() { return !pending_frame.has_value(); });
+
+    if (render_error)
+        std::rethrow_exception(std::exchange(render_error, nullptr));
+}
+
+void Renderer::draw_ui(flecs::world* world)
+{
+    ui_overlay.new_frame();
+
+    render_graph.draw_ui(world);
+
+    if (ImGui::Begin("Frame pacing"))
+    {
+        ImGui::Text("Frames in flight: %u", context->frames_in_flight);
+        ImGui::Text("Frame slot: %u", current_frame);
+        ImGui::Text("Render thread: %s", threaded ? "on" : "off");
+        ImGui::Checkbox("Low latency", &low_latency);
+    }
+    ImGui::End();
+
+    UiOverlay::end_frame();
+}
+
+f64 Renderer::gpu_frame_ms() const
+{
+    return last_gpu_ms.load(std::memory_order_relaxed);
+}
+
+bool Renderer::capture_frame(const std::string& path)
+{
+    wait_render_idle();
+
+    // Swapchain images can not be read back once presented.
+    if (!context->is_headless())
+    {
+        spdlog::warn("Frame capture is only supported when running headless");
+        return false;
+    }
+
+    const auto point = frame_points[last_frame];
+    if (point.value == 0)
+    {
+        spdlog::warn("No frame has been rendered to capture");
+        return false;
+    }
+    context->timeline->wait(point);
+
+    const auto [width, height] = context->surface_extent;
+    const VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+    const Buffer readback(context, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+    const Command command(context, context->graphics_queue, context->queue_family_indices.graphics_family.value());
+    const auto cmd = command.begin();
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageExtent = { width, height, 1 };
+    vkCmdCopyImageToBuffer(cmd, context->surface_images[last_frame], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &region);
+
+    VkMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+    VkDependencyInfo dep_info{};
+    dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dep_info.memoryBarrierCount = 1;
+    dep_info.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(cmd, &dep_info);
+
+    command.flush();
+    vmaInvalidateAllocation(context->allocator, readback.allocation, 0, VK_WHOLE_SIZE);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        spdlog::error("Failed to open: {} for writing the captured frame", path);
+        return false;
+    }
+
+    // Offscreen images are rgba8, so the readback can be written as is.
+    const auto write = [](void* user, void* data, const int size)
+    {
+        static_cast<std::ofstream*>(user)->write(static_cast<const char*>(data), size);
+    };
+    if (stbi_write_png_to_func(write, &file, static_cast<i32>(width), static_cast<i32>(height), 4,
+                               readback.allocation_info.pMappedData, static_cast<i32>(width * 4)) == 0)
+    {
+        spdlog::error("Failed to encode the captured frame");
+        return false;
+    }
+
+    spdlog::info("Captured frame to: {}", path);
+    return true;
+}
+
+void Renderer::rebuild_graph_resources()
+{
+    // Node descriptors are rewritten in place, so no frame still executing may read them.
+    for (const auto point : frame_points)
+        context->timeline->wait(point);
+    render_graph.wait_async_work();
+
+    render_graph.create_transients(resource_manager);
+    render_graph.ready_node_resources(resource_manager);
+    render_graph.compile_barriers(resource_manager);
 }
 
 void Renderer::create_render_sync_objects()
@@ -86,51 +316,128 @@ void Renderer::create_render_sync_objects()
     VkSemaphoreCreateInfo semaphore_create_info{};
     semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fence_create_info{};
-    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    frame_points.assign(context->frames_in_flight, { QueueType::Graphics, 0 });
 
-    for (usize i{ 0 }; i < back_buffer_count; ++i)
+    // Acquire and present semaphores only exist for the swapchain.
+    if (context->is_headless())
+        return;
+
+    image_available_semaphores.resize(context->frames_in_flight);
+    for (auto& semaphore : image_available_semaphores)
     {
-        if (vkCreateSemaphore(context->device, &semaphore_create_info, nullptr, &image_available_semaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(context->device, &semaphore_create_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(context->device, &fence_create_info, nullptr, &in_flight_fences[i]) != VK_SUCCESS)
+        if (vkCreateSemaphore(context->device, &semaphore_create_info, nullptr, &semaphore) != VK_SUCCESS)
             throw std::runtime_error("Failed to create a sync primitive!");
     }
 }
 
-void Renderer::render(flecs::world* w)
+void Renderer::create_present_semaphores()
 {
-    world = w;
-    UiOverlay::new_frame();
+    // Presents still queued may wait on the old semaphores.
+    if (!render_finished_semaphores.empty())
+    {
+        context->timeline->retire([d = context->device, semaphores = std::move(render_finished_semaphores)]()
+        {
+            for (const auto semaphore : semaphores)
+                vkDestroySemaphore(d, semaphore, nullptr);
+        });
+    }
+    render_finished_semaphores.clear();
 
-    ImGui::ShowDemoWindow();
-    render_graph.draw_ui(w);
+    if (context->is_headless())
+        return;
 
-    UiOverlay::end_frame();
+    VkSemaphoreCreateInfo semaphore_create_info{};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    const auto im = image_available_semaphores[current_frame];
-    const auto re = render_finished_semaphores[current_frame];
-    const auto fr = in_flight_fences[current_frame];
+    render_finished_semaphores.resize(context->surface_images.size());
+    for (auto& semaphore : render_finished_semaphores)
+    {
+        if (vkCreateSemaphore(context->device, &semaphore_create_info, nullptr, &semaphore) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create a sync primitive!");
+    }
+}
 
-    vkWaitForFences(context->device, 1, &fr, VK_TRUE, std::numeric_limits<u64>::max());
+void Renderer::recreate_swapchain(const VkExtent2D framebuffer)
+{
+    context->resize_swapchain(framebuffer);
+    create_present_semaphores();
 
-    u32 image_index{ 0 };
+    // Transients are sized relative to the swapchain, so every node has to pick up the new images.
+    if (nodes_ready)
+        rebuild_graph_resources();
 
-    if (const auto result = vkAcquireNextImageKHR(
-        context->device, context->swap_chain,
-        100, image_available_semaphores[current_frame],
-        VK_NULL_HANDLE, &image_index); result != VK_SUCCESS)
-    {
-        vkDeviceWaitIdle(context->device);
-        context->resize_swapchain();
+    swapchain_dirty = false;
+}
 
+void Renderer::render(const ExtractedFrame& frame)
+{
+    // Nothing can be presented while minimized, and a resize is picked up before acquiring rather than after
+    // the driver reports the swapchain as out of date.
+    const auto extent = frame.framebuffer_extent;
+    if (extent.width == 0 || extent.height == 0)
         return;
+
+    if (swapchain_dirty || extent.width != context->surface_extent.width || extent.height != context->surface_extent.height)
+        recreate_swapchain(extent);
+
+    auto& timeline = *context->timeline;
+
+    timeline.wait(frame_points[current_frame]);
+    timeline.collect_retired();
+
+    // The gpu is done with this frame slot, so its constants can be overwritten.
+    auto& frame_allocator = resource_manager.get_frame_allocator();
+    frame_allocator.begin_frame(current_frame);
+
+    // Headless frames render into the offscreen image of their slot, which the wait above already freed.
+    const bool headless = context->is_headless();
+    u32 image_index{ current_frame };
+
+    if (!headless)
+    {
+        // The frame slot wait above paces the cpu, so acquiring only blocks when every image is queued for display.
+        const auto acquire_result = vkAcquireNextImageKHR(context->device, context->swap_chain, std::numeric_limits<u64>::max(),
+                                                          image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
+        if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            // No image was acquired and the semaphore is left unsignaled, so the frame can just be skipped.
+            recreate_swapchain(extent);
+            return;
+        }
+
+        // A suboptimal image can still be presented, the swapchain is recreated once it has been.
+        if (acquire_result == VK_SUBOPTIMAL_KHR)
+            swapchain_dirty = true;
+        else if (acquire_result != VK_SUCCESS)
+        {
+            spdlog::error("Failed to acquire swapchain image");
+            throw std::runtime_error("Failed to acquire swapchain image");
+        }
     }
 
-    vkResetFences(context->device, 1, &fr);
+    // Slots past the scene buffer were assigned, the larger buffer holds everything applied so far.
+    if (nodes_ready && scene->capacity > scene->buffer_slots)
+    {
+        create_scene_buffer(context, resource_manager, *scene);
+        render_graph.compile_barriers(resource_manager);
+    }
+
+    // Toggling passes or nodes changes which transients alias and which barriers are needed.
+    if (nodes_ready && render_graph.setup())
+        rebuild_graph_resources();
+
+    if (nodes_ready)
+        render_graph.update_node_resources(resource_manager, frame.snapshot);
+
+    // Graph passes are recorded in parallel and submitted ahead of the ui and present transitions.
+    if (nodes_ready)
+    {
+        render_graph.run(current_frame, resource_manager, frame.snapshot);
+        last_gpu_ms.store(render_graph.get_profiler().get_frame_ms(), std::memory_order_relaxed);
+    }
 
     const auto cmd = draw_command.begin(current_frame);
+
     const auto output_image = context->surface_images[image_index];
     {
         VkImageMemoryBarrier2 image_barrier{};
@@ -152,7 +459,12 @@ void Renderer::render(flecs::world* w)
         vkCmdPipelineBarrier2(cmd, &dep_info);
     }
 
+    // The profiler frame is advanced by the graph, so the ui is only timed while the graph runs.
+    auto& profiler = render_graph.get_profiler();
+    const u32 ui_scope = nodes_ready ? profiler.begin_scope(cmd, "UI") : invalid_profiler_scope;
     ui_overlay.draw_cmd(cmd, context->surface_image_views[image_index]);
+    if (nodes_ready)
+        profiler.end_scope(cmd, ui_scope);
 
     {
         VkImageMemoryBarrier2 image_barrier{};
@@ -164,7 +476,8 @@ void Renderer::render(flecs::world* w)
         image_barrier.dstStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT;
         image_barrier.dstAccessMask = 0;
         image_barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        image_barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        // Offscreen images are left ready to be read back by capture_frame.
+        image_barrier.newLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
         VkDependencyInfo dep_info{};
         dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
@@ -174,24 +487,36 @@ void Renderer::render(flecs::world* w)
         vkCmdPipelineBarrier2(cmd, &dep_info);
     }
     draw_command.end(current_frame);
+    frame_allocator.flush();
 
-    VkSubmitInfo submit_info{};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    VkCommandBufferSubmitInfo cmd_info{};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    cmd_info.commandBuffer = cmd;
 
-    const VkSemaphore wait_semaphores[] = { im };
-    constexpr VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = wait_semaphores;
-    submit_info.pWaitDstStageMask = wait_stages;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &cmd;
+    if (headless)
+    {
+        // The last graphics submission of the frame, once its point is reached the whole slot can be reused.
+        frame_points[current_frame] = timeline.submit(QueueType::Graphics, { &cmd_info, 1 });
+        last_frame = current_frame;
+        current_frame = (current_frame + 1) % context->frames_in_flight;
+        return;
+    }
 
-    const VkSemaphore signal_semaphores[] = { re };
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signal_semaphores;
+    const auto re = render_finished_semaphores[image_index];
 
-    if (vkQueueSubmit(context->graphics_queue, 1, &submit_info, fr) != VK_SUCCESS)
-        throw std::runtime_error("Failed to submit command buffer to queue!");
+    VkSemaphoreSubmitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    wait_info.semaphore = image_available_semaphores[current_frame];
+    wait_info.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+    VkSemaphoreSubmitInfo signal_info{};
+    signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    signal_info.semaphore = re;
+    signal_info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+    frame_points[current_frame] = timeline.submit(QueueType::Graphics, { &cmd_info, 1 }, { &wait_info, 1 }, { &signal_info, 1 });
+
+    const VkSemaphore signal_semaphores[] = { re };
 
     VkPresentInfoKHR present_info{};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -204,8 +529,20 @@ void Renderer::render(flecs::world* w)
     present_info.pImageIndices = &image_index;
     present_info.pResults = nullptr;
 
-    vkQueuePresentKHR(context->present_queue, &present_info);
+    if (const auto present_result = vkQueuePresentKHR(context->present_queue, &present_info);
+        present_result == VK_ERROR_OUT_OF_DATE_KHR || present_result == VK_SUBOPTIMAL_KHR)
+        swapchain_dirty = true;
+    else if (present_result != VK_SUCCESS)
+    {
+        spdlog::error("Failed to present swapchain image");
+        throw std::runtime_error("Failed to present swapchain image");
+    }
+
+    // Nothing waits on the frame just submitted until its slot comes around again, unless latency matters more.
+    if (low_latency)
+        timeline.wait(frame_points[current_frame]);
 
-    current_frame = (current_frame++) % back_buffer_count;
+    last_frame = current_frame;
+    current_frame = (current_frame + 1) % context->frames_in_flight;
 }
 }
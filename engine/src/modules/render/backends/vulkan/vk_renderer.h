@@ -3,36 +3,99 @@
 #include "vk_ui.h"
 #include "render_graph.h"
 #include "resources/vk_resource_manager.h"
+#include "shaders/scene.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
 
 namespace mas::gfx::vulkan
 {
 class Renderer final : public gfx::Renderer
 {
 public:
-    explicit Renderer(GLFWwindow* window, flecs::world* world);
+    // Recording and the nodes' cpu work run on the executor's workers.
+    Renderer(GLFWwindow* window, const RenderSettings& settings, tf::Executor& executor);
     ~Renderer() override;
     DISABLE_COPY_AND_MOVE(Renderer)
 
     void add_models(const std::vector<std::tuple<Model, gfx::MeshData, gfx::MaterialData>>& model_data) override;
 
-    void render(flecs::world* w) override;
+    [[nodiscard]] RenderSnapshot& begin_extract() override;
+
+    void end_extract(flecs::world* world) override;
 
     void startup_done() override;
 
+    [[nodiscard]] f64 gpu_frame_ms() const override;
+
+    bool capture_frame(const std::string& path) override;
+
 private:
+    // A snapshot together with the main thread state the render thread needs to draw it.
+    struct ExtractedFrame
+    {
+        RenderSnapshot snapshot{};
+        VkExtent2D framebuffer_extent{};
+    };
+
+    void render(const ExtractedFrame& frame);
+
+    void render_loop();
+
+    // Block until the render thread has finished the frame it was handed, rethrowing anything it threw.
+    void wait_render_idle();
+
+    void draw_ui(flecs::world* world);
+
     void create_render_sync_objects();
 
+    // Present waits on these, so there is one per swapchain image rather than per frame slot.
+    void create_present_semaphores();
+
+    // Recreate the swapchain and everything sized by it. Frames in flight are drained before node resources are rebuilt.
+    void recreate_swapchain(VkExtent2D framebuffer);
+
+    // Transients, node resources and barriers for the current swapchain size and graph plan. Waits for every frame in
+    // flight first.
+    void rebuild_graph_resources();
+
     std::shared_ptr<Context> context;
-    flecs::world* world{ nullptr };
     ResourceManager resource_manager;
     RenderGraph render_graph;
     UiOverlay ui_overlay;
     Command draw_command;
+    // Scene buffer updates of every extracted snapshot, pending until a rendered frame uploads them.
+    std::shared_ptr<SceneState> scene{ std::make_shared<SceneState>() };
     u32 current_frame{ 0 };
+    // Slot of the most recently submitted frame.
+    u32 last_frame{ 0 };
+    bool nodes_ready{ false };
+    bool low_latency{ false };
+    // Set when the swapchain no longer matches the surface, it is recreated before the next acquire.
+    bool swapchain_dirty{ false };
+    std::atomic<f64> last_gpu_ms{ 0.0 };
+
+    // The main thread extracts into one frame while the render thread draws the other.
+    std::array<ExtractedFrame, 2> extracted_frames{};
+    u32 extract_index{ 0 };
+
+    bool threaded{ true };
+    std::thread render_thread{};
+    std::mutex render_mutex{};
+    std::condition_variable render_cv{};
+    std::optional<u32> pending_frame{};
+    bool stopping{ false };
+    std::exception_ptr render_error{};
 
     // Sync objects
-    std::vector<VkSemaphore> image_available_semaphores{ back_buffer_count };
-    std::vector<VkSemaphore> render_finished_semaphores{ back_buffer_count };
-    std::vector<VkFence> in_flight_fences{ back_buffer_count };
+    std::vector<VkSemaphore> image_available_semaphores{};
+    std::vector<VkSemaphore> render_finished_semaphores{};
+    // Point on the graphics timeline that completes the last frame recorded in each slot.
+    std::vector<TimelinePoint> frame_points{};
 };
 }
@@ -0,0 +1,189 @@
+#include "vk_timeline.h"
+
+#include "spdlog/spdlog.h"
+
+#include <limits>
+#include <stdexcept>
+
+namespace mas::gfx::vulkan
+{
+namespace
+{
+VkSemaphore create_timeline_semaphore(const VkDevice device)
+{
+    VkSemaphoreTypeCreateInfo type_ci{};
+    type_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_ci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_ci.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_ci{};
+    semaphore_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_ci.pNext = &type_ci;
+
+    VkSemaphore semaphore{ nullptr };
+    if (vkCreateSemaphore(device, &semaphore_ci, nullptr, &semaphore) != VK_SUCCESS)
+    {
+        spdlog::error("Failed to create timeline semaphore");
+        throw std::runtime_error("Failed to create timeline semaphore");
+    }
+
+    return semaphore;
+}
+}
+
+GpuTimeline::GpuTimeline(const VkDevice d, const VkQueue graphics_queue, const VkQueue compute_queue)
+    : device(d),
+    separate_compute(compute_queue != nullptr)
+{
+    graphics.queue = graphics_queue;
+    graphics.semaphore = create_timeline_semaphore(device);
+
+    if (separate_compute)
+    {
+        compute.queue = compute_queue;
+        compute.semaphore = create_timeline_semaphore(device);
+    }
+}
+
+GpuTimeline::~GpuTimeline()
+{
+    for (const auto queue : { QueueType::Graphics, QueueType::Compute })
+        wait(last_submitted(queue));
+    collect_retired();
+
+    vkDestroySemaphore(device, graphics.semaphore, nullptr);
+    if (compute.semaphore)
+        vkDestroySemaphore(device, compute.semaphore, nullptr);
+}
+
+GpuTimeline::Queue& GpuTimeline::get_queue(const QueueType queue)
+{
+    return queue == QueueType::Compute && separate_compute ? compute : graphics;
+}
+
+const GpuTimeline::Queue& GpuTimeline::get_queue(const QueueType queue) const
+{
+    return queue == QueueType::Compute && separate_compute ? compute : graphics;
+}
+
+TimelinePoint GpuTimeline::submit(const QueueType queue, const std::span<const VkCommandBufferSubmitInfo> command_buffers,
+                                  const std::span<const VkSemaphoreSubmitInfo> waits, const std::span<const VkSemaphoreSubmitInfo> signals)
+{
+    auto& target = get_queue(queue);
+
+    // Values have to be signaled in increasing order, so reserving one and submitting happen under the same lock.
+    std::lock_guard lock(target.mutex);
+    const u64 value = target.value + 1;
+
+    std::vector<VkSemaphoreSubmitInfo> signal_infos(signals.begin(), signals.end());
+    VkSemaphoreSubmitInfo timeline_signal{};
+    timeline_signal.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    timeline_signal.semaphore = target.semaphore;
+    timeline_signal.value = value;
+    timeline_signal.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    signal_infos.push_back(timeline_signal);
+
+    VkSubmitInfo2 submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submit_info.waitSemaphoreInfoCount = static_cast<u32>(waits.size());
+    submit_info.pWaitSemaphoreInfos = waits.data();
+    submit_info.commandBufferInfoCount = static_cast<u32>(command_buffers.size());
+    submit_info.pCommandBufferInfos = command_buffers.data();
+    submit_info.signalSemaphoreInfoCount = static_cast<u32>(signal_infos.size());
+    submit_info.pSignalSemaphoreInfos = signal_infos.data();
+
+    if (vkQueueSubmit2(target.queue, 1, &submit_info, nullptr) != VK_SUCCESS)
+    {
+        spdlog::error("Failed to submit to queue");
+        throw std::runtime_error("Failed to submit to queue");
+    }
+
+    target.value = value;
+    return { queue, value };
+}
+
+VkSemaphoreSubmitInfo GpuTimeline::wait_info(const TimelinePoint point, const VkPipelineStageFlags2 stages) const
+{
+    VkSemaphoreSubmitInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    info.semaphore = get_queue(point.queue).semaphore;
+    info.value = point.value;
+    info.stageMask = stages;
+
+    return info;
+}
+
+TimelinePoint GpuTimeline::last_submitted(const QueueType queue) const
+{
+    const auto& target = get_queue(queue);
+
+    std::lock_guard lock(target.mutex);
+    return { queue, target.value };
+}
+
+u64 GpuTimeline::completed_value(const QueueType queue) const
+{
+    u64 value{ 0 };
+    vkGetSemaphoreCounterValue(device, get_queue(queue).semaphore, &value);
+
+    return value;
+}
+
+bool GpuTimeline::is_complete(const TimelinePoint point) const
+{
+    return point.value == 0 || completed_value(point.queue) >= point.value;
+}
+
+void GpuTimeline::wait(const TimelinePoint point) const
+{
+    if (point.value == 0)
+        return;
+
+    const auto semaphore = get_queue(point.queue).semaphore;
+
+    VkSemaphoreWaitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &semaphore;
+    wait_info.pValues = &point.value;
+
+    vkWaitSemaphores(device, &wait_info, std::numeric_limits<u64>::max());
+}
+
+void GpuTimeline::retire(std::move_only_function<void()> destroy)
+{
+    Retired entry{};
+    entry.values = { last_submitted(QueueType::Graphics).value, last_submitted(QueueType::Compute).value };
+    entry.destroy = std::move(destroy);
+
+    std::lock_guard lock(retired_mutex);
+    retired.push_back(std::move(entry));
+}
+
+void GpuTimeline::collect_retired()
+{
+    const u64 graphics_done = completed_value(QueueType::Graphics);
+    const u64 compute_done = completed_value(QueueType::Compute);
+
+    std::vector<Retired> finished{};
+    {
+        std::lock_guard lock(retired_mutex);
+        for (usize i{ 0 }; i < retired.size();)
+        {
+            if (retired[i].values[0] > graphics_done || retired[i].values[1] > compute_done)
+            {
+                ++i;
+                continue;
+            }
+
+            finished.push_back(std::move(retired[i]));
+            retired[i] = std::move(retired.back());
+            retired.pop_back();
+        }
+    }
+
+    // Outside the lock, a callback may retire something else.
+    for (auto& entry : finished)
+        entry.destroy();
+}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "common.h"
+
+#include "volk/volk.h"
+
+#include <array>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace mas::gfx::vulkan
+{
+enum class QueueType
+{
+    Graphics,
+    Compute,
+};
+
+// A point on the timeline of one queue, reached once every submission up to and including it has finished.
+struct TimelinePoint
+{
+    QueueType queue{ QueueType::Graphics };
+    u64 value{ 0 };
+};
+
+// Every submission of the engine goes through here and signals the next value of its queue's timeline semaphore.
+// Cpu code waits on or polls those values instead of fences or idling whole queues.
+class GpuTimeline
+{
+public:
+    GpuTimeline() = delete;
+    ~GpuTimeline();
+    DISABLE_COPY_AND_MOVE(GpuTimeline)
+    // The compute queue may be null, compute submissions then go to the graphics queue.
+    GpuTimeline(VkDevice d, VkQueue graphics_queue, VkQueue compute_queue);
+
+    // Submit one batch and return the point it signals. Binary semaphores, like the ones used for presentation,
+    // can be passed along in waits and signals. Safe to call from any thread.
+    TimelinePoint submit(QueueType queue, std::span<const VkCommandBufferSubmitInfo> command_buffers,
+                         std::span<const VkSemaphoreSubmitInfo> waits = {}, std::span<const VkSemaphoreSubmitInfo> signals = {});
+
+    [[nodiscard]] VkSemaphoreSubmitInfo wait_info(TimelinePoint point, VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) const;
+
+    // Last point submitted on the queue, not necessarily reached yet.
+    [[nodiscard]] TimelinePoint last_submitted(QueueType queue) const;
+
+    [[nodiscard]] u64 completed_value(QueueType queue) const;
+
+    [[nodiscard]] bool is_complete(TimelinePoint point) const;
+
+    void wait(TimelinePoint point) const;
+
+    // Run the callback once everything submitted so far, on every queue, has finished. Used to destroy resources
+    // the gpu may still be reading.
+    void retire(std::move_only_function<void()> destroy);
+
+    // Run the callbacks whose work has finished, without blocking.
+    void collect_retired();
+
+private:
+    struct Queue
+    {
+        VkQueue queue{ nullptr };
+        VkSemaphore semaphore{ nullptr };
+        u64 value{ 0 };
+        mutable std::mutex mutex{};
+    };
+
+    struct Retired
+    {
+        std::array<u64, 2> values{};
+        std::move_only_function<void()> destroy{};
+    };
+
+    [[nodiscard]] Queue& get_queue(QueueType queue);
+    [[nodiscard]] const Queue& get_queue(QueueType queue) const;
+
+    VkDevice device{ nullptr };
+    bool separate_compute{ false };
+    Queue graphics{};
+    Queue compute{};
+
+    std::mutex retired_mutex{};
+    std::vector<Retired> retired{};
+};
+}
@@ -48,7 +48,11 @@ UiOverlay::UiOverlay(std::shared_ptr<Context> c)
 	}
 
 	ImGui::CreateContext();
-	ImGui_ImplGlfw_InitForVulkan(context->window, true);
+	// Without a window there is no platform backend, display size and time step are set every frame instead.
+	if (context->is_headless())
+		ImGui::GetIO().IniFilename = nullptr;
+	else
+		ImGui_ImplGlfw_InitForVulkan(context->window, true);
 	ImGui_ImplVulkan_LoadFunctions([](const char* function_name, void* vulkan_instance)
 								   {
 									   return vkGetInstanceProcAddr(*(static_cast<VkInstance*>(vulkan_instance)), function_name);
@@ -60,8 +64,9 @@ UiOverlay::UiOverlay(std::shared_ptr<Context> c)
 	init_info.Device = context->device;
 	init_info.Queue = context->graphics_queue;
 	init_info.DescriptorPool = imgui_pool;
-	init_info.MinImageCount = back_buffer_count;
-	init_info.ImageCount = back_buffer_count;
+	init_info.MinImageCount = 2;
+	// The backend rotates its vertex buffers per call, there must be at least one set per frame in flight.
+	init_info.ImageCount = std::max(2u, context->frames_in_flight);
 	init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
 	init_info.UseDynamicRendering = true;
 	init_info.ColorAttachmentFormat = context->surface_format.format;
@@ -72,10 +77,19 @@ UiOverlay::UiOverlay(std::shared_ptr<Context> c)
 	ImGui::StyleColorsDark();
 }
 
-void UiOverlay::new_frame()
+void UiOverlay::new_frame() const
 {
 	ImGui_ImplVulkan_NewFrame();
-	ImGui_ImplGlfw_NewFrame();
+	if (context->is_headless())
+	{
+		auto& io = ImGui::GetIO();
+		io.DisplaySize = ImVec2(static_cast<f32>(context->surface_extent.width), static_cast<f32>(context->surface_extent.height));
+		io.DeltaTime = 1.0f / 60.0f;
+	}
+	else
+	{
+		ImGui_ImplGlfw_NewFrame();
+	}
 	ImGui::NewFrame();
 }
 
@@ -11,7 +11,7 @@ public:
     DISABLE_COPY_AND_MOVE(UiOverlay)
     explicit UiOverlay(std::shared_ptr<Context> c);
 
-    static void new_frame();
+    void new_frame() const;
     static void end_frame();
     void draw_cmd(VkCommandBuffer cmd, VkImageView target_view) const;
 private:
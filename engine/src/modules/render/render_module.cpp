@@ -1,26 +1,120 @@
 #include "render_module.h"
 #include "modules/window/window_module.h"
+#include "modules/transform/transform_module.h"
 
 #include <stdexcept>
 
 
 namespace mas
 {
+namespace
+{
+// Free list of scene buffer slots, released slots are handed out again before the buffer grows.
+struct SceneSlots
+{
+    std::vector<u32> free{};
+    u32 next{ 0 };
+};
+
+gfx::SceneTransform scene_transform(const GlobalTransform& transform)
+{
+    const glm::mat4 rows = glm::transpose(transform.matrix());
+    return { { rows[0], rows[1], rows[2] } };
+}
+}
+
 RenderModule::RenderModule(flecs::world& world)
 {
     if (const auto result = world.module<RenderModule>(); !result)
         throw std::runtime_error("Failed to add render module!");
 
     world.import<WindowModule>();
+    world.import<TransformModule>();
+
+    world.set<SceneSlots>({});
+
+    // Entities get their slot component together with their Model, the observer below only fills it in.
+    world.component<Model>().add(flecs::With, world.component<SceneSlot>());
+
+    world.observer("Scene slot allocation")
+        .with<Model>()
+        .with<GlobalTransform>()
+        .event(flecs::OnAdd)
+        .each([](flecs::entity e)
+              {
+                  auto* slots = e.world().get_mut<SceneSlots>();
+                  u32 index{ slots->next };
+                  if (slots->free.empty())
+                      ++slots->next;
+                  else
+                  {
+                      index = slots->free.back();
+                      slots->free.pop_back();
+                  }
 
-    // TODO: System OnLoad that starts a new frame for UI rendering this frame
+                  e.set<SceneSlot>({ index });
+              });
+
+    world.observer("Scene slot release")
+        .with<Model>()
+        .with<GlobalTransform>()
+        .event(flecs::OnRemove)
+        .each([](flecs::entity e)
+              {
+                  const auto* slot = e.get<SceneSlot>();
+                  if (!slot)
+                      return;
+
+                  e.world().get_mut<SceneSlots>()->free.push_back(slot->index);
+                  e.remove<SceneSlot>();
+              });
+
+    // Extraction is the last thing a tick does, after which the renderer only reads the snapshot.
+    const auto objects = world.query<const GlobalTransform, const Model, const SceneSlot>();
 
-    world.system<Renderer>("Render system")
+    world.system<Renderer>("Render extraction system")
         .term_at(1).singleton()
         .kind(flecs::OnStore)
-        .each([&world](const Renderer& r)
+        .each([&world, objects](flecs::iter& it, usize, const Renderer& r)
               {
-                  r->render(&world);
+                  auto& snapshot = r->begin_extract();
+                  snapshot.objects.clear();
+                  snapshot.scene_updates.clear();
+
+                  const auto* visible = world.get<VisibilityList>();
+                  const bool culled = visible && visible->valid;
+                  objects.iter([&snapshot, culled](flecs::iter& object_it, const GlobalTransform* transforms, const Model* models, const SceneSlot* slots)
+                  {
+                      // Change detection is per table, tables of static entities are never sent to the gpu again.
+                      const bool changed = object_it.changed();
+                      if (culled && !changed)
+                      {
+                          object_it.skip();
+                          return;
+                      }
+
+                      for (const auto i : object_it)
+                      {
+                          if (!culled)
+                              snapshot.objects.push_back({ transforms[i].matrix(), models[i], slots[i].index });
+                          if (changed)
+                              snapshot.scene_updates.push_back({ slots[i].index, scene_transform(transforms[i]) });
+                      }
+                  });
+
+                  // Culled objects are still in the scene buffer, only their draws are left out.
+                  if (culled)
+                  {
+                      for (const auto& stage : visible->stages)
+                          snapshot.objects.insert(snapshot.objects.end(), stage.begin(), stage.end());
+                  }
+
+                  const auto camera = world.get<gfx::Camera>();
+                  snapshot.camera = camera ? std::optional(*camera) : std::nullopt;
+                  snapshot.tick = static_cast<u64>(world.get_info()->frame_count_total);
+                  snapshot.delta_time = it.delta_time();
+
+                  r->end_extract(&world);
               });
 }
 }
@@ -5,6 +5,8 @@
 #include "glm/glm.hpp"
 
 #include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
 namespace mas
@@ -19,6 +21,13 @@ struct Model
     MaterialId material_id;
 };
 
+// Slot of a renderable entity in the gpu scene buffer. Added with every Model, assigned by the render module once the
+// entity also has a GlobalTransform, and released when it loses either.
+struct SceneSlot
+{
+    u32 index{ 0 };
+};
+
 namespace gfx
 {
 struct Camera
@@ -75,6 +84,65 @@ struct MaterialData
     TextureData emissive{};
 };
 
+struct RenderObject
+{
+    glm::mat4 transform{ 1.0f };
+    Model model{};
+    u32 slot{ 0 };
+};
+
+// Rows of an affine world matrix whose fourth row is always (0, 0, 0, 1), the layout of the gpu scene buffer.
+struct SceneTransform
+{
+    glm::vec4 rows[3]{};
+};
+
+struct SceneUpdate
+{
+    u32 slot{ 0 };
+    SceneTransform transform{};
+};
+
+// Render relevant ecs state, copied out of the world at the end of every tick. The renderer reads only this while
+// recording, so the world can move on to the next tick in the meantime.
+struct RenderSnapshot
+{
+    std::vector<RenderObject> objects{};
+    // Transforms that changed since the previous snapshot, every other slot of the scene buffer is still current.
+    std::vector<SceneUpdate> scene_updates{};
+    std::optional<Camera> camera{};
+    u64 tick{ 0 };
+    f32 delta_time{ 0.0f };
+};
+
+// Render without a window or display into offscreen images, for benchmark and regression runs on build machines.
+// Works with software implementations such as lavapipe.
+struct HeadlessSettings
+{
+    u32 width{ 1920 };
+    u32 height{ 1080 };
+    // Frames rendered before the app exits, each simulated with a fixed time step.
+    u32 frame_count{ 600 };
+    // Frames left out of the summary, the first ones include asset uploads and pipeline creation.
+    u32 warmup_frames{ 10 };
+    // Cpu and gpu time of every frame as csv, skipped when empty.
+    std::string stats_path{ "frame_times.csv" };
+    // Png of the final frame, skipped when empty.
+    std::string capture_path{};
+};
+
+struct RenderSettings
+{
+    // Frames the cpu may run ahead of the gpu, 1 to 3. More hides cpu spikes at the cost of latency.
+    u32 frames_in_flight{ 2 };
+    // Wait for the gpu after every frame, so input is sampled as late as possible. Can be toggled at runtime.
+    bool low_latency{ false };
+    // Record and submit frames on a dedicated thread, overlapped with the next simulation tick.
+    bool render_thread{ true };
+    // Set to run headless, the app then ignores the window settings.
+    std::optional<HeadlessSettings> headless{};
+};
+
 class Renderer
 {
 public:
@@ -82,16 +150,35 @@ public:
     virtual ~Renderer() = default;
     DISABLE_COPY_AND_MOVE(Renderer)
 
-    virtual void render(flecs::world* world) = 0;
+    // Snapshot the next frame is extracted into. Only valid on the main thread until end_extract.
+    [[nodiscard]] virtual RenderSnapshot& begin_extract() = 0;
+
+    // Hand the extracted snapshot over for rendering. The world may be modified again as soon as this returns.
+    virtual void end_extract(flecs::world* world) = 0;
 
     virtual void add_models(const std::vector<std::tuple<Model, gfx::MeshData, gfx::MaterialData>>& model_data) = 0;
 
     virtual void startup_done() {}
+
+    // Gpu time of the most recent frame whose timings are available, zero if the backend can not measure it.
+    [[nodiscard]] virtual f64 gpu_frame_ms() const { return 0.0; }
+
+    // Wait for the last rendered frame and write it to a png. Returns false if it could not be captured.
+    virtual bool capture_frame(const std::string& path) { return false; }
 };
 }
 
 using Renderer = std::shared_ptr<gfx::Renderer>;
 
+// Objects the camera can see, filled by a culling system before extraction. There is one list per stage, so a multi
+// threaded system can append without locking. Extraction submits these instead of every renderable entity while
+// valid is set.
+struct VisibilityList
+{
+    std::vector<std::vector<gfx::RenderObject>> stages{};
+    bool valid{ false };
+};
+
 struct RenderModule
 {
     // ReSharper disable once CppNonExplicitConvertingConstructor
@@ -0,0 +1,385 @@
+#include "scene_file.h"
+#include "modules/asset/asset_loader.h"
+#include "modules/transform/transform_module.h"
+#include "modules/render/render_module.h"
+#include "modules/spatial/spatial_module.h"
+
+#include "spdlog/spdlog.h"
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+namespace mas
+{
+namespace
+{
+static_assert(std::endian::native == std::endian::little, "Scene files are little endian");
+
+constexpr u32 scene_magic{ 0x4e43534d }; // "MSCN"
+constexpr u64 section_alignment{ 16 };
+
+enum class AssetFlags : u32
+{
+    None = 0,
+    Binary = 1 << 0,
+};
+
+IMPLEMENT_TYPED_BITFLAG_OPERATORS(AssetFlags)
+
+enum class TableFlags : u32
+{
+    None = 0,
+    GlobalTransform = 1 << 0,
+    Model = 1 << 1,
+    Occluder = 1 << 2,
+};
+
+IMPLEMENT_TYPED_BITFLAG_OPERATORS(TableFlags)
+
+struct SceneHeader
+{
+    u32 magic{ scene_magic };
+    u32 version{ scene_file_version };
+    u32 transform_size{ sizeof(Transform) };
+    u32 global_transform_size{ sizeof(GlobalTransform) };
+    u32 asset_count{ 0 };
+    u32 table_count{ 0 };
+    u64 asset_offset{ 0 };
+    u64 table_offset{ 0 };
+    u64 file_size{ 0 };
+};
+
+struct SceneAsset
+{
+    u64 hash{ 0 };
+    u64 path_offset{ 0 };
+    u32 path_length{ 0 };
+    AssetFlags flags{ AssetFlags::None };
+};
+
+struct SceneTable
+{
+    u32 row_count{ 0 };
+    TableFlags flags{ TableFlags::None };
+    u64 transform_offset{ 0 };
+    u64 global_transform_offset{ 0 };
+    u64 model_offset{ 0 };
+};
+
+static_assert(std::is_trivially_copyable_v<Transform> && std::is_trivially_copyable_v<GlobalTransform>);
+static_assert(sizeof(SceneHeader) == 48 && sizeof(SceneAsset) == 24 && sizeof(SceneTable) == 32);
+
+// Fnv-1a, std::hash differs between standard libraries.
+u64 hash_path(const std::string& path)
+{
+    u64 hash{ 0xcbf29ce484222325 };
+    for (const char c : path)
+    {
+        hash ^= static_cast<u8>(c);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+u64 align_section(const u64 offset)
+{
+    return (offset + section_alignment - 1) & ~(section_alignment - 1);
+}
+
+// Columns of one flecs table, pointing into the world while saving.
+struct TableColumns
+{
+    usize count{ 0 };
+    const Transform* transforms{ nullptr };
+    const GlobalTransform* global_transforms{ nullptr };
+    const Model* models{ nullptr };
+    bool occluder{ false };
+};
+
+[[noreturn]] void invalid_file(const std::string& path, const std::string_view reason)
+{
+    spdlog::error("Invalid scene file {}: {}", path, reason);
+    throw std::runtime_error("Failed to load scene!");
+}
+}
+
+void save_scene(const flecs::world& world, const std::string& path)
+{
+    // Only owned columns, an inherited one is a single value for the whole table.
+    const auto query = world.query_builder<const Transform, const GlobalTransform*, const Model*>()
+        .term_at(1).self()
+        .term_at(2).self()
+        .term_at(3).self()
+        .with<Occluder>().optional()
+        .without(flecs::ChildOf, flecs::Wildcard)
+        .build();
+
+    std::vector<TableColumns> tables{};
+    query.iter([&tables](flecs::iter& it, const Transform* transforms, const GlobalTransform* global_transforms, const Model* models)
+    {
+        tables.push_back({ static_cast<usize>(it.count()), transforms, global_transforms, models, it.is_set(4) });
+    });
+
+    // Path hashes by model index, and every referenced file once.
+    const auto* loader = world.get<AssetLoader>();
+    std::vector<u64> model_hashes{};
+    std::vector<std::pair<u64, const AssetSource*>> assets{};
+    std::unordered_map<u64, const AssetSource*> assets_by_hash{};
+    const auto model_hash = [&](const Model& model)
+    {
+        const auto index = id::index(model.mesh_id);
+        if (index < model_hashes.size() && model_hashes[index] != 0)
+            return model_hashes[index];
+
+        const AssetSource* source = loader ? loader->get_source(model) : nullptr;
+        if (!source)
+        {
+            spdlog::error("Can not save model {} to {}, it was not loaded from a file", index, path);
+            throw std::runtime_error("Failed to save scene!");
+        }
+
+        const u64 hash = hash_path(source->path);
+        if (const auto [it, inserted] = assets_by_hash.try_emplace(hash, source); inserted)
+            assets.emplace_back(hash, source);
+        else if (it->second->path != source->path)
+        {
+            spdlog::error("Paths {} and {} have the same hash", it->second->path, source->path);
+            throw std::runtime_error("Failed to save scene!");
+        }
+
+        if (index >= model_hashes.size())
+            model_hashes.resize(index + 1, 0);
+        model_hashes[index] = hash;
+        return hash;
+    };
+
+    // Lay out the sections before writing anything.
+    SceneHeader header{};
+    header.table_count = static_cast<u32>(tables.size());
+
+    std::vector<SceneTable> table_entries(tables.size());
+    std::vector<std::vector<u64>> table_models(tables.size());
+    for (usize t{ 0 }; t < tables.size(); ++t)
+    {
+        if (tables[t].models)
+        {
+            table_models[t].resize(tables[t].count);
+            for (usize i{ 0 }; i < tables[t].count; ++i)
+                table_models[t][i] = model_hash(tables[t].models[i]);
+        }
+    }
+    header.asset_count = static_cast<u32>(assets.size());
+
+    u64 offset = align_section(sizeof(SceneHeader));
+    header.asset_offset = offset;
+    offset += sizeof(SceneAsset) * assets.size();
+
+    std::vector<SceneAsset> asset_entries(assets.size());
+    for (usize a{ 0 }; a < assets.size(); ++a)
+    {
+        const auto& [hash, source] = assets[a];
+        asset_entries[a] = { hash, offset, static_cast<u32>(source->path.size()), source->binary ? AssetFlags::Binary : AssetFlags::None };
+        offset += source->path.size();
+    }
+
+    offset = align_section(offset);
+    header.table_offset = offset;
+    offset += sizeof(SceneTable) * tables.size();
+
+    for (usize t{ 0 }; t < tables.size(); ++t)
+    {
+        const auto& columns = tables[t];
+        auto& entry = table_entries[t];
+        entry.row_count = static_cast<u32>(columns.count);
+
+        entry.transform_offset = offset = align_section(offset);
+        offset += sizeof(Transform) * columns.count;
+
+        if (columns.global_transforms)
+        {
+            entry.flags |= TableFlags::GlobalTransform;
+            entry.global_transform_offset = offset = align_section(offset);
+            offset += sizeof(GlobalTransform) * columns.count;
+        }
+
+        if (columns.models)
+        {
+            entry.flags |= TableFlags::Model;
+            entry.model_offset = offset = align_section(offset);
+            offset += sizeof(u64) * columns.count;
+        }
+
+        if (columns.occluder)
+            entry.flags |= TableFlags::Occluder;
+    }
+    header.file_size = offset;
+
+    // Everything goes to the file in one write.
+    std::vector<std::byte> file(header.file_size);
+    const auto write = [&file](const u64 at, const void* data, const usize size)
+    {
+        if (size > 0)
+            std::memcpy(file.data() + at, data, size);
+    };
+
+    write(0, &header, sizeof(header));
+    write(header.asset_offset, asset_entries.data(), sizeof(SceneAsset) * asset_entries.size());
+    for (usize a{ 0 }; a < assets.size(); ++a)
+        write(asset_entries[a].path_offset, assets[a].second->path.data(), asset_entries[a].path_length);
+    write(header.table_offset, table_entries.data(), sizeof(SceneTable) * table_entries.size());
+    for (usize t{ 0 }; t < tables.size(); ++t)
+    {
+        const auto& entry = table_entries[t];
+        write(entry.transform_offset, tables[t].transforms, sizeof(Transform) * entry.row_count);
+        if (tables[t].global_transforms)
+            write(entry.global_transform_offset, tables[t].global_transforms, sizeof(GlobalTransform) * entry.row_count);
+        if (tables[t].models)
+            write(entry.model_offset, table_models[t].data(), sizeof(u64) * entry.row_count);
+    }
+
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+    if (!stream)
+    {
+        spdlog::error("Failed to write scene file {}", path);
+        throw std::runtime_error("Failed to save scene!");
+    }
+
+    spdlog::info("Saved {} tables and {} assets to {}", tables.size(), assets.size(), path);
+}
+
+std::vector<flecs::entity_t> load_scene(const flecs::world& world, const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream)
+    {
+        spdlog::error("Failed to open scene file {}", path);
+        throw std::runtime_error("Failed to load scene!");
+    }
+
+    std::vector<std::byte> file(static_cast<usize>(stream.tellg()));
+    stream.seekg(0);
+    stream.read(reinterpret_cast<char*>(file.data()), static_cast<std::streamsize>(file.size()));
+    if (!stream)
+        invalid_file(path, "could not be read");
+
+    const auto in_file = [&file](const u64 offset, const u64 size)
+    {
+        return offset <= file.size() && size <= file.size() - offset;
+    };
+
+    SceneHeader header{};
+    if (!in_file(0, sizeof(header)))
+        invalid_file(path, "too small");
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (header.magic != scene_magic)
+        invalid_file(path, "not a scene file");
+    if (header.version != scene_file_version)
+        invalid_file(path, fmt::format("version {}, expected {}", header.version, scene_file_version));
+    if (header.transform_size != sizeof(Transform))
+        invalid_file(path, "saved with a different Transform");
+    if (header.file_size != file.size()
+        || !in_file(header.asset_offset, sizeof(SceneAsset) * u64{ header.asset_count })
+        || !in_file(header.table_offset, sizeof(SceneTable) * u64{ header.table_count }))
+        invalid_file(path, "truncated");
+
+    // Global transforms are recomputed by the transform system anyway, a build with another layout drops them.
+    const bool keep_global_transforms = header.global_transform_size == sizeof(GlobalTransform);
+    if (!keep_global_transforms)
+        spdlog::warn("Scene file {} was saved with a different GlobalTransform, it will be recomputed", path);
+
+    // Resolve the model files.
+    std::unordered_map<u64, Model> models{};
+    if (header.asset_count > 0)
+    {
+        auto* loader = world.get_mut<AssetLoader>();
+        if (!loader)
+        {
+            spdlog::error("Can not load the models of scene {} without an AssetLoader", path);
+            throw std::runtime_error("Failed to load scene!");
+        }
+
+        for (u32 a{ 0 }; a < header.asset_count; ++a)
+        {
+            SceneAsset asset{};
+            std::memcpy(&asset, file.data() + header.asset_offset + sizeof(SceneAsset) * a, sizeof(asset));
+            if (!in_file(asset.path_offset, asset.path_length))
+                invalid_file(path, "asset path out of bounds");
+
+            const std::string asset_path(reinterpret_cast<const char*>(file.data() + asset.path_offset), asset.path_length);
+            const bool binary = (asset.flags & AssetFlags::Binary) == AssetFlags::Binary;
+            models[asset.hash] = binary ? loader->load_glb(asset_path) : loader->load_gltf(asset_path);
+        }
+    }
+
+    std::vector<flecs::entity_t> entities{};
+    std::vector<Model> table_models{};
+    for (u32 t{ 0 }; t < header.table_count; ++t)
+    {
+        SceneTable table{};
+        std::memcpy(&table, file.data() + header.table_offset + sizeof(SceneTable) * t, sizeof(table));
+        if (table.row_count == 0)
+            continue;
+
+        const auto has = [&table](const TableFlags flag) { return (table.flags & flag) == flag; };
+        const u64 rows = table.row_count;
+        if (!in_file(table.transform_offset, sizeof(Transform) * rows)
+            || (has(TableFlags::GlobalTransform) && !in_file(table.global_transform_offset, sizeof(GlobalTransform) * rows))
+            || (has(TableFlags::Model) && !in_file(table.model_offset, sizeof(u64) * rows)))
+            invalid_file(path, "column out of bounds");
+
+        // Columns are copied straight from the file, flecs only reads the data.
+        ecs_bulk_desc_t desc{};
+        desc.count = static_cast<i32>(table.row_count);
+        std::array<void*, FLECS_ID_DESC_MAX> data{};
+        usize count{ 0 };
+
+        desc.ids[count] = world.id<Transform>().raw_id();
+        data[count++] = file.data() + table.transform_offset;
+
+        desc.ids[count] = world.id<GlobalTransform>().raw_id();
+        data[count++] = has(TableFlags::GlobalTransform) && keep_global_transforms ? file.data() + table.global_transform_offset : nullptr;
+
+        if (has(TableFlags::Model))
+        {
+            // Rows of a table mostly share their model, so the last lookup is kept.
+            table_models.resize(table.row_count);
+            u64 last_hash{ 0 };
+            Model last_model{};
+            for (usize i{ 0 }; i < table.row_count; ++i)
+            {
+                u64 hash{};
+                std::memcpy(&hash, file.data() + table.model_offset + sizeof(u64) * i, sizeof(hash));
+                if (hash != last_hash || i == 0)
+                {
+                    const auto model = models.find(hash);
+                    if (model == models.end())
+                        invalid_file(path, "model without an asset");
+                    last_hash = hash;
+                    last_model = model->second;
+                }
+                table_models[i] = last_model;
+            }
+
+            desc.ids[count] = world.id<Model>().raw_id();
+            data[count++] = table_models.data();
+        }
+
+        if (has(TableFlags::Occluder))
+            desc.ids[count++] = world.id<Occluder>().raw_id();
+
+        desc.data = data.data();
+        const flecs::entity_t* created = ecs_bulk_init(world, &desc);
+        entities.insert(entities.end(), created, created + table.row_count);
+    }
+
+    spdlog::info("Loaded {} entities from {}", entities.size(), path);
+    return entities;
+}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "common.h"
+
+#include "flecs/flecs.h"
+
+#include <string>
+#include <vector>
+
+namespace mas
+{
+// Binary scene files hold the entities with a Transform table by table, so loading creates every table's entities with
+// one bulk call that copies whole columns. Models are stored as the hash of the file they were loaded from.
+//
+// Little endian, offsets are from the start of the file and every section starts 16 byte aligned, so the file can be
+// read in one go or mapped and used in place:
+//   header        magic, version, component sizes, counts and section offsets
+//   assets        hash, path offset and length and format of every referenced model file, then the paths
+//   tables        row count, flags and column offsets of every table
+//   columns       Transform[rows], GlobalTransform[rows] if stored, u64 model path hash[rows] if stored
+//
+// Prefabs, children and entities inheriting their Transform are not stored. Instances spawned with App::spawn own their
+// Transform and Model and are stored as plain entities.
+constexpr u32 scene_file_version{ 1 };
+
+// Write the scene of the world to path. Models must come from the world's AssetLoader.
+void save_scene(const flecs::world& world, const std::string& path);
+
+// Create the entities stored in path and load the models they use through the world's AssetLoader, which only loads
+// during the startup phase. Returns the new entities in the order they were saved.
+std::vector<flecs::entity_t> load_scene(const flecs::world& world, const std::string& path);
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "common.h"
+#include "glm/glm.hpp"
+
+#include <limits>
+
+namespace mas
+{
+// Axis aligned bounding box, empty until something has been added to it.
+struct Aabb
+{
+    glm::vec3 min{ std::numeric_limits<f32>::max() };
+    glm::vec3 max{ std::numeric_limits<f32>::lowest() };
+
+    [[nodiscard]] bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+    [[nodiscard]] glm::vec3 center() const { return (min + max) * 0.5f; }
+
+    [[nodiscard]] glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+    [[nodiscard]] f32 surface_area() const
+    {
+        const glm::vec3 size = max - min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    [[nodiscard]] bool contains(const Aabb& other) const
+    {
+        return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+    }
+
+    void extend(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void extend(const Aabb& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+};
+
+[[nodiscard]] inline Aabb merge(Aabb a, const Aabb& b)
+{
+    a.extend(b);
+    return a;
+}
+
+// Bounds of the transformed box, from the absolute values of the rotation and scale part.
+[[nodiscard]] inline Aabb transform_aabb(const Aabb& local, const glm::mat4& transform)
+{
+    const glm::vec3 center = glm::vec3(transform * glm::vec4(local.center(), 1.0f));
+    const glm::vec3 extent = local.extent();
+    const glm::vec3 world_extent = glm::abs(glm::vec3(transform[0])) * extent.x + glm::abs(glm::vec3(transform[1])) * extent.y +
+        glm::abs(glm::vec3(transform[2])) * extent.z;
+
+    return { center - world_extent, center + world_extent };
+}
+
+// Planes of a view frustum in world space, normals pointing inwards.
+struct Frustum
+{
+    glm::vec4 planes[6]{};
+};
+
+// Depth is zero to one.
+[[nodiscard]] inline Frustum make_frustum(const glm::mat4& view_proj)
+{
+    const auto row = [&view_proj](const i32 i) { return glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]); };
+
+    Frustum frustum{};
+    frustum.planes[0] = row(3) + row(0);
+    frustum.planes[1] = row(3) - row(0);
+    frustum.planes[2] = row(3) + row(1);
+    frustum.planes[3] = row(3) - row(1);
+    frustum.planes[4] = row(2);
+    frustum.planes[5] = row(3) - row(2);
+
+    for (auto& plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    return frustum;
+}
+}
@@ -0,0 +1,743 @@
+#include "bvh.h"
+#include "job_system.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+
+namespace mas
+{
+namespace
+{
+constexpr u32 sah_bins{ 16 };
+// Leaves grow by this fraction of their proxy's size in every direction.
+constexpr f32 leaf_margin{ 0.1f };
+// A rebuild starts once this many proxies changed the tree, or a fraction of all of them if that is more.
+constexpr usize min_rebuild_changes{ 64 };
+constexpr usize rebuild_fraction{ 8 };
+
+using Node = Bvh::Node;
+
+Aabb node_bounds(const Node& node)
+{
+    return { { node.min[0], node.min[1], node.min[2] }, { node.max[0], node.max[1], node.max[2] } };
+}
+
+void set_node_bounds(Node& node, const Aabb& bounds)
+{
+    node.min[0] = bounds.min.x;
+    node.min[1] = bounds.min.y;
+    node.min[2] = bounds.min.z;
+    node.max[0] = bounds.max.x;
+    node.max[1] = bounds.max.y;
+    node.max[2] = bounds.max.z;
+}
+
+Aabb fatten(const Aabb& bounds)
+{
+    const glm::vec3 margin = (bounds.max - bounds.min) * leaf_margin;
+    return { bounds.min - margin, bounds.max + margin };
+}
+
+struct BuildItem
+{
+    Aabb bounds{};
+    glm::vec3 centroid{ 0.0f };
+    ProxyId proxy{ invalid_proxy };
+};
+
+// Top down binned sah build, one item per leaf. Runs on a worker, so it only touches its own data.
+std::vector<Node> build_nodes(std::vector<BuildItem> items)
+{
+    std::vector<Node> nodes{};
+    if (items.empty())
+        return nodes;
+
+    nodes.reserve(items.size() * 2 - 1);
+
+    struct Range
+    {
+        usize begin{ 0 };
+        usize end{ 0 };
+        i32 parent{ -1 };
+    };
+
+    std::vector<Range> stack{ { 0, items.size(), -1 } };
+    while (!stack.empty())
+    {
+        const auto [begin, end, parent] = stack.back();
+        stack.pop_back();
+
+        const auto index = static_cast<i32>(nodes.size());
+        auto& node = nodes.emplace_back();
+        node.parent = parent;
+        if (parent >= 0)
+        {
+            auto& parent_node = nodes[parent];
+            (parent_node.left < 0 ? parent_node.left : parent_node.right) = index;
+        }
+
+        Aabb bounds{};
+        Aabb centroids{};
+        for (usize i{ begin }; i < end; ++i)
+        {
+            bounds.extend(items[i].bounds);
+            centroids.extend(items[i].centroid);
+        }
+        set_node_bounds(nodes[index], bounds);
+
+        if (end - begin == 1)
+        {
+            nodes[index].proxy = items[begin].proxy;
+            continue;
+        }
+
+        const glm::vec3 size = centroids.max - centroids.min;
+        const i32 axis = size.x > size.y && size.x > size.z ? 0 : size.y > size.z ? 1 : 2;
+        usize middle = begin + (end - begin) / 2;
+
+        if (size[axis] > 0.0f)
+        {
+            std::array<Aabb, sah_bins> bin_bounds{};
+            std::array<usize, sah_bins> bin_counts{};
+            const f32 scale = static_cast<f32>(sah_bins) / size[axis];
+            const auto bin_of = [&](const BuildItem& item)
+            {
+                return std::min(static_cast<u32>((item.centroid[axis] - centroids.min[axis]) * scale), sah_bins - 1);
+            };
+
+            for (usize i{ begin }; i < end; ++i)
+            {
+                const u32 bin = bin_of(items[i]);
+                bin_bounds[bin].extend(items[i].bounds);
+                ++bin_counts[bin];
+            }
+
+            // Cost of splitting after every bin, the left side swept forwards and the right side backwards.
+            std::array<f32, sah_bins - 1> costs{};
+            Aabb left{};
+            usize left_count{ 0 };
+            for (u32 i{ 0 }; i < sah_bins - 1; ++i)
+            {
+                left.extend(bin_bounds[i]);
+                left_count += bin_counts[i];
+                costs[i] = left_count > 0 ? static_cast<f32>(left_count) * left.surface_area() : 0.0f;
+            }
+
+            Aabb right{};
+            usize right_count{ 0 };
+            for (u32 i{ sah_bins - 1 }; i > 0; --i)
+            {
+                right.extend(bin_bounds[i]);
+                right_count += bin_counts[i];
+                costs[i - 1] += right_count > 0 ? static_cast<f32>(right_count) * right.surface_area() : 0.0f;
+            }
+
+            const auto best = static_cast<u32>(std::ranges::min_element(costs) - costs.begin());
+            const auto split = std::partition(items.begin() + static_cast<std::ptrdiff_t>(begin), items.begin() + static_cast<std::ptrdiff_t>(end),
+                                              [&](const BuildItem& item) { return bin_of(item) <= best; });
+            middle = static_cast<usize>(split - items.begin());
+        }
+
+        // All centroids in one bin, or on top of each other.
+        if (middle == begin || middle == end)
+        {
+            middle = begin + (end - begin) / 2;
+            std::nth_element(items.begin() + static_cast<std::ptrdiff_t>(begin), items.begin() + static_cast<std::ptrdiff_t>(middle),
+                             items.begin() + static_cast<std::ptrdiff_t>(end),
+                             [axis](const BuildItem& a, const BuildItem& b) { return a.centroid[axis] < b.centroid[axis]; });
+        }
+
+        // Popped left first, which is the order children are linked to their parent in.
+        stack.push_back({ middle, end, index });
+        stack.push_back({ begin, middle, index });
+    }
+
+    return nodes;
+}
+
+#if MAS_SSE
+// Frustum planes as structure of arrays, two batches of four, the last two lanes repeat the first plane.
+struct FrustumLanes
+{
+    __m128 x[2];
+    __m128 y[2];
+    __m128 z[2];
+    __m128 w[2];
+};
+
+FrustumLanes frustum_lanes(const Frustum& frustum)
+{
+    const auto& p = frustum.planes;
+    return {
+        { _mm_setr_ps(p[0].x, p[1].x, p[2].x, p[3].x), _mm_setr_ps(p[4].x, p[5].x, p[0].x, p[0].x) },
+        { _mm_setr_ps(p[0].y, p[1].y, p[2].y, p[3].y), _mm_setr_ps(p[4].y, p[5].y, p[0].y, p[0].y) },
+        { _mm_setr_ps(p[0].z, p[1].z, p[2].z, p[3].z), _mm_setr_ps(p[4].z, p[5].z, p[0].z, p[0].z) },
+        { _mm_setr_ps(p[0].w, p[1].w, p[2].w, p[3].w), _mm_setr_ps(p[4].w, p[5].w, p[0].w, p[0].w) },
+    };
+}
+
+enum class Containment
+{
+    Outside,
+    Intersecting,
+    Inside,
+};
+
+// All six planes at once. The corner furthest along a plane's normal decides whether the box is outside of it, the
+// nearest corner whether it is completely inside.
+Containment test_frustum(const FrustumLanes& frustum, const Node& node)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 min_x = _mm_set1_ps(node.min[0]), min_y = _mm_set1_ps(node.min[1]), min_z = _mm_set1_ps(node.min[2]);
+    const __m128 max_x = _mm_set1_ps(node.max[0]), max_y = _mm_set1_ps(node.max[1]), max_z = _mm_set1_ps(node.max[2]);
+
+    const auto select = [](const __m128 mask, const __m128 a, const __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+
+    int outside{ 0 };
+    int intersecting{ 0 };
+    for (usize i{ 0 }; i < 2; ++i)
+    {
+        const __m128 pos_x = _mm_cmpgt_ps(frustum.x[i], zero);
+        const __m128 pos_y = _mm_cmpgt_ps(frustum.y[i], zero);
+        const __m128 pos_z = _mm_cmpgt_ps(frustum.z[i], zero);
+
+        const __m128 far_distance = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(frustum.x[i], select(pos_x, max_x, min_x)), _mm_mul_ps(frustum.y[i], select(pos_y, max_y, min_y))),
+            _mm_add_ps(_mm_mul_ps(frustum.z[i], select(pos_z, max_z, min_z)), frustum.w[i]));
+        const __m128 near_distance = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(frustum.x[i], select(pos_x, min_x, max_x)), _mm_mul_ps(frustum.y[i], select(pos_y, min_y, max_y))),
+            _mm_add_ps(_mm_mul_ps(frustum.z[i], select(pos_z, min_z, max_z)), frustum.w[i]));
+
+        outside |= _mm_movemask_ps(_mm_cmplt_ps(far_distance, zero));
+        intersecting |= _mm_movemask_ps(_mm_cmplt_ps(near_distance, zero));
+    }
+
+    if (outside != 0)
+        return Containment::Outside;
+    return intersecting != 0 ? Containment::Intersecting : Containment::Inside;
+}
+
+bool test_box(const __m128 box_min, const __m128 box_max, const Node& node)
+{
+    const __m128 overlap = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.min), box_max), _mm_cmple_ps(box_min, _mm_load_ps(node.max)));
+    return (_mm_movemask_ps(overlap) & 0x7) == 0x7;
+}
+
+struct RayLanes
+{
+    __m128 origin;
+    __m128 inverse_direction;
+    // Lanes past xyz clamp the interval to the start and end of the ray.
+    __m128 lower;
+    __m128 upper;
+};
+
+RayLanes ray_lanes(const glm::vec3& origin, const glm::vec3& direction, const f32 max_distance)
+{
+    constexpr f32 inf = std::numeric_limits<f32>::infinity();
+    const glm::vec3 inverse = 1.0f / direction;
+    return {
+        _mm_setr_ps(origin.x, origin.y, origin.z, 0.0f),
+        _mm_setr_ps(inverse.x, inverse.y, inverse.z, inf),
+        _mm_setr_ps(-inf, -inf, -inf, 0.0f),
+        _mm_setr_ps(inf, inf, inf, max_distance),
+    };
+}
+
+// Slab test, returns the entry distance or a negative value on a miss. A ray parallel to and on one of a slab's
+// planes gives nan, that slab does not limit the interval then.
+f32 test_ray(const RayLanes& ray, const Node& node)
+{
+    const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min), ray.origin), ray.inverse_direction);
+    const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max), ray.origin), ray.inverse_direction);
+
+    const __m128 inf = _mm_set1_ps(std::numeric_limits<f32>::infinity());
+    const __m128 ordered = _mm_cmpord_ps(t0, t1);
+    const __m128 slab_near = _mm_or_ps(_mm_and_ps(ordered, _mm_min_ps(t0, t1)), _mm_andnot_ps(ordered, _mm_sub_ps(_mm_setzero_ps(), inf)));
+    const __m128 slab_far = _mm_or_ps(_mm_and_ps(ordered, _mm_max_ps(t0, t1)), _mm_andnot_ps(ordered, inf));
+
+    __m128 near = _mm_max_ps(slab_near, ray.lower);
+    __m128 far = _mm_min_ps(slab_far, ray.upper);
+
+    near = _mm_max_ps(near, _mm_shuffle_ps(near, near, _MM_SHUFFLE(2, 3, 0, 1)));
+    near = _mm_max_ps(near, _mm_shuffle_ps(near, near, _MM_SHUFFLE(1, 0, 3, 2)));
+    far = _mm_min_ps(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(2, 3, 0, 1)));
+    far = _mm_min_ps(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    const f32 entry = _mm_cvtss_f32(near);
+    return entry <= _mm_cvtss_f32(far) ? entry : -1.0f;
+}
+#else
+enum class Containment
+{
+    Outside,
+    Intersecting,
+    Inside,
+};
+
+using FrustumLanes = Frustum;
+
+FrustumLanes frustum_lanes(const Frustum& frustum)
+{
+    return frustum;
+}
+
+Containment test_frustum(const FrustumLanes& frustum, const Node& node)
+{
+    bool intersecting{ false };
+    for (const auto& plane : frustum.planes)
+    {
+        const glm::vec3 far{ plane.x > 0.0f ? node.max[0] : node.min[0], plane.y > 0.0f ? node.max[1] : node.min[1], plane.z > 0.0f ? node.max[2] : node.min[2] };
+        const glm::vec3 near{ plane.x > 0.0f ? node.min[0] : node.max[0], plane.y > 0.0f ? node.min[1] : node.max[1], plane.z > 0.0f ? node.min[2] : node.max[2] };
+        if (glm::dot(glm::vec3(plane), far) + plane.w < 0.0f)
+            return Containment::Outside;
+        intersecting |= glm::dot(glm::vec3(plane), near) + plane.w < 0.0f;
+    }
+
+    return intersecting ? Containment::Intersecting : Containment::Inside;
+}
+
+bool test_box(const Aabb& box, const Node& node)
+{
+    return box.min.x <= node.max[0] && box.min.y <= node.max[1] && box.min.z <= node.max[2] &&
+        node.min[0] <= box.max.x && node.min[1] <= box.max.y && node.min[2] <= box.max.z;
+}
+
+struct RayLanes
+{
+    glm::vec3 origin;
+    glm::vec3 inverse_direction;
+    f32 max_distance;
+};
+
+RayLanes ray_lanes(const glm::vec3& origin, const glm::vec3& direction, const f32 max_distance)
+{
+    return { origin, 1.0f / direction, max_distance };
+}
+
+f32 test_ray(const RayLanes& ray, const Node& node)
+{
+    f32 near{ 0.0f };
+    f32 far{ ray.max_distance };
+    for (i32 axis{ 0 }; axis < 3; ++axis)
+    {
+        const f32 t0 = (node.min[axis] - ray.origin[axis]) * ray.inverse_direction[axis];
+        const f32 t1 = (node.max[axis] - ray.origin[axis]) * ray.inverse_direction[axis];
+        // A ray parallel to and on one of the slab's planes gives nan, the slab does not limit it then.
+        if (std::isnan(t0) || std::isnan(t1))
+            continue;
+
+        near = std::max(near, std::min(t0, t1));
+        far = std::min(far, std::max(t0, t1));
+    }
+
+    return near <= far ? near : -1.0f;
+}
+#endif
+}
+
+Bvh::~Bvh()
+{
+    if (rebuild.valid())
+        rebuild.wait();
+}
+
+Bvh::Bvh(Bvh&&) noexcept = default;
+
+Bvh& Bvh::operator=(Bvh&& other) noexcept
+{
+    if (rebuild.valid())
+        rebuild.wait();
+
+    nodes = std::move(other.nodes);
+    free_nodes = std::move(other.free_nodes);
+    root = other.root;
+    other.root = -1;
+    proxies = std::move(other.proxies);
+    free_proxies = std::move(other.free_proxies);
+    changes_since_build = other.changes_since_build;
+    changed_during_rebuild = std::move(other.changed_during_rebuild);
+    rebuild = std::move(other.rebuild);
+
+    return *this;
+}
+
+ProxyId Bvh::create_proxy(const Aabb& bounds, const u64 user_data)
+{
+    ProxyId proxy{ static_cast<ProxyId>(proxies.size()) };
+    if (free_proxies.empty())
+        proxies.emplace_back();
+    else
+    {
+        proxy = free_proxies.back();
+        free_proxies.pop_back();
+    }
+
+    auto& entry = proxies[proxy];
+    entry.bounds = bounds;
+    entry.user_data = user_data;
+    entry.alive = true;
+    entry.node = insert_leaf(proxy, fatten(bounds));
+
+    ++changes_since_build;
+    log_change(proxy);
+
+    return proxy;
+}
+
+void Bvh::destroy_proxy(const ProxyId proxy)
+{
+    auto& entry = proxies[proxy];
+    if (entry.node >= 0)
+        remove_leaf(entry.node);
+
+    entry.node = -1;
+    entry.alive = false;
+    free_proxies.push_back(proxy);
+
+    ++changes_since_build;
+    log_change(proxy);
+}
+
+void Bvh::move_proxy(const ProxyId proxy, const Aabb& bounds)
+{
+    auto& entry = proxies[proxy];
+    entry.bounds = bounds;
+    if (entry.node < 0 || node_bounds(nodes[entry.node]).contains(bounds))
+        return;
+
+    remove_leaf(entry.node);
+    entry.node = insert_leaf(proxy, fatten(bounds));
+
+    ++changes_since_build;
+    log_change(proxy);
+}
+
+void Bvh::maintain(JobSystem& jobs)
+{
+    if (rebuild.valid() && rebuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        apply_rebuild(rebuild.get());
+
+    if (!rebuild.valid() && changes_since_build >= std::max(min_rebuild_changes, proxy_count() / rebuild_fraction))
+        start_rebuild(jobs);
+}
+
+void Bvh::finish_rebuild()
+{
+    if (rebuild.valid())
+        apply_rebuild(rebuild.get());
+}
+
+void Bvh::start_rebuild(JobSystem& jobs)
+{
+    std::vector<BuildItem> items{};
+    items.reserve(proxy_count());
+    for (ProxyId proxy{ 0 }; proxy < proxies.size(); ++proxy)
+    {
+        const auto& entry = proxies[proxy];
+        if (!entry.alive)
+            continue;
+
+        // The current leaf bounds, so the margin carries over into the new tree.
+        const Aabb bounds = entry.node >= 0 ? node_bounds(nodes[entry.node]) : fatten(entry.bounds);
+        items.push_back({ bounds, bounds.center(), proxy });
+    }
+
+    changes_since_build = 0;
+    changed_during_rebuild.clear();
+    rebuild = jobs.background([items = std::move(items)]() mutable
+    {
+        BuildResult result{};
+        result.nodes = build_nodes(std::move(items));
+        result.root = result.nodes.empty() ? -1 : 0;
+        return result;
+    });
+}
+
+void Bvh::apply_rebuild(BuildResult result)
+{
+    nodes = std::move(result.nodes);
+    free_nodes.clear();
+    root = result.root;
+
+    for (auto& entry : proxies)
+        entry.node = -1;
+
+    for (i32 i{ 0 }; i < static_cast<i32>(nodes.size()); ++i)
+    {
+        if (nodes[i].is_leaf())
+            proxies[nodes[i].proxy].node = i;
+    }
+
+    // The tree was built from the proxies as they were when the rebuild started.
+    for (const auto proxy : changed_during_rebuild)
+    {
+        auto& entry = proxies[proxy];
+        entry.logged = false;
+
+        if (!entry.alive)
+        {
+            if (entry.node >= 0)
+                remove_leaf(entry.node);
+            entry.node = -1;
+        }
+        else if (entry.node < 0)
+            entry.node = insert_leaf(proxy, fatten(entry.bounds));
+        else if (!node_bounds(nodes[entry.node]).contains(entry.bounds))
+        {
+            remove_leaf(entry.node);
+            entry.node = insert_leaf(proxy, fatten(entry.bounds));
+        }
+    }
+    changed_during_rebuild.clear();
+}
+
+void Bvh::log_change(const ProxyId proxy)
+{
+    if (!rebuild.valid() || proxies[proxy].logged)
+        return;
+
+    proxies[proxy].logged = true;
+    changed_during_rebuild.push_back(proxy);
+}
+
+i32 Bvh::allocate_node()
+{
+    if (free_nodes.empty())
+    {
+        nodes.emplace_back();
+        return static_cast<i32>(nodes.size() - 1);
+    }
+
+    const i32 node = free_nodes.back();
+    free_nodes.pop_back();
+    nodes[node] = {};
+    return node;
+}
+
+void Bvh::free_node(const i32 node)
+{
+    nodes[node] = {};
+    free_nodes.push_back(node);
+}
+
+i32 Bvh::insert_leaf(const ProxyId proxy, const Aabb& bounds)
+{
+    const i32 leaf = allocate_node();
+    set_node_bounds(nodes[leaf], bounds);
+    nodes[leaf].proxy = proxy;
+
+    if (root < 0)
+    {
+        root = leaf;
+        return leaf;
+    }
+
+    // Descend towards the sibling that grows the tree's surface area the least.
+    i32 sibling = root;
+    while (!nodes[sibling].is_leaf())
+    {
+        const auto& node = nodes[sibling];
+        const f32 area = node_bounds(node).surface_area();
+        const f32 combined = merge(node_bounds(node), bounds).surface_area();
+
+        // Pairing with this node, or the area every ancestor gains on the way further down.
+        const f32 cost = 2.0f * combined;
+        const f32 inherited = 2.0f * (combined - area);
+
+        const auto child_cost = [&](const i32 child)
+        {
+            const Aabb child_bounds = node_bounds(nodes[child]);
+            const f32 merged = merge(child_bounds, bounds).surface_area();
+            return (nodes[child].is_leaf() ? merged : merged - child_bounds.surface_area()) + inherited;
+        };
+
+        const f32 left_cost = child_cost(node.left);
+        const f32 right_cost = child_cost(node.right);
+        if (cost < left_cost && cost < right_cost)
+            break;
+
+        sibling = left_cost < right_cost ? node.left : node.right;
+    }
+
+    const i32 old_parent = nodes[sibling].parent;
+    const i32 parent = allocate_node();
+    nodes[parent].parent = old_parent;
+    nodes[parent].left = sibling;
+    nodes[parent].right = leaf;
+    set_node_bounds(nodes[parent], merge(node_bounds(nodes[sibling]), bounds));
+    nodes[sibling].parent = parent;
+    nodes[leaf].parent = parent;
+
+    if (old_parent < 0)
+        root = parent;
+    else
+    {
+        auto& node = nodes[old_parent];
+        (node.left == sibling ? node.left : node.right) = parent;
+        refit(old_parent);
+    }
+
+    return leaf;
+}
+
+void Bvh::remove_leaf(const i32 leaf)
+{
+    if (leaf == root)
+    {
+        root = -1;
+        free_node(leaf);
+        return;
+    }
+
+    const i32 parent = nodes[leaf].parent;
+    const i32 grand_parent = nodes[parent].parent;
+    const i32 sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+    nodes[sibling].parent = grand_parent;
+    if (grand_parent < 0)
+        root = sibling;
+    else
+    {
+        auto& node = nodes[grand_parent];
+        (node.left == parent ? node.left : node.right) = sibling;
+    }
+
+    free_node(parent);
+    free_node(leaf);
+
+    if (grand_parent >= 0)
+        refit(grand_parent);
+}
+
+void Bvh::refit(i32 node)
+{
+    while (node >= 0)
+    {
+        auto& entry = nodes[node];
+        const Aabb previous = node_bounds(entry);
+        const Aabb bounds = merge(node_bounds(nodes[entry.left]), node_bounds(nodes[entry.right]));
+        if (bounds.min == previous.min && bounds.max == previous.max)
+            return;
+
+        set_node_bounds(entry, bounds);
+        node = entry.parent;
+    }
+}
+
+void Bvh::query_frustum(const Frustum& frustum, std::vector<ProxyId>& results) const
+{
+    if (root < 0)
+        return;
+
+    const auto lanes = frustum_lanes(frustum);
+
+    // Nodes completely inside are pushed with their index negated and one subtracted, their leaves are taken untested.
+    std::vector<i32> stack{ root };
+    while (!stack.empty())
+    {
+        const i32 entry = stack.back();
+        stack.pop_back();
+
+        const bool inside = entry < 0;
+        const i32 index = inside ? -entry - 1 : entry;
+        const auto& node = nodes[index];
+
+        auto containment = Containment::Inside;
+        if (!inside)
+        {
+            containment = test_frustum(lanes, node);
+            if (containment == Containment::Outside)
+                continue;
+        }
+
+        if (node.is_leaf())
+        {
+            // Leaves carry a margin, the proxy's own bounds decide unless the leaf is completely inside.
+            if (containment == Containment::Intersecting)
+            {
+                Node tight{};
+                set_node_bounds(tight, proxies[node.proxy].bounds);
+                if (test_frustum(lanes, tight) == Containment::Outside)
+                    continue;
+            }
+
+            results.push_back(node.proxy);
+            continue;
+        }
+
+        const bool children_inside = containment == Containment::Inside;
+        stack.push_back(children_inside ? -node.right - 1 : node.right);
+        stack.push_back(children_inside ? -node.left - 1 : node.left);
+    }
+}
+
+void Bvh::query_box(const Aabb& box, std::vector<ProxyId>& results) const
+{
+    if (root < 0)
+        return;
+
+#if MAS_SSE
+    const __m128 box_min = _mm_setr_ps(box.min.x, box.min.y, box.min.z, 0.0f);
+    const __m128 box_max = _mm_setr_ps(box.max.x, box.max.y, box.max.z, 0.0f);
+    const auto overlaps = [&](const Node& node) { return test_box(box_min, box_max, node); };
+#else
+    const auto overlaps = [&](const Node& node) { return test_box(box, node); };
+#endif
+
+    std::vector<i32> stack{ root };
+    while (!stack.empty())
+    {
+        const auto& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (!overlaps(node))
+            continue;
+
+        if (node.is_leaf())
+        {
+            // Leaves carry a margin, the proxy's own bounds decide.
+            const auto& bounds = proxies[node.proxy].bounds;
+            if (glm::all(glm::lessThanEqual(bounds.min, box.max)) && glm::all(glm::lessThanEqual(box.min, bounds.max)))
+                results.push_back(node.proxy);
+            continue;
+        }
+
+        stack.push_back(node.right);
+        stack.push_back(node.left);
+    }
+}
+
+void Bvh::query_ray(const glm::vec3& origin, const glm::vec3& direction, const f32 max_distance, std::vector<RayHit>& results) const
+{
+    if (root < 0)
+        return;
+
+    const auto lanes = ray_lanes(origin, direction, max_distance);
+
+    std::vector<i32> stack{ root };
+    while (!stack.empty())
+    {
+        const auto& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (test_ray(lanes, node) < 0.0f)
+            continue;
+
+        if (node.is_leaf())
+        {
+            Node tight{};
+            set_node_bounds(tight, proxies[node.proxy].bounds);
+            if (const f32 distance = test_ray(lanes, tight); distance >= 0.0f)
+                results.push_back({ node.proxy, distance });
+            continue;
+        }
+
+        stack.push_back(node.right);
+        stack.push_back(node.left);
+    }
+}
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "common.h"
+#include "bounds.h"
+
+#include <future>
+#include <vector>
+
+namespace mas
+{
+class JobSystem;
+
+using ProxyId = u32;
+constexpr ProxyId invalid_proxy{ std::numeric_limits<u32>::max() };
+
+struct RayHit
+{
+    ProxyId proxy{ invalid_proxy };
+    // Distance along the ray where it enters the proxy's bounds.
+    f32 distance{ 0.0f };
+};
+
+// Dynamic bounding volume hierarchy with one proxy per leaf. A proxy moving out of its leaf is removed and inserted
+// again next to the sibling that grows the tree the least, which keeps updates cheap but lets the tree degrade, so
+// once enough proxies changed the whole tree is rebuilt with a binned surface area heuristic as background work on the
+// job system. Queries keep using the refitted tree until the rebuild is done.
+class Bvh
+{
+public:
+    Bvh() = default;
+    ~Bvh();
+    Bvh(Bvh&&) noexcept;
+    Bvh& operator=(Bvh&&) noexcept;
+    DISABLE_COPY(Bvh)
+
+    [[nodiscard]] ProxyId create_proxy(const Aabb& bounds, u64 user_data);
+
+    void destroy_proxy(ProxyId proxy);
+
+    // Leaves are a little larger than their proxy, the tree is only touched once the bounds leave that margin.
+    void move_proxy(ProxyId proxy, const Aabb& bounds);
+
+    [[nodiscard]] u64 get_user_data(const ProxyId proxy) const { return proxies[proxy].user_data; }
+    [[nodiscard]] const Aabb& get_bounds(const ProxyId proxy) const { return proxies[proxy].bounds; }
+    [[nodiscard]] usize proxy_count() const { return proxies.size() - free_proxies.size(); }
+
+    // Applies a finished rebuild and starts the next one when enough proxies changed. Call once per frame.
+    void maintain(JobSystem& jobs);
+
+    // Blocks until a rebuild in flight has been applied.
+    void finish_rebuild();
+
+    // Proxies whose bounds intersect the query are appended to the results, in no particular order.
+    void query_frustum(const Frustum& frustum, std::vector<ProxyId>& results) const;
+    void query_box(const Aabb& box, std::vector<ProxyId>& results) const;
+    void query_ray(const glm::vec3& origin, const glm::vec3& direction, f32 max_distance, std::vector<RayHit>& results) const;
+
+    // Laid out for aligned 128 bit loads of the bounds.
+    struct alignas(16) Node
+    {
+        f32 min[4]{};
+        f32 max[4]{};
+        i32 parent{ -1 };
+        i32 left{ -1 };
+        i32 right{ -1 };
+        ProxyId proxy{ invalid_proxy };
+
+        [[nodiscard]] bool is_leaf() const { return left < 0; }
+    };
+
+private:
+    struct Proxy
+    {
+        Aabb bounds{};
+        u64 user_data{ 0 };
+        i32 node{ -1 };
+        bool alive{ false };
+        // Listed in changed_during_rebuild.
+        bool logged{ false };
+    };
+
+    struct BuildResult
+    {
+        std::vector<Node> nodes{};
+        i32 root{ -1 };
+    };
+
+    void start_rebuild(JobSystem& jobs);
+    void apply_rebuild(BuildResult result);
+
+    // Remembers proxies touched while a rebuild is in flight, they are patched into its result.
+    void log_change(ProxyId proxy);
+
+    i32 allocate_node();
+    void free_node(i32 node);
+    i32 insert_leaf(ProxyId proxy, const Aabb& bounds);
+    void remove_leaf(i32 leaf);
+    // Recomputes the bounds of node and its ancestors, stopping at the first one that did not change.
+    void refit(i32 node);
+
+    std::vector<Node> nodes{};
+    std::vector<i32> free_nodes{};
+    i32 root{ -1 };
+
+    std::vector<Proxy> proxies{};
+    std::vector<ProxyId> free_proxies{};
+
+    // Structural changes since the tree was last built.
+    usize changes_since_build{ 0 };
+    std::vector<ProxyId> changed_during_rebuild{};
+    std::future<BuildResult> rebuild{};
+};
+}
@@ -0,0 +1,16 @@
+#define MAS_KERNEL_TARGET baseline
+#include "cull_kernel.inl"
+
+namespace mas
+{
+namespace avx2
+{
+usize cull_spheres(const Frustum& frustum, const BoundingSphere* spheres, usize count, u32* visible);
+}
+
+usize cull_spheres(const Frustum& frustum, const BoundingSphere* spheres, const usize count, u32* visible)
+{
+    static const auto kernel = cpu_has_avx2() ? &avx2::cull_spheres : &baseline::cull_spheres;
+    return kernel(frustum, spheres, count, visible);
+}
+}
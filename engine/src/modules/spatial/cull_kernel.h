@@ -0,0 +1,12 @@
+#pragma once
+#include "common.h"
+#include "bounds.h"
+#include "spatial_module.h"
+
+namespace mas
+{
+// Tests count bounding spheres against the frustum in batches of eight and writes the indices of those that
+// intersect it to visible, in order. visible must hold count indices. Returns how many were written.
+// Uses AVX on cpus with AVX2, two SSE halves per batch on other SSE targets, and plain floats otherwise.
+usize cull_spheres(const Frustum& frustum, const BoundingSphere* spheres, usize count, u32* visible);
+}
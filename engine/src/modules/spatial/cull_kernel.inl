@@ -0,0 +1,184 @@
+// Body of the sphere cull kernel, built once per instruction set by cull_kernel.cpp and cull_kernel_avx2.cpp.
+// MAS_KERNEL_TARGET names the namespace of the build.
+#include "cull_kernel.h"
+#include "simd.h"
+
+#include <cstring>
+
+namespace mas::MAS_KERNEL_TARGET
+{
+static_assert(sizeof(BoundingSphere) == 16, "The kernel loads a sphere as four floats");
+
+namespace
+{
+constexpr usize batch_size{ 8 };
+
+#if MAS_SSE
+// Centre and radius of four spheres, one per lane.
+struct Spheres4
+{
+    __m128 x, y, z, r;
+};
+
+Spheres4 load_spheres(const BoundingSphere* spheres)
+{
+    Spheres4 s{
+        _mm_loadu_ps(&spheres[0].sphere.x),
+        _mm_loadu_ps(&spheres[1].sphere.x),
+        _mm_loadu_ps(&spheres[2].sphere.x),
+        _mm_loadu_ps(&spheres[3].sphere.x),
+    };
+    _MM_TRANSPOSE4_PS(s.x, s.y, s.z, s.r);
+    return s;
+}
+
+#if MAS_AVX
+using Lanes = __m256;
+
+// Every plane component broadcast to all lanes.
+struct Planes
+{
+    Lanes x[6], y[6], z[6], w[6];
+};
+
+Planes load_planes(const Frustum& frustum)
+{
+    Planes planes{};
+    for (usize i{ 0 }; i < 6; ++i)
+    {
+        planes.x[i] = _mm256_set1_ps(frustum.planes[i].x);
+        planes.y[i] = _mm256_set1_ps(frustum.planes[i].y);
+        planes.z[i] = _mm256_set1_ps(frustum.planes[i].z);
+        planes.w[i] = _mm256_set1_ps(frustum.planes[i].w);
+    }
+    return planes;
+}
+
+Lanes combine(const __m128 low, const __m128 high)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+}
+
+// Bit i is set if sphere i is not entirely behind any plane.
+u32 test_batch(const Planes& planes, const BoundingSphere* spheres)
+{
+    const Spheres4 low = load_spheres(spheres);
+    const Spheres4 high = load_spheres(spheres + 4);
+    const Lanes x = combine(low.x, high.x);
+    const Lanes y = combine(low.y, high.y);
+    const Lanes z = combine(low.z, high.z);
+    const Lanes neg_r = _mm256_sub_ps(_mm256_setzero_ps(), combine(low.r, high.r));
+
+    Lanes inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (usize i{ 0 }; i < 6; ++i)
+    {
+        const Lanes distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes.x[i], x), _mm256_mul_ps(planes.y[i], y)),
+                                             _mm256_add_ps(_mm256_mul_ps(planes.z[i], z), planes.w[i]));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, neg_r, _CMP_GE_OQ));
+    }
+
+    return static_cast<u32>(_mm256_movemask_ps(inside));
+}
+#else
+using Lanes = __m128;
+
+struct Planes
+{
+    Lanes x[6], y[6], z[6], w[6];
+};
+
+Planes load_planes(const Frustum& frustum)
+{
+    Planes planes{};
+    for (usize i{ 0 }; i < 6; ++i)
+    {
+        planes.x[i] = _mm_set1_ps(frustum.planes[i].x);
+        planes.y[i] = _mm_set1_ps(frustum.planes[i].y);
+        planes.z[i] = _mm_set1_ps(frustum.planes[i].z);
+        planes.w[i] = _mm_set1_ps(frustum.planes[i].w);
+    }
+    return planes;
+}
+
+u32 test_half(const Planes& planes, const BoundingSphere* spheres)
+{
+    const Spheres4 s = load_spheres(spheres);
+    const Lanes neg_r = _mm_sub_ps(_mm_setzero_ps(), s.r);
+
+    Lanes inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (usize i{ 0 }; i < 6; ++i)
+    {
+        const Lanes distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes.x[i], s.x), _mm_mul_ps(planes.y[i], s.y)),
+                                          _mm_add_ps(_mm_mul_ps(planes.z[i], s.z), planes.w[i]));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, neg_r));
+    }
+
+    return static_cast<u32>(_mm_movemask_ps(inside));
+}
+
+// Bit i is set if sphere i is not entirely behind any plane.
+u32 test_batch(const Planes& planes, const BoundingSphere* spheres)
+{
+    return test_half(planes, spheres) | (test_half(planes, spheres + 4) << 4);
+}
+#endif
+#else
+using Planes = Frustum;
+
+Planes load_planes(const Frustum& frustum)
+{
+    return frustum;
+}
+
+u32 test_batch(const Planes& planes, const BoundingSphere* spheres)
+{
+    u32 mask{ 0 };
+    for (usize i{ 0 }; i < batch_size; ++i)
+    {
+        const glm::vec4& sphere = spheres[i].sphere;
+        bool inside{ true };
+        for (const auto& plane : planes.planes)
+            inside &= glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w >= -sphere.w;
+
+        mask |= inside ? 1u << i : 0u;
+    }
+    return mask;
+}
+#endif
+
+// Every lane is written, only the set ones advance, so visible needs room for one index per lane.
+usize write_indices(const u32 mask, const u32 first, const u32 lanes, u32* visible)
+{
+    usize written{ 0 };
+    for (u32 i{ 0 }; i < lanes; ++i)
+    {
+        visible[written] = first + i;
+        written += (mask >> i) & 1;
+    }
+    return written;
+}
+}
+
+usize cull_spheres(const Frustum& frustum, const BoundingSphere* spheres, const usize count, u32* visible)
+{
+    const Planes planes = load_planes(frustum);
+
+    usize written{ 0 };
+    usize first{ 0 };
+    for (; first + batch_size <= count; first += batch_size)
+        written += write_indices(test_batch(planes, spheres + first), static_cast<u32>(first), batch_size, visible + written);
+
+    // The tail is padded to a full batch, the padding lanes are masked off.
+    if (first < count)
+    {
+        const usize remaining = count - first;
+        BoundingSphere tail[batch_size]{};
+        std::memcpy(tail, spheres + first, remaining * sizeof(BoundingSphere));
+
+        const u32 mask = test_batch(planes, tail) & ((1u << remaining) - 1);
+        written += write_indices(mask, static_cast<u32>(first), static_cast<u32>(remaining), visible + written);
+    }
+
+    return written;
+}
+}
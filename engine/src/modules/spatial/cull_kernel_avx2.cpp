@@ -0,0 +1,3 @@
+// Built with /arch:AVX2, cull_spheres only calls into it once the cpu was checked.
+#define MAS_KERNEL_TARGET avx2
+#include "cull_kernel.inl"
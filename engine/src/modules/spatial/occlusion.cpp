@@ -0,0 +1,188 @@
+#define MAS_KERNEL_TARGET baseline
+#include "occlusion.inl"
+
+#include "taskflow/taskflow.hpp"
+#include "taskflow/algorithm/for_each.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace mas
+{
+namespace
+{
+constexpr f32 far_depth{ std::numeric_limits<f32>::infinity() };
+// Vertices closer to the eye than this in clip space w count as crossing the near plane.
+constexpr f32 min_w{ 1e-4f };
+}
+
+namespace avx2
+{
+void rasterize_bin(const OcclusionBuffer::Triangle* triangles, const u32* bin, usize count, f32* pixels, u32 tile_x, u32 tile_y);
+}
+
+OcclusionBuffer::OcclusionBuffer(const u32 width, const u32 height)
+    : tiles_x((width + tile_width - 1) / tile_width),
+    tiles_y((height + tile_height - 1) / tile_height)
+{
+    this->width = tiles_x * tile_width;
+    this->height = tiles_y * tile_height;
+    bins.resize(tiles_x * tiles_y);
+    depth.resize(static_cast<usize>(this->width) * this->height, far_depth);
+    tile_max.resize(bins.size(), far_depth);
+}
+
+void OcclusionBuffer::begin(const glm::mat4& view_proj)
+{
+    this->view_proj = view_proj;
+    triangles.clear();
+    for (auto& bin : bins)
+        bin.clear();
+}
+
+void OcclusionBuffer::add_occluder(const OccluderMesh& mesh, const glm::mat4& transform)
+{
+    const glm::mat4 mvp = view_proj * transform;
+    clip_scratch.resize(mesh.positions.size());
+    for (usize i{ 0 }; i < mesh.positions.size(); ++i)
+        clip_scratch[i] = mvp * glm::vec4(mesh.positions[i], 1.0f);
+
+    const glm::vec2 scale{ static_cast<f32>(width) * 0.5f, static_cast<f32>(height) * 0.5f };
+    for (usize i{ 0 }; i + 2 < mesh.indices.size(); i += 3)
+    {
+        Triangle triangle{};
+        bool crosses_near{ false };
+        for (usize v{ 0 }; v < 3; ++v)
+        {
+            const glm::vec4& clip = clip_scratch[mesh.indices[i + v]];
+            crosses_near |= clip.w < min_w;
+            triangle.v[v] = { (clip.x / clip.w + 1.0f) * scale.x, (clip.y / clip.w + 1.0f) * scale.y, clip.z / clip.w };
+        }
+
+        if (crosses_near)
+            continue;
+
+        // Both windings occlude, the edge functions expect a positive area.
+        const glm::vec3 d1 = triangle.v[1] - triangle.v[0];
+        const glm::vec3 d2 = triangle.v[2] - triangle.v[0];
+        const f32 area = d1.x * d2.y - d2.x * d1.y;
+        if (std::abs(area) < 1e-6f)
+            continue;
+        if (area < 0.0f)
+            std::swap(triangle.v[1], triangle.v[2]);
+
+        const f32 min_x = std::min({ triangle.v[0].x, triangle.v[1].x, triangle.v[2].x });
+        const f32 max_x = std::max({ triangle.v[0].x, triangle.v[1].x, triangle.v[2].x });
+        const f32 min_y = std::min({ triangle.v[0].y, triangle.v[1].y, triangle.v[2].y });
+        const f32 max_y = std::max({ triangle.v[0].y, triangle.v[1].y, triangle.v[2].y });
+        if (max_x < 0.0f || max_y < 0.0f || min_x >= static_cast<f32>(width) || min_y >= static_cast<f32>(height))
+            continue;
+
+        const u32 first_x = static_cast<u32>(std::max(min_x, 0.0f)) / tile_width;
+        const u32 last_x = static_cast<u32>(std::min(max_x, static_cast<f32>(width - 1))) / tile_width;
+        const u32 first_y = static_cast<u32>(std::max(min_y, 0.0f)) / tile_height;
+        const u32 last_y = static_cast<u32>(std::min(max_y, static_cast<f32>(height - 1))) / tile_height;
+
+        const auto index = static_cast<u32>(triangles.size());
+        triangles.push_back(triangle);
+        for (u32 ty{ first_y }; ty <= last_y; ++ty)
+        {
+            for (u32 tx{ first_x }; tx <= last_x; ++tx)
+                bins[ty * tiles_x + tx].push_back(index);
+        }
+    }
+}
+
+void OcclusionBuffer::rasterize(tf::Executor& executor)
+{
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    if (triangles.empty())
+        std::ranges::fill(tile_max, far_depth);
+    else
+    {
+        // Tiles share nothing, so every one is its own task.
+        tf::Taskflow taskflow;
+        taskflow.for_each_index(u32{ 0 }, static_cast<u32>(bins.size()), u32{ 1 }, [this](const u32 tile) { rasterize_tile(tile); });
+        executor.run(taskflow).wait();
+    }
+
+    stats.triangles = static_cast<u32>(triangles.size());
+    stats.raster_ms = std::chrono::duration<f32, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+}
+
+void OcclusionBuffer::rasterize_tile(const u32 tile)
+{
+    f32* pixels = depth.data() + static_cast<usize>(tile) * tile_width * tile_height;
+    std::fill_n(pixels, tile_width * tile_height, far_depth);
+
+    const u32 tile_x = tile % tiles_x * tile_width;
+    const u32 tile_y = tile / tiles_x * tile_height;
+
+    static const auto kernel = cpu_has_avx2() ? &avx2::rasterize_bin : &baseline::rasterize_bin;
+    kernel(triangles.data(), bins[tile].data(), bins[tile].size(), pixels, tile_x, tile_y);
+
+    tile_max[tile] = *std::max_element(pixels, pixels + tile_width * tile_height);
+}
+
+bool OcclusionBuffer::is_visible(const Aabb& bounds) const
+{
+    // Unbounded boxes can not be hidden.
+    if (triangles.empty() || glm::any(glm::isinf(bounds.min)) || glm::any(glm::isinf(bounds.max)))
+        return true;
+
+    // Screen rectangle and nearest depth of the box corners.
+    glm::vec2 min_screen{ std::numeric_limits<f32>::max() };
+    glm::vec2 max_screen{ std::numeric_limits<f32>::lowest() };
+    f32 nearest{ std::numeric_limits<f32>::max() };
+    for (u32 corner{ 0 }; corner < 8; ++corner)
+    {
+        const glm::vec3 point{ corner & 1 ? bounds.max.x : bounds.min.x, corner & 2 ? bounds.max.y : bounds.min.y,
+                               corner & 4 ? bounds.max.z : bounds.min.z };
+        const glm::vec4 clip = view_proj * glm::vec4(point, 1.0f);
+        if (clip.w < min_w)
+            return true;
+
+        const glm::vec2 screen = (glm::vec2(clip) / clip.w + 1.0f) * 0.5f * glm::vec2(width, height);
+        min_screen = glm::min(min_screen, screen);
+        max_screen = glm::max(max_screen, screen);
+        nearest = std::min(nearest, clip.z / clip.w);
+    }
+
+    if (max_screen.x < 0.0f || max_screen.y < 0.0f || min_screen.x >= static_cast<f32>(width) || min_screen.y >= static_cast<f32>(height))
+        return true;
+
+    // Every pixel the rectangle touches.
+    const u32 first_x = static_cast<u32>(std::max(min_screen.x, 0.0f));
+    const u32 last_x = static_cast<u32>(std::min(max_screen.x, static_cast<f32>(width - 1)));
+    const u32 first_y = static_cast<u32>(std::max(min_screen.y, 0.0f));
+    const u32 last_y = static_cast<u32>(std::min(max_screen.y, static_cast<f32>(height - 1)));
+
+    for (u32 ty{ first_y / tile_height }; ty <= last_y / tile_height; ++ty)
+    {
+        for (u32 tx{ first_x / tile_width }; tx <= last_x / tile_width; ++tx)
+        {
+            const u32 tile = ty * tiles_x + tx;
+            if (nearest > tile_max[tile])
+                continue;
+
+            const f32* pixels = depth.data() + static_cast<usize>(tile) * tile_width * tile_height;
+            const u32 x0 = std::max(first_x, tx * tile_width) - tx * tile_width;
+            const u32 x1 = std::min(last_x, tx * tile_width + tile_width - 1) - tx * tile_width;
+            const u32 y0 = std::max(first_y, ty * tile_height) - ty * tile_height;
+            const u32 y1 = std::min(last_y, ty * tile_height + tile_height - 1) - ty * tile_height;
+            for (u32 y{ y0 }; y <= y1; ++y)
+            {
+                for (u32 x{ x0 }; x <= x1; ++x)
+                {
+                    if (nearest <= pixels[y * tile_width + x])
+                        return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+}
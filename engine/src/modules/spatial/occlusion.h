@@ -0,0 +1,87 @@
+#pragma once
+#include "common.h"
+#include "bounds.h"
+
+#include <vector>
+
+namespace tf
+{
+class Executor;
+}
+
+namespace mas
+{
+// Positions and triangle indices of a mesh, kept on the cpu to rasterize it as an occluder.
+struct OccluderMesh
+{
+    std::vector<glm::vec3> positions{};
+    std::vector<u32> indices{};
+};
+
+struct OcclusionStats
+{
+    u32 triangles{ 0 };
+    f32 raster_ms{ 0.0f };
+};
+
+// Low resolution depth buffer of the occluders, rasterized on the cpu so culling against it needs no gpu readback.
+// Triangles are binned into tiles which are rasterized on the executor's workers, eight pixels of a row at a time with
+// AVX on cpus with AVX2, two SSE halves or plain floats. Depth is sampled at pixel centres. The farthest depth of every tile is kept as
+// well, bounds behind it are rejected without looking at single pixels.
+class OcclusionBuffer
+{
+public:
+    static constexpr u32 tile_width{ 32 };
+    static constexpr u32 tile_height{ 16 };
+
+    // Width and height are rounded up to whole tiles.
+    explicit OcclusionBuffer(u32 width = 256, u32 height = 128);
+    ~OcclusionBuffer() = default;
+    OcclusionBuffer(OcclusionBuffer&&) noexcept = default;
+    OcclusionBuffer& operator=(OcclusionBuffer&&) noexcept = default;
+    DISABLE_COPY(OcclusionBuffer)
+
+    // Drop the occluders of the previous frame.
+    void begin(const glm::mat4& view_proj);
+
+    // Transform the triangles of the mesh to the screen and bin them. Triangles crossing the near plane are left out,
+    // which can only let more through.
+    void add_occluder(const OccluderMesh& mesh, const glm::mat4& transform);
+
+    // Rasterize every binned triangle. Must not be called from one of the executor's workers.
+    void rasterize(tf::Executor& executor);
+
+    // False only if every pixel the bounds cover already has an occluder in front of the nearest point of the
+    // bounds. Safe to call from many threads once rasterize returned.
+    [[nodiscard]] bool is_visible(const Aabb& bounds) const;
+
+    [[nodiscard]] bool empty() const { return triangles.empty(); }
+    [[nodiscard]] const OcclusionStats& get_stats() const { return stats; }
+
+    // Screen space triangle, x and y in pixels and z the depth after the perspective divide.
+    struct Triangle
+    {
+        glm::vec3 v[3];
+    };
+
+private:
+    void rasterize_tile(u32 tile);
+
+    u32 width{ 0 };
+    u32 height{ 0 };
+    u32 tiles_x{ 0 };
+    u32 tiles_y{ 0 };
+    glm::mat4 view_proj{ 1.0f };
+
+    std::vector<Triangle> triangles{};
+    // Triangles overlapping each tile.
+    std::vector<std::vector<u32>> bins{};
+    // Tile after tile, row major within a tile. Pixels without an occluder are infinitely far.
+    std::vector<f32> depth{};
+    // Farthest depth in each tile.
+    std::vector<f32> tile_max{};
+    std::vector<glm::vec4> clip_scratch{};
+
+    OcclusionStats stats{};
+};
+}
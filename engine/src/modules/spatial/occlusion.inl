@@ -0,0 +1,154 @@
+// Rasterizer of the occlusion buffer, built once per instruction set by occlusion.cpp and occlusion_avx2.cpp.
+// MAS_KERNEL_TARGET names the namespace of the build.
+#include "occlusion.h"
+#include "simd.h"
+
+namespace mas::MAS_KERNEL_TARGET
+{
+namespace
+{
+constexpr u32 span_width{ 8 };
+static_assert(OcclusionBuffer::tile_width % span_width == 0, "Spans must not cross tiles");
+
+// Edge functions e(x, y) = a * x + b * y + c, positive inside, and the depth plane z(x, y) = zx * x + zy * y + zc.
+struct TriangleSetup
+{
+    f32 a[3], b[3], c[3];
+    f32 zx, zy, zc;
+};
+
+TriangleSetup setup_triangle(const OcclusionBuffer::Triangle& t)
+{
+    TriangleSetup s{};
+    for (usize i{ 0 }; i < 3; ++i)
+    {
+        const auto& from = t.v[i];
+        const auto& to = t.v[(i + 1) % 3];
+        s.a[i] = from.y - to.y;
+        s.b[i] = to.x - from.x;
+        s.c[i] = -(s.a[i] * from.x + s.b[i] * from.y);
+    }
+
+    const f32 d1[3]{ t.v[1].x - t.v[0].x, t.v[1].y - t.v[0].y, t.v[1].z - t.v[0].z };
+    const f32 d2[3]{ t.v[2].x - t.v[0].x, t.v[2].y - t.v[0].y, t.v[2].z - t.v[0].z };
+    const f32 area = d1[0] * d2[1] - d2[0] * d1[1];
+    s.zx = (d1[2] * d2[1] - d2[2] * d1[1]) / area;
+    s.zy = (d1[0] * d2[2] - d2[0] * d1[2]) / area;
+    s.zc = t.v[0].z - s.zx * t.v[0].x - s.zy * t.v[0].y;
+    return s;
+}
+
+// Eight pixels of a row starting at x, keeping the nearer of the stored depth and the triangle's where it covers them.
+#if MAS_AVX
+void rasterize_span(const TriangleSetup& s, f32* row, const f32 x, const f32 y)
+{
+    const __m256 xs = _mm256_add_ps(_mm256_set1_ps(x), _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f));
+    const __m256 zero = _mm256_setzero_ps();
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (usize i{ 0 }; i < 3; ++i)
+    {
+        const __m256 edge = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(s.a[i]), xs), _mm256_set1_ps(s.b[i] * y + s.c[i]));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(edge, zero, _CMP_GE_OQ));
+    }
+
+    const __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(s.zx), xs), _mm256_set1_ps(s.zy * y + s.zc));
+    const __m256 stored = _mm256_loadu_ps(row);
+    _mm256_storeu_ps(row, _mm256_blendv_ps(stored, _mm256_min_ps(stored, z), inside));
+}
+#elif MAS_SSE
+void rasterize_half(const TriangleSetup& s, f32* row, const f32 x, const f32 y)
+{
+    const __m128 xs = _mm_add_ps(_mm_set1_ps(x), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (usize i{ 0 }; i < 3; ++i)
+    {
+        const __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s.a[i]), xs), _mm_set1_ps(s.b[i] * y + s.c[i]));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, zero));
+    }
+
+    const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s.zx), xs), _mm_set1_ps(s.zy * y + s.zc));
+    const __m128 stored = _mm_loadu_ps(row);
+    const __m128 nearer = _mm_min_ps(stored, z);
+    _mm_storeu_ps(row, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+}
+
+void rasterize_span(const TriangleSetup& s, f32* row, const f32 x, const f32 y)
+{
+    rasterize_half(s, row, x, y);
+    rasterize_half(s, row + 4, x + 4.0f, y);
+}
+#else
+void rasterize_span(const TriangleSetup& s, f32* row, const f32 x, const f32 y)
+{
+    for (u32 i{ 0 }; i < span_width; ++i)
+    {
+        const f32 px = x + static_cast<f32>(i) + 0.5f;
+        bool inside{ true };
+        for (usize e{ 0 }; e < 3; ++e)
+            inside &= s.a[e] * px + s.b[e] * y + s.c[e] >= 0.0f;
+
+        if (inside)
+        {
+            const f32 z = s.zx * px + s.zy * y + s.zc;
+            row[i] = z < row[i] ? z : row[i];
+        }
+    }
+}
+#endif
+
+f32 min3(const f32 a, const f32 b, const f32 c)
+{
+    const f32 ab = a < b ? a : b;
+    return ab < c ? ab : c;
+}
+
+f32 max3(const f32 a, const f32 b, const f32 c)
+{
+    const f32 ab = a > b ? a : b;
+    return ab > c ? ab : c;
+}
+
+u32 clamp_to(const f32 v, const u32 last)
+{
+    return static_cast<u32>(v < 0.0f ? 0.0f : v > static_cast<f32>(last) ? static_cast<f32>(last) : v);
+}
+}
+
+// Rasterizes the triangles listed in bin into the pixels of the tile whose corner is at tile_x, tile_y.
+void rasterize_bin(const OcclusionBuffer::Triangle* triangles, const u32* bin, const usize count, f32* pixels, const u32 tile_x,
+                   const u32 tile_y)
+{
+    constexpr u32 tile_width{ OcclusionBuffer::tile_width };
+    constexpr u32 tile_height{ OcclusionBuffer::tile_height };
+
+    for (usize i{ 0 }; i < count; ++i)
+    {
+        const OcclusionBuffer::Triangle& triangle = triangles[bin[i]];
+        const TriangleSetup setup = setup_triangle(triangle);
+
+        // Rows and spans of the tile the triangle's bounds touch.
+        const f32 min_x = min3(triangle.v[0].x, triangle.v[1].x, triangle.v[2].x) - static_cast<f32>(tile_x);
+        const f32 max_x = max3(triangle.v[0].x, triangle.v[1].x, triangle.v[2].x) - static_cast<f32>(tile_x);
+        const f32 min_y = min3(triangle.v[0].y, triangle.v[1].y, triangle.v[2].y) - static_cast<f32>(tile_y);
+        const f32 max_y = max3(triangle.v[0].y, triangle.v[1].y, triangle.v[2].y) - static_cast<f32>(tile_y);
+
+        const u32 first_span = clamp_to(min_x, tile_width - 1) / span_width;
+        const u32 last_span = clamp_to(max_x, tile_width - 1) / span_width;
+        const u32 first_row = clamp_to(min_y, tile_height - 1);
+        const u32 last_row = clamp_to(max_y, tile_height - 1);
+
+        for (u32 row{ first_row }; row <= last_row; ++row)
+        {
+            const f32 y = static_cast<f32>(tile_y + row) + 0.5f;
+            for (u32 span{ first_span }; span <= last_span; ++span)
+            {
+                const u32 x = span * span_width;
+                rasterize_span(setup, pixels + row * tile_width + x, static_cast<f32>(tile_x + x), y);
+            }
+        }
+    }
+}
+}
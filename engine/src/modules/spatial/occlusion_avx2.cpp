@@ -0,0 +1,3 @@
+// Built with /arch:AVX2, the occlusion buffer only calls into it once the cpu was checked.
+#define MAS_KERNEL_TARGET avx2
+#include "occlusion.inl"
@@ -0,0 +1,224 @@
+#include "spatial_module.h"
+#include "cull_kernel.h"
+#include "job_system.h"
+#include "modules/transform/transform_module.h"
+#include "modules/render/render_module.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace mas
+{
+namespace
+{
+const Aabb* find_mesh_bounds(const MeshBounds& mesh_bounds, const MeshId mesh)
+{
+    const auto index = id::index(mesh);
+    return index < mesh_bounds.bounds.size() ? &mesh_bounds.bounds[index] : nullptr;
+}
+
+BoundingSphere bounding_sphere(const Aabb& bounds)
+{
+    return { glm::vec4(bounds.center(), glm::length(bounds.extent())) };
+}
+
+// Indices written by the kernel per call, keeps the buffer on the stack for tables of any size.
+constexpr usize cull_chunk_size{ 1024 };
+}
+
+SpatialModule::SpatialModule(flecs::world& world)
+{
+    if (const auto result = world.module<SpatialModule>(); !result)
+        throw std::runtime_error("Failed to add spatial module");
+
+    world.import<TransformModule>();
+    world.import<RenderModule>();
+
+    world.set<SpatialIndex>({});
+
+    // Added with every Model so entities are created in their final table, proxies are then created in place by the
+    // refit. Entities that lack them, such as ones whose GlobalTransform was removed and added again, get them here.
+    world.component<Model>()
+        .add(flecs::With, world.component<SpatialProxy>())
+        .add(flecs::With, world.component<BoundingSphere>());
+
+    // Entities only get a proxy once the bounds of their mesh are known.
+    world.system<SpatialIndex, const MeshBounds, const GlobalTransform, const Model>("Spatial proxy creation")
+        .term_at(1).singleton()
+        .term_at(2).singleton()
+        .without<SpatialProxy>()
+        .kind(flecs::PostUpdate)
+        .each([](flecs::entity e, SpatialIndex& index, const MeshBounds& mesh_bounds, const GlobalTransform& transform, const Model& model)
+              {
+                  const auto* local = find_mesh_bounds(mesh_bounds, model.mesh_id);
+                  if (!local)
+                      return;
+
+                  const auto bounds = transform_aabb(*local, transform.matrix());
+                  e.set<SpatialProxy>({ index.bvh.create_proxy(bounds, e.id()) });
+                  e.set<BoundingSphere>(bounding_sphere(bounds));
+              });
+
+    // Tables whose transforms did not change are skipped, static entities cost nothing after their first frame. New
+    // entities count as a change of their table, as do new mesh bounds, so proxies without an id are created here.
+    // The index and proxies are declared as out only, otherwise writing to them would count as a change of every table.
+    world.system<SpatialIndex, const MeshBounds, const GlobalTransform, const Model, SpatialProxy, BoundingSphere>("Spatial refit")
+        .term_at(1).singleton().inout(flecs::Out)
+        .term_at(2).singleton()
+        .term_at(5).out()
+        .term_at(6).out()
+        .kind(flecs::PostUpdate)
+        .iter([](flecs::iter& it, SpatialIndex* index, const MeshBounds* mesh_bounds, const GlobalTransform* transforms, const Model* models,
+                 SpatialProxy* proxies, BoundingSphere* spheres)
+              {
+                  if (!it.changed())
+                  {
+                      it.skip();
+                      return;
+                  }
+
+                  for (const auto i : it)
+                  {
+                      if (const auto* local = find_mesh_bounds(*mesh_bounds, models[i].mesh_id))
+                      {
+                          const auto bounds = transform_aabb(*local, transforms[i].matrix());
+                          if (proxies[i].id == invalid_proxy)
+                              proxies[i].id = index->bvh.create_proxy(bounds, it.entity(i).id());
+                          else
+                              index->bvh.move_proxy(proxies[i].id, bounds);
+                          spheres[i] = bounding_sphere(bounds);
+                      }
+                  }
+              });
+
+    world.system<SpatialIndex, const Jobs>("Spatial index maintenance")
+        .term_at(1).singleton()
+        .term_at(2).singleton()
+        .kind(flecs::PostUpdate)
+        .each([](SpatialIndex& index, const Jobs& jobs)
+              {
+                  index.bvh.maintain(*jobs);
+              });
+
+    world.set<VisibilityList>({});
+    world.set<OccluderMeshes>({});
+    world.set<OcclusionCulling>({});
+
+    // The lists are only valid while there is a camera to cull against, otherwise extraction submits everything.
+    world.system<VisibilityList>("Visibility reset")
+        .term_at(1).singleton()
+        .kind(flecs::PreStore)
+        .each([](flecs::iter& it, usize, VisibilityList& list)
+              {
+                  list.stages.resize(static_cast<usize>(it.world().get_stage_count()));
+                  for (auto& stage : list.stages)
+                      stage.clear();
+
+                  list.valid = it.world().has<gfx::Camera>();
+              });
+
+    // Occluders outside the frustum are skipped before their triangles are transformed.
+    const auto occluders = world.query_builder<const GlobalTransform, const Model, const BoundingSphere>()
+        .with<Occluder>()
+        .build();
+
+    world.system<OcclusionCulling, const gfx::Camera, const OccluderMeshes, const Jobs>("Occluder rasterization")
+        .term_at(1).singleton()
+        .term_at(2).singleton()
+        .term_at(3).singleton()
+        .term_at(4).singleton()
+        .kind(flecs::PreStore)
+        .each([occluders](OcclusionCulling& occlusion, const gfx::Camera& camera, const OccluderMeshes& meshes, const Jobs& jobs)
+              {
+                  const glm::mat4 view_proj = camera.proj * camera.view;
+                  occlusion.buffer.begin(view_proj);
+                  if (occlusion.enabled)
+                  {
+                      const Frustum frustum = make_frustum(view_proj);
+                      occluders.iter([&occlusion, &meshes, &frustum](flecs::iter& it, const GlobalTransform* transforms, const Model* models,
+                                                                     const BoundingSphere* spheres)
+                      {
+                          const auto count = static_cast<usize>(it.count());
+                          u32 indices[cull_chunk_size];
+                          for (usize first{ 0 }; first < count; first += cull_chunk_size)
+                          {
+                              const usize visible_count = cull_spheres(frustum, spheres + first, std::min(cull_chunk_size, count - first), indices);
+                              for (usize j{ 0 }; j < visible_count; ++j)
+                              {
+                                  const usize i = first + indices[j];
+                                  const auto mesh = id::index(models[i].mesh_id);
+                                  if (mesh < meshes.meshes.size())
+                                      occlusion.buffer.add_occluder(meshes.meshes[mesh], transforms[i].matrix());
+                              }
+                          }
+                      });
+                  }
+
+                  occlusion.buffer.rasterize(jobs->get_executor());
+              });
+
+    // Tables are split over the worker threads, each appending to the list of its own stage. Entities without bounds
+    // yet are always visible.
+    world.system<VisibilityList, const gfx::Camera, const OcclusionCulling, const GlobalTransform, const Model, const SceneSlot,
+                 const BoundingSphere*>("Frustum culling")
+        .term_at(1).singleton()
+        .term_at(2).singleton()
+        .term_at(3).singleton()
+        .kind(flecs::PreStore)
+        .multi_threaded()
+        .iter([](flecs::iter& it, VisibilityList* list, const gfx::Camera* camera, const OcclusionCulling* occlusion, const GlobalTransform* transforms,
+                 const Model* models, const SceneSlot* slots, const BoundingSphere* spheres)
+              {
+                  auto& visible = list->stages[static_cast<usize>(it.world().get_stage_id())];
+                  const auto count = static_cast<usize>(it.count());
+
+                  if (!spheres)
+                  {
+                      for (const auto i : it)
+                          visible.push_back({ transforms[i].matrix(), models[i], slots[i].index });
+                      return;
+                  }
+
+                  // The buffer is only read here, it was rasterized before this system started.
+                  const auto& buffer = occlusion->buffer;
+                  const bool test_occlusion = !buffer.empty();
+
+                  const Frustum frustum = make_frustum(camera->proj * camera->view);
+                  u32 indices[cull_chunk_size];
+                  for (usize first{ 0 }; first < count; first += cull_chunk_size)
+                  {
+                      const usize chunk = std::min(cull_chunk_size, count - first);
+                      const usize visible_count = cull_spheres(frustum, spheres + first, chunk, indices);
+                      for (usize j{ 0 }; j < visible_count; ++j)
+                      {
+                          const usize i = first + indices[j];
+                          if (test_occlusion)
+                          {
+                              const glm::vec4& sphere = spheres[i].sphere;
+                              const glm::vec3 center{ sphere };
+                              if (!buffer.is_visible({ center - sphere.w, center + sphere.w }))
+                                  continue;
+                          }
+
+                          visible.push_back({ transforms[i].matrix(), models[i], slots[i].index });
+                      }
+                  }
+              });
+
+    world.observer("Spatial proxy release")
+        .with<Model>()
+        .with<GlobalTransform>()
+        .event(flecs::OnRemove)
+        .each([](flecs::entity e)
+              {
+                  const auto* proxy = e.get<SpatialProxy>();
+                  if (!proxy || !e.world().has<SpatialIndex>())
+                      return;
+
+                  if (proxy->id != invalid_proxy)
+                      e.world().get_mut<SpatialIndex>()->bvh.destroy_proxy(proxy->id);
+                  e.remove<SpatialProxy>();
+                  e.remove<BoundingSphere>();
+              });
+}
+}
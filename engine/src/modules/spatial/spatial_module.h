@@ -0,0 +1,63 @@
+#pragma once
+#include "common.h"
+#include "bounds.h"
+#include "bvh.h"
+#include "occlusion.h"
+
+#include "flecs/flecs.h"
+
+#include <limits>
+#include <vector>
+
+namespace mas
+{
+// Local bounds of every loaded mesh by mesh index, set once the assets of the startup phase have been loaded.
+struct MeshBounds
+{
+    std::vector<Aabb> bounds{};
+};
+
+//Internal type to the engine, the entity's proxy in the spatial index. Invalid until the bounds of its mesh are known.
+struct SpatialProxy
+{
+    ProxyId id{ invalid_proxy };
+};
+
+// World space bounding sphere of the entity, centre in xyz and radius in w. Kept in sync with its proxy, the radius is
+// infinite until the bounds of its mesh are known, which keeps the entity visible.
+struct BoundingSphere
+{
+    glm::vec4 sphere{ 0.0f, 0.0f, 0.0f, std::numeric_limits<f32>::infinity() };
+};
+
+// World space bounds of every entity with a Model and a GlobalTransform. Query it through the bvh, proxies carry the
+// id of their entity as user data.
+struct SpatialIndex
+{
+    Bvh bvh{};
+};
+
+// Marks an entity whose mesh hides what is behind it from the occlusion culling. Works best on large, simple meshes
+// such as walls and terrain, every triangle is rasterized each frame.
+struct Occluder
+{};
+
+// Geometry of every loaded mesh by mesh index, set together with the mesh bounds. Occluders are rasterized from it.
+struct OccluderMeshes
+{
+    std::vector<OccluderMesh> meshes{};
+};
+
+// Entities that pass the frustum are tested against the occluders before they are added to the visibility list.
+struct OcclusionCulling
+{
+    OcclusionBuffer buffer{};
+    bool enabled{ true };
+};
+
+struct SpatialModule
+{
+    // ReSharper disable once CppNonExplicitConvertingConstructor
+    SpatialModule(flecs::world& world);
+};
+}
@@ -0,0 +1,16 @@
+#define MAS_KERNEL_TARGET baseline
+#include "transform_kernel.inl"
+
+namespace mas
+{
+namespace avx2
+{
+void compose_transforms(const Transform* local, const GlobalTransform* parent, GlobalTransform* global, usize count);
+}
+
+void compose_transforms(const Transform* local, const GlobalTransform* parent, GlobalTransform* global, const usize count)
+{
+    static const auto kernel = cpu_has_avx2() ? &avx2::compose_transforms : &baseline::compose_transforms;
+    kernel(local, parent, global, count);
+}
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "common.h"
+#include "transform_module.h"
+
+namespace mas
+{
+// Composes the translation, rotation and scale of count local transforms straight into affine rows, without
+// building intermediate matrices, and stores them as global transforms. A non null parent is applied to all of
+// them, which matches a flecs table where every entity shares one parent.
+// On cpus with AVX2 eight transforms are composed at once, one per lane, and the remainder one at a time with SSE
+// and FMA. Other cpus use SSE for every transform, targets without it plain floats.
+void compose_transforms(const Transform* local, const GlobalTransform* parent, GlobalTransform* global, usize count);
+}
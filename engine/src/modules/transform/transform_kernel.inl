@@ -0,0 +1,359 @@
+// Body of the transform kernel, built once per instruction set by transform_kernel.cpp and transform_kernel_avx2.cpp.
+// MAS_KERNEL_TARGET names the namespace of the build.
+#include "transform_kernel.h"
+#include "simd.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace mas::MAS_KERNEL_TARGET
+{
+static_assert(sizeof(Transform) == 40, "The kernel loads Transform as position, scale and rotation floats");
+static_assert(offsetof(Transform, position) == 0 && offsetof(Transform, scale) == 12 && offsetof(Transform, rotation) == 24);
+
+namespace
+{
+#if MAS_SSE
+using Row = __m128;
+
+// a * b + c
+Row mul_add(const Row a, const Row b, const Row c)
+{
+#if MAS_FMA
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+template <int X, int Y, int Z, int W>
+Row swizzle(const Row v)
+{
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X));
+}
+
+struct Affine
+{
+    Row rows[3];
+};
+
+Affine compose(const Transform& t)
+{
+    const auto* data = reinterpret_cast<const float*>(&t);
+    const Row position = _mm_loadu_ps(data);
+    const Row scale = _mm_loadu_ps(data + 3);
+    const Row q = _mm_loadu_ps(data + 6);
+    const Row q2 = _mm_add_ps(q, q);
+
+    const Row xyz_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    const Row w_mask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    const Row s = _mm_and_ps(scale, xyz_mask);
+
+    // Each rotation row is its identity row plus two products of quaternion terms with per lane signs, the w lane
+    // is zeroed by the sign and later holds the translation.
+    const Row r0 = mul_add(_mm_mul_ps(swizzle<1, 0, 0, 0>(q), swizzle<1, 1, 2, 0>(q2)), _mm_setr_ps(-1.0f, 1.0f, 1.0f, 0.0f),
+                           mul_add(_mm_mul_ps(swizzle<2, 3, 3, 0>(q), swizzle<2, 2, 1, 0>(q2)), _mm_setr_ps(-1.0f, -1.0f, 1.0f, 0.0f),
+                                   _mm_setr_ps(1.0f, 0.0f, 0.0f, 0.0f)));
+    const Row r1 = mul_add(_mm_mul_ps(swizzle<0, 0, 1, 0>(q), swizzle<1, 0, 2, 0>(q2)), _mm_setr_ps(1.0f, -1.0f, 1.0f, 0.0f),
+                           mul_add(_mm_mul_ps(swizzle<3, 2, 3, 0>(q), swizzle<2, 2, 0, 0>(q2)), _mm_setr_ps(1.0f, -1.0f, -1.0f, 0.0f),
+                                   _mm_setr_ps(0.0f, 1.0f, 0.0f, 0.0f)));
+    const Row r2 = mul_add(_mm_mul_ps(swizzle<0, 1, 0, 0>(q), swizzle<2, 2, 0, 0>(q2)), _mm_setr_ps(1.0f, 1.0f, -1.0f, 0.0f),
+                           mul_add(_mm_mul_ps(swizzle<3, 3, 1, 0>(q), swizzle<1, 0, 1, 0>(q2)), _mm_setr_ps(-1.0f, 1.0f, -1.0f, 0.0f),
+                                   _mm_setr_ps(0.0f, 0.0f, 1.0f, 0.0f)));
+
+    return {
+        _mm_or_ps(_mm_mul_ps(r0, s), _mm_and_ps(swizzle<0, 0, 0, 0>(position), w_mask)),
+        _mm_or_ps(_mm_mul_ps(r1, s), _mm_and_ps(swizzle<1, 1, 1, 1>(position), w_mask)),
+        _mm_or_ps(_mm_mul_ps(r2, s), _mm_and_ps(swizzle<2, 2, 2, 2>(position), w_mask)),
+    };
+}
+
+// parent * local, the implicit fourth row of both is (0, 0, 0, 1).
+Affine multiply(const Affine& parent, const Affine& local)
+{
+    const Row w_row = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+
+    Affine result{};
+    for (usize i{ 0 }; i < 3; ++i)
+    {
+        const Row p = parent.rows[i];
+        Row row = _mm_mul_ps(swizzle<0, 0, 0, 0>(p), local.rows[0]);
+        row = mul_add(swizzle<1, 1, 1, 1>(p), local.rows[1], row);
+        row = mul_add(swizzle<2, 2, 2, 2>(p), local.rows[2], row);
+        result.rows[i] = mul_add(swizzle<3, 3, 3, 3>(p), w_row, row);
+    }
+    return result;
+}
+
+#ifdef MAS_COMPACT_GLOBAL_TRANSFORM
+Affine load(const GlobalTransform& g)
+{
+    const auto* data = &g.rows[0].x;
+    return { _mm_loadu_ps(data), _mm_loadu_ps(data + 4), _mm_loadu_ps(data + 8) };
+}
+
+void store(const Affine& a, GlobalTransform& g)
+{
+    auto* data = &g.rows[0].x;
+    _mm_storeu_ps(data, a.rows[0]);
+    _mm_storeu_ps(data + 4, a.rows[1]);
+    _mm_storeu_ps(data + 8, a.rows[2]);
+}
+#else
+Affine load(const GlobalTransform& g)
+{
+    // Through the storage, glm's operator[] is shared with the baseline build.
+    const auto* data = reinterpret_cast<const f32*>(&g.transform);
+    Row c0 = _mm_loadu_ps(data);
+    Row c1 = _mm_loadu_ps(data + 4);
+    Row c2 = _mm_loadu_ps(data + 8);
+    Row c3 = _mm_loadu_ps(data + 12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    return { c0, c1, c2 };
+}
+
+void store(const Affine& a, GlobalTransform& g)
+{
+    // glm matrices are column major, the rows are transposed back into columns.
+    Row r0 = a.rows[0];
+    Row r1 = a.rows[1];
+    Row r2 = a.rows[2];
+    Row r3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    auto* data = reinterpret_cast<f32*>(&g.transform);
+    _mm_storeu_ps(data, r0);
+    _mm_storeu_ps(data + 4, r1);
+    _mm_storeu_ps(data + 8, r2);
+    _mm_storeu_ps(data + 12, r3);
+}
+#endif
+
+#if MAS_AVX2
+using Lanes = __m256;
+constexpr usize lane_count{ 8 };
+
+// Eight affine transforms, element m[i][j] of transform k in lane k.
+struct WideAffine
+{
+    Lanes m[3][4];
+};
+
+// a * b + c
+Lanes mul_add(const Lanes a, const Lanes b, const Lanes c)
+{
+#if MAS_FMA
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+WideAffine compose_wide(const Transform* t)
+{
+    // Gathering each of the ten floats of eight transforms turns them into structure of arrays.
+    const auto* data = reinterpret_cast<const float*>(t);
+    const __m256i offsets = _mm256_setr_epi32(0, 10, 20, 30, 40, 50, 60, 70);
+    Lanes f[10];
+    for (usize i{ 0 }; i < 10; ++i)
+        f[i] = _mm256_i32gather_ps(data + i, offsets, 4);
+
+    const Lanes &px = f[0], &py = f[1], &pz = f[2];
+    const Lanes &sx = f[3], &sy = f[4], &sz = f[5];
+    const Lanes &qx = f[6], &qy = f[7], &qz = f[8], &qw = f[9];
+
+    const Lanes x2 = _mm256_add_ps(qx, qx), y2 = _mm256_add_ps(qy, qy), z2 = _mm256_add_ps(qz, qz);
+    const Lanes xx = _mm256_mul_ps(qx, x2), yy = _mm256_mul_ps(qy, y2), zz = _mm256_mul_ps(qz, z2);
+    const Lanes xy = _mm256_mul_ps(qx, y2), xz = _mm256_mul_ps(qx, z2), yz = _mm256_mul_ps(qy, z2);
+    const Lanes wx = _mm256_mul_ps(qw, x2), wy = _mm256_mul_ps(qw, y2), wz = _mm256_mul_ps(qw, z2);
+    const Lanes one = _mm256_set1_ps(1.0f);
+
+    WideAffine a{};
+    a.m[0][0] = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, yy), zz), sx);
+    a.m[0][1] = _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy);
+    a.m[0][2] = _mm256_mul_ps(_mm256_add_ps(xz, wy), sz);
+    a.m[0][3] = px;
+    a.m[1][0] = _mm256_mul_ps(_mm256_add_ps(xy, wz), sx);
+    a.m[1][1] = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, xx), zz), sy);
+    a.m[1][2] = _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz);
+    a.m[1][3] = py;
+    a.m[2][0] = _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx);
+    a.m[2][1] = _mm256_mul_ps(_mm256_add_ps(yz, wx), sy);
+    a.m[2][2] = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, xx), yy), sz);
+    a.m[2][3] = pz;
+    return a;
+}
+
+// The same parent in every lane.
+WideAffine broadcast(const GlobalTransform& g)
+{
+    const auto* data = reinterpret_cast<const f32*>(&g);
+    WideAffine a{};
+    for (usize i{ 0 }; i < 3; ++i)
+    {
+        for (usize j{ 0 }; j < 4; ++j)
+        {
+#ifdef MAS_COMPACT_GLOBAL_TRANSFORM
+            a.m[i][j] = _mm256_set1_ps(data[i * 4 + j]);
+#else
+            a.m[i][j] = _mm256_set1_ps(data[j * 4 + i]);
+#endif
+        }
+    }
+    return a;
+}
+
+WideAffine multiply_wide(const WideAffine& parent, const WideAffine& local)
+{
+    WideAffine result{};
+    for (usize i{ 0 }; i < 3; ++i)
+    {
+        for (usize j{ 0 }; j < 4; ++j)
+        {
+            Lanes v = _mm256_mul_ps(parent.m[i][0], local.m[0][j]);
+            v = mul_add(parent.m[i][1], local.m[1][j], v);
+            v = mul_add(parent.m[i][2], local.m[2][j], v);
+            result.m[i][j] = j == 3 ? _mm256_add_ps(v, parent.m[i][3]) : v;
+        }
+    }
+    return result;
+}
+
+// Transposes a, b, c and d into four floats per transform and writes them offset floats into each of the eight.
+void store_lanes(const Lanes a, const Lanes b, const Lanes c, const Lanes d, GlobalTransform* g, const usize offset)
+{
+    const Lanes t0 = _mm256_unpacklo_ps(a, b);
+    const Lanes t1 = _mm256_unpackhi_ps(a, b);
+    const Lanes t2 = _mm256_unpacklo_ps(c, d);
+    const Lanes t3 = _mm256_unpackhi_ps(c, d);
+
+    // Transforms 0 to 3 end up in the low halves, 4 to 7 in the high ones.
+    const Lanes r[4]{
+        _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+        _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+        _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+        _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)),
+    };
+    for (usize i{ 0 }; i < 4; ++i)
+    {
+        _mm_storeu_ps(reinterpret_cast<f32*>(g + i) + offset, _mm256_castps256_ps128(r[i]));
+        _mm_storeu_ps(reinterpret_cast<f32*>(g + i + 4) + offset, _mm256_extractf128_ps(r[i], 1));
+    }
+}
+
+void store_wide(const WideAffine& a, GlobalTransform* g)
+{
+#ifdef MAS_COMPACT_GLOBAL_TRANSFORM
+    for (usize i{ 0 }; i < 3; ++i)
+        store_lanes(a.m[i][0], a.m[i][1], a.m[i][2], a.m[i][3], g, i * 4);
+#else
+    // glm matrices are column major, every column gets its element of the implicit fourth row.
+    const Lanes zero = _mm256_setzero_ps();
+    for (usize j{ 0 }; j < 3; ++j)
+        store_lanes(a.m[0][j], a.m[1][j], a.m[2][j], zero, g, j * 4);
+    store_lanes(a.m[0][3], a.m[1][3], a.m[2][3], _mm256_set1_ps(1.0f), g, 12);
+#endif
+}
+#endif
+#else
+struct Affine
+{
+    f32 m[3][4];
+};
+
+Affine compose(const Transform& t)
+{
+    const auto& q = t.rotation;
+    const f32 x2 = q.x + q.x, y2 = q.y + q.y, z2 = q.z + q.z;
+    const f32 xx = q.x * x2, yy = q.y * y2, zz = q.z * z2;
+    const f32 xy = q.x * y2, xz = q.x * z2, yz = q.y * z2;
+    const f32 wx = q.w * x2, wy = q.w * y2, wz = q.w * z2;
+    const auto& s = t.scale;
+    const auto& p = t.position;
+
+    return { {
+        { (1.0f - yy - zz) * s.x, (xy - wz) * s.y, (xz + wy) * s.z, p.x },
+        { (xy + wz) * s.x, (1.0f - xx - zz) * s.y, (yz - wx) * s.z, p.y },
+        { (xz - wy) * s.x, (yz + wx) * s.y, (1.0f - xx - yy) * s.z, p.z },
+    } };
+}
+
+Affine multiply(const Affine& parent, const Affine& local)
+{
+    Affine result{};
+    for (usize i{ 0 }; i < 3; ++i)
+    {
+        const auto& p = parent.m[i];
+        for (usize j{ 0 }; j < 4; ++j)
+            result.m[i][j] = p[0] * local.m[0][j] + p[1] * local.m[1][j] + p[2] * local.m[2][j];
+        result.m[i][3] += p[3];
+    }
+    return result;
+}
+
+#ifdef MAS_COMPACT_GLOBAL_TRANSFORM
+Affine load(const GlobalTransform& g)
+{
+    Affine a{};
+    std::memcpy(a.m, &g.rows[0].x, sizeof(a.m));
+    return a;
+}
+
+void store(const Affine& a, GlobalTransform& g)
+{
+    std::memcpy(&g.rows[0].x, a.m, sizeof(a.m));
+}
+#else
+Affine load(const GlobalTransform& g)
+{
+    Affine a{};
+    for (usize i{ 0 }; i < 3; ++i)
+    {
+        for (usize j{ 0 }; j < 4; ++j)
+            a.m[i][j] = g.transform[static_cast<int>(j)][static_cast<int>(i)];
+    }
+    return a;
+}
+
+void store(const Affine& a, GlobalTransform& g)
+{
+    for (usize j{ 0 }; j < 4; ++j)
+    {
+        const auto col = static_cast<int>(j);
+        g.transform[col] = glm::vec4(a.m[0][j], a.m[1][j], a.m[2][j], j == 3 ? 1.0f : 0.0f);
+    }
+}
+#endif
+#endif
+}
+
+void compose_transforms(const Transform* local, const GlobalTransform* parent, GlobalTransform* global, const usize count)
+{
+    usize first{ 0 };
+#if MAS_AVX2
+    // Eight at a time, one transform per lane, the rest one by one.
+    if (!parent)
+    {
+        for (; first + lane_count <= count; first += lane_count)
+            store_wide(compose_wide(local + first), global + first);
+    }
+    else
+    {
+        const WideAffine parent_wide = broadcast(*parent);
+        for (; first + lane_count <= count; first += lane_count)
+            store_wide(multiply_wide(parent_wide, compose_wide(local + first)), global + first);
+    }
+#endif
+
+    if (!parent)
+    {
+        for (usize i{ first }; i < count; ++i)
+            store(compose(local[i]), global[i]);
+        return;
+    }
+
+    const Affine parent_affine = load(*parent);
+    for (usize i{ first }; i < count; ++i)
+        store(multiply(parent_affine, compose(local[i])), global[i]);
+}
+}
@@ -0,0 +1,3 @@
+// Built with /arch:AVX2, compose_transforms only calls into it once the cpu was checked.
+#define MAS_KERNEL_TARGET avx2
+#include "transform_kernel.inl"
@@ -1,20 +1,91 @@
 #include "transform_module.h"
+#include "transform_kernel.h"
+#include "job_system.h"
 
+#include "taskflow/algorithm/for_each.hpp"
+
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 namespace mas
 {
+namespace
+{
+// Entities a worker composes at once, large root tables are split over several workers.
+constexpr usize compose_chunk_size{ 1024 };
+
+struct ComposeChunk
+{
+    const Transform* local{ nullptr };
+    GlobalTransform* global{ nullptr };
+    usize count{ 0 };
+};
+}
+
 TransformModule::TransformModule(const flecs::world& world)
 {
     if (const auto result = world.module<TransformModule>(); !result)
         throw std::runtime_error("Failed to add transform module");
 
-    world.system<const Transform, GlobalTransform>("Transform system")
+    // Tables whose Transform, and parent GlobalTransform for children, are unchanged since the last run are skipped
+    // and keep their GlobalTransform clean, which in turn lets their children skip as well.
+    const auto roots = world.query_builder<const Transform, GlobalTransform>()
+        .without(flecs::ChildOf, flecs::Wildcard)
+        .term_at(2).out()
+        .build();
+
+    // Roots depend on nothing, so they are composed on the job system's workers. Flecs' own worker iterators can not
+    // detect changes, the changed tables are collected here first.
+    world.system<const Jobs>("Root transform system")
+        .term_at(1).singleton()
         .kind(flecs::OnValidate)
-        .multi_threaded(true)
-        .each([](const Transform& t, GlobalTransform& global_t)
+        .each([roots](const Jobs& jobs)
               {
-                  global_t.transform = glm::translate(glm::mat4(1.0f), t.position) * glm::toMat4(glm::quat(t.rotation)) * glm::scale(glm::mat4(1.0f), t.scale);
+                  std::vector<ComposeChunk> chunks{};
+                  roots.iter([&chunks](flecs::iter& it, const Transform* t, GlobalTransform* global_t)
+                  {
+                      if (!it.changed())
+                      {
+                          it.skip();
+                          return;
+                      }
+
+                      const auto count = static_cast<usize>(it.count());
+                      for (usize first{ 0 }; first < count; first += compose_chunk_size)
+                          chunks.push_back({ t + first, global_t + first, std::min(compose_chunk_size, count - first) });
+                  });
+
+                  if (chunks.size() == 1)
+                      compose_transforms(chunks[0].local, nullptr, chunks[0].global, chunks[0].count);
+                  else if (!chunks.empty())
+                  {
+                      tf::Taskflow taskflow;
+                      taskflow.for_each(chunks.begin(), chunks.end(), [](const ComposeChunk& chunk)
+                      {
+                          compose_transforms(chunk.local, nullptr, chunk.global, chunk.count);
+                      });
+                      jobs->get_executor().run(taskflow).wait();
+                  }
+              });
+
+    // Cascade walks the ChildOf hierarchy breadth first, so a parent's GlobalTransform is final before its children
+    // are visited. Splitting the tables over threads would break that ordering, so children run single threaded
+    // after the roots.
+    world.system<const Transform, const GlobalTransform*, GlobalTransform>("Transform system")
+        .kind(flecs::OnValidate)
+        .with(flecs::ChildOf, flecs::Wildcard)
+        .term_at(2).parent().cascade()
+        .term_at(3).out()
+        .iter([](flecs::iter& it, const Transform* t, const GlobalTransform* parent_t, GlobalTransform* global_t)
+              {
+                  if (!it.changed())
+                  {
+                      it.skip();
+                      return;
+                  }
+
+                  compose_transforms(t, parent_t, global_t, static_cast<usize>(it.count()));
               });
 }
 }
@@ -6,6 +6,8 @@
 
 namespace mas
 {
+// Relative to the parent when the entity is a ChildOf another entity with a GlobalTransform.
+// Change it through set() or call modified() after get_mut(), untouched transforms are not recomputed.
 struct Transform
 {
     glm::vec3 position{ 0.0f };
@@ -14,10 +16,22 @@ struct Transform
 };
 
 //Internal type to the engine, use mas::Transform instead.
+#ifdef MAS_COMPACT_GLOBAL_TRANSFORM
+// 48 bytes instead of 64, rows of the affine matrix whose fourth row is always (0, 0, 0, 1).
+struct GlobalTransform
+{
+    glm::vec4 rows[3]{ { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } };
+
+    [[nodiscard]] glm::mat4 matrix() const { return glm::transpose(glm::mat4(rows[0], rows[1], rows[2], glm::vec4(0.0f, 0.0f, 0.0f, 1.0f))); }
+};
+#else
 struct GlobalTransform
 {
     glm::mat4 transform{ 1.0f };
+
+    [[nodiscard]] glm::mat4 matrix() const { return transform; }
 };
+#endif
 
 struct TransformModule
 {
@@ -0,0 +1,47 @@
+#include "simd.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace mas
+{
+namespace
+{
+bool detect_avx2()
+{
+#if MAS_SSE && defined(_MSC_VER)
+    int info[4]{};
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    constexpr int fma{ 1 << 12 };
+    constexpr int osxsave{ 1 << 27 };
+    constexpr int avx{ 1 << 28 };
+    if ((info[2] & (fma | osxsave | avx)) != (fma | osxsave | avx))
+        return false;
+
+    // The xmm and ymm state has to be enabled by the os, or the upper halves are lost on context switches.
+    if ((_xgetbv(0) & 0x6) != 0x6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    constexpr int avx2{ 1 << 5 };
+    return (info[1] & avx2) != 0;
+#elif MAS_SSE && (defined(__GNUC__) || defined(__clang__))
+    // Also checks that the os enabled the ymm state.
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return false;
+#endif
+}
+}
+
+bool cpu_has_avx2()
+{
+    static const bool has_avx2 = detect_avx2();
+    return has_avx2;
+}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Instruction sets this translation unit is compiled for. x64 always has SSE2, AVX and FMA are only there when the
+// compiler targets them, /arch:AVX2 or -mavx2 -mfma.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAS_SSE 1
+#include <immintrin.h>
+#else
+#define MAS_SSE 0
+#endif
+
+#if MAS_SSE && defined(__AVX__)
+#define MAS_AVX 1
+#else
+#define MAS_AVX 0
+#endif
+
+#if MAS_AVX && defined(__AVX2__)
+#define MAS_AVX2 1
+#else
+#define MAS_AVX2 0
+#endif
+
+// Msvc has no switch for fma alone, it comes with /arch:AVX2.
+#if MAS_AVX && (defined(__FMA__) || (defined(_MSC_VER) && defined(__AVX2__)))
+#define MAS_FMA 1
+#else
+#define MAS_FMA 0
+#endif
+
+// The engine is built for the SSE2 baseline. Kernels that profit from wider lanes are compiled a second time in a
+// *_avx2.cpp file with /arch:AVX2, each build in its own namespace, and the cpu picks one on first use.
+// Inline functions from shared headers may be merged with their baseline copies by the linker, so the AVX2 builds
+// only use intrinsics and their own helpers.
+namespace mas
+{
+// Whether the cpu has AVX2 and FMA and the os saves the ymm registers. Checked once.
+bool cpu_has_avx2();
+}
@@ -0,0 +1,31 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+
+// Depth only. The instance index walks the group's range of the visible instances, filled by the cull shader with
+// the scene slots of the survivors.
+
+// Rows of the affine world matrix, the fourth row is (0, 0, 0, 1).
+struct SceneTransform
+{
+    vec4 rows[3];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer SceneTransforms { SceneTransform transforms[]; };
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer VisibleInstances { uint ids[]; };
+
+layout(push_constant) uniform Push
+{
+    mat4 view_proj;
+    SceneTransforms scene;
+    VisibleInstances visible;
+} push;
+
+layout(location = 0) in vec3 position;
+
+void main()
+{
+    SceneTransform transform = push.scene.transforms[push.visible.ids[gl_InstanceIndex]];
+    vec4 local = vec4(position, 1.0);
+    vec3 world = vec3(dot(transform.rows[0], local), dot(transform.rows[1], local), dot(transform.rows[2], local));
+    gl_Position = push.view_proj * vec4(world, 1.0);
+}
@@ -1,25 +1,36 @@
 #include <iostream>
+#include <string>
+#include <string_view>
 
 #include "engine.h"
 #include "modules/asset/asset_loader.h"
 #include "modules/render/render_module.h"
 
-int main()
+int main(int argc, char** argv)
 {
-    const auto settings = mas::AppSettings{
+    auto settings = mas::AppSettings{
         .window_settings = mas::WindowSettings{
             .width = 1920,
             .height = 1080,
             .title = "Mastodon Engine"
         },
     };
-    auto app = mas::App(settings);
 
-    for (usize i{ 0 }; i < 100; ++i)
+    // --headless [frame count] renders offscreen for benchmarks, then writes frame_times.csv and headless.png.
+    if (argc > 1 && std::string_view(argv[1]) == "--headless")
     {
-        app.world.entity().set(mas::Transform{}).set(mas::GlobalTransform{});
+        settings.render_settings.headless = mas::gfx::HeadlessSettings{
+            .capture_path = "headless.png",
+        };
+        if (argc > 2)
+            settings.render_settings.headless->frame_count = static_cast<u32>(std::stoul(argv[2]));
     }
 
+    auto app = mas::App(settings);
+
+    const std::vector<mas::Transform> transforms(100);
+    app.spawn(transforms);
+
     app.world.system<mas::AssetLoader>()
         .kind(flecs::OnStart)
         .term_at(1).singleton()